@@ -0,0 +1,279 @@
+/*!
+* @file 	benchmark.cpp
+* @brief	Native benchmark suite. Measures per-update latency distributions
+* 			of the filters on a deterministic synthetic gait trace (or on a
+* 			recorded binary log passed as second argument) plus
+* 			microbenchmarks of some often hit routines. Output is
+* 			tab-separated (one line per benchmark) such that runs can be
+* 			diffed between releases.
+*
+* 			Usage: LSE_benchmark [parameterFile] [trace.lse]
+ */
+
+#include "Manager.hpp"
+#ifdef USE_CERES
+#include "FilterFLS.hpp"
+#endif
+#include "tinyxml.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <ctime>
+#include <vector>
+
+namespace LSE {
+
+/*! Forwards private Manager internals to the microbenchmarks */
+class BenchmarkAccess{
+public:
+	static Eigen::Matrix3d gamma(Manager& m,const int& k,const Eigen::Vector3d& w,const double& dt){
+		return m.gamma(k,w,dt);
+	}
+};
+
+}
+
+/*! Number of synthetic IMU steps per filter benchmark */
+static const int NSTEP = 10000;
+/*! IMU steps between two kinematic measurements */
+static const int ENC_STRIDE = 10;
+/*! Calls per sample for the microbenchmarks */
+static const int BATCH = 1000;
+/*! Samples for the microbenchmarks */
+static const int NSAMPLE = 1000;
+
+/*! Monotonic clock in nanoseconds */
+static unsigned long long now(){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (unsigned long long)ts.tv_sec*1000000000ull+ts.tv_nsec;
+}
+
+/*! Prints one result line (times in nanoseconds) */
+static void report(const char* name,std::vector<double>& ns){
+	std::sort(ns.begin(),ns.end());
+	double mean = 0;
+	for(unsigned int i=0;i<ns.size();i++) mean += ns[i];
+	mean = mean/ns.size();
+	double median = ns[ns.size()/2];
+	double p99 = ns[(unsigned int)(0.99*(ns.size()-1))];
+	double max = ns[ns.size()-1];
+	printf("%s\t%u\t%.0f\t%.0f\t%.0f\t%.0f\n",name,(unsigned int)ns.size(),median,p99,mean,max);
+}
+
+/*! Forward kinematics of a StarlETH-like robot (hip abduction, hip flexion,
+ * knee flexion), same geometry as the defaults of RobotCalibration */
+static Eigen::Vector3d legKin(Eigen::Matrix<double,LSE_DOF_LEG,1> a,int i){
+	double bx = 0.2525;
+	double by = 0.185;
+	double lH = -0.0685;
+	double lT = -0.2;
+	double lS = -0.235;
+	Eigen::Vector3d s;
+	s(0) = ((i<2)*2-1)*bx+lT*sin(a(1))+lS*sin(a(1)+a(2));
+	s(1) = -((i%2)*2-1)*by-sin(a(0))*(lH+lT*cos(a(1))+lS*cos(a(1)+a(2)));
+	s(2) = cos(a(0))*(lH+lT*cos(a(1))+lS*cos(a(1)+a(2)));
+	return s;
+}
+
+/*! Forward kinematics Jacobian (see legKin) */
+static Eigen::Matrix<double,3,LSE_DOF_LEG> legKinJac(Eigen::Matrix<double,LSE_DOF_LEG,1> a,int i){
+	Eigen::Matrix<double,3,LSE_DOF_LEG> J;
+	J.setZero();
+	double lH = -0.0685;
+	double lT = -0.2;
+	double lS = -0.235;
+	J(0,1) = lS*cos(a(1)+a(2))+lT*cos(a(1));
+	J(0,2) = lS*cos(a(1)+a(2));
+	J(1,0) = -cos(a(0))*(lH+lT*cos(a(1))+lS*cos(a(1)+a(2)));
+	J(1,1) = sin(a(0))*(lT*sin(a(1))+lS*sin(a(1)+a(2)));
+	J(1,2) = lS*sin(a(0))*sin(a(1)+a(2));
+	J(2,0) = -sin(a(0))*(lH+lT*cos(a(1))+lS*cos(a(1)+a(2)));
+	J(2,1) = -cos(a(0))*(lT*sin(a(1))+lS*sin(a(1)+a(2)));
+	J(2,2) = -lS*cos(a(0))*sin(a(1)+a(2));
+	return J;
+}
+
+/*! Deterministic synthetic gait measurements at step i (1kHz IMU) */
+static void synthMeas(const int& i,double& t,LSE::ImuMeas& imu,LSE::EncMeas& enc){
+	t = i*0.001;
+	imu.f_(0) = 0.1*sin(2*t);
+	imu.f_(1) = -0.05*cos(3*t);
+	imu.f_(2) = 9.81+0.2*sin(5*t);
+	imu.w_(0) = 0.01*sin(t);
+	imu.w_(1) = 0.02*cos(2*t);
+	imu.w_(2) = -0.02*sin(3*t);
+	for(int j=0;j<LSE_N_LEG*LSE_DOF_LEG;j++){
+		enc.e_(j) = 0.3+0.05*sin(4*t+j);
+		enc.v_(j) = 0.2*cos(4*t+j);
+	}
+	for(int j=0;j<LSE_N_LEG;j++){
+		enc.CF_[j] = (sin(4*t+j*1.57)>-0.9);
+	}
+}
+
+/*! Writes a copy of the parameter file with the given active filter */
+static int makeParFile(const char* pFilename,const int& filter,const char* pOutname){
+	TiXmlDocument doc(pFilename);
+	if(!doc.LoadFile()) return 0;
+	TiXmlElement* pElem = TiXmlHandle(&doc).FirstChildElement("LeggedStateEstimator").Element();
+	if(pElem==NULL) return 0;
+	pElem->SetAttribute("activeFilter",filter);
+	return doc.SaveFile(pOutname);
+}
+
+/*! Per-update latency distribution of one filter on the synthetic trace */
+static void benchFilter(const char* name,const char* pParfile){
+	LSE::Manager manager(pParfile,&legKin,&legKinJac);
+	std::vector<double> ns;
+	ns.reserve(NSTEP);
+	double t;
+	LSE::ImuMeas imu;
+	LSE::EncMeas enc;
+	for(int i=1;i<=NSTEP;i++){
+		synthMeas(i,t,imu,enc);
+		manager.addImuMeas(t,imu);
+		if(i%ENC_STRIDE==0) manager.addEncMeas(t,enc);
+		unsigned long long t0 = now();
+		manager.update(t);
+		ns.push_back((double)(now()-t0));
+	}
+	report(name,ns);
+}
+
+/*! Replay throughput of one filter on a recorded binary log */
+static void benchReplay(const char* name,const char* pParfile,const char* pTrace){
+	LSE::Manager manager(pParfile,&legKin,&legKinJac);
+	unsigned long long t0 = now();
+	int n = manager.replay(pTrace,0,1e12);
+	double el = (double)(now()-t0);
+	if(n<=0){
+		printf("# %s: no records replayed from %s\n",name,pTrace);
+		return;
+	}
+	printf("%s\t%d\t%.0f\t-\t%.0f\t-\n",name,n,el/n,el/n);
+}
+
+#ifdef USE_CERES
+/*! Per-update latency distribution of the fixed-lag smoother */
+static void benchFLS(const char* pParfile){
+	LSE::Manager manager(pParfile,&legKin,&legKinJac);
+	LSE::FilterFLS fls(&manager,pParfile);
+	std::vector<double> ns;
+	ns.reserve(NSTEP);
+	double t;
+	LSE::ImuMeas imu;
+	LSE::EncMeas enc;
+	for(int i=1;i<=NSTEP;i++){
+		synthMeas(i,t,imu,enc);
+		manager.addImuMeas(t,imu);
+		if(i%ENC_STRIDE==0) manager.addEncMeas(t,enc);
+		unsigned long long t0 = now();
+		fls.update(t);
+		ns.push_back((double)(now()-t0));
+	}
+	report("FilterFLS/update",ns);
+}
+#endif
+
+/*! Microbenchmark of Manager::gamma (uncached, arguments change per call) */
+static double benchGamma(const char* pParfile){
+	LSE::Manager manager(pParfile,&legKin,&legKinJac);
+	std::vector<double> ns;
+	ns.reserve(NSAMPLE);
+	Eigen::Vector3d w;
+	double chk = 0;
+	for(int i=0;i<NSAMPLE;i++){
+		unsigned long long t0 = now();
+		for(int j=0;j<BATCH;j++){
+			w(0) = 0.1+1e-6*(i*BATCH+j);
+			w(1) = -0.2;
+			w(2) = 0.05;
+			chk += LSE::BenchmarkAccess::gamma(manager,2,w,0.01)(0,0);
+		}
+		ns.push_back((double)(now()-t0)/BATCH);
+	}
+	report("Manager::gamma",ns);
+	return chk;
+}
+
+/*! Microbenchmark of Rotations::quatToRotMat */
+static double benchQuatToRotMat(){
+	std::vector<double> ns;
+	ns.reserve(NSAMPLE);
+	LSE::Rotations::Quat q;
+	double chk = 0;
+	for(int i=0;i<NSAMPLE;i++){
+		unsigned long long t0 = now();
+		for(int j=0;j<BATCH;j++){
+			q(0) = 0.2*sin(1e-3*(i*BATCH+j));
+			q(1) = 0.1;
+			q(2) = -0.2;
+			q(3) = sqrt(1-q(0)*q(0)-0.05);
+			chk += LSE::Rotations::quatToRotMat(q)(0,0);
+		}
+		ns.push_back((double)(now()-t0)/BATCH);
+	}
+	report("Rotations::quatToRotMat",ns);
+	return chk;
+}
+
+/*! Microbenchmark of the measurement-store insert path (in-order inserts) */
+static double benchMeasInsert(){
+	LSE::MeasStorage<LSE::ImuMeas,LSE_MEAS_N>* pStore = new LSE::MeasStorage<LSE::ImuMeas,LSE_MEAS_N>();
+	std::vector<double> ns;
+	ns.reserve(NSAMPLE);
+	LSE::ImuMeas imu;
+	imu.f_ << 0,0,9.81;
+	imu.w_.setZero();
+	double t = 0;
+	for(int i=0;i<NSAMPLE;i++){
+		unsigned long long t0 = now();
+		for(int j=0;j<BATCH;j++){
+			t += 0.001;
+			pStore->insert(std::make_pair(t,imu));
+		}
+		ns.push_back((double)(now()-t0)/BATCH);
+	}
+	report("MeasStorage::insert",ns);
+	delete pStore;
+	return t;
+}
+
+int main(int argc,char** argv){
+	const char* pParfile = argc>1 ? argv[1] : "Parameters.xml";
+	const char* pTrace = argc>2 ? argv[2] : NULL;
+
+	printf("# LSE benchmark suite (times in ns)\n");
+	printf("# name\tsamples\tmedian\tp99\tmean\tmax\n");
+
+	// Filter benchmarks (one patched parameter file per filter)
+	const char* names[3] = {"FilterVUKF/update","FilterOCEKF/update","FilterVUKF2/update"};
+	char parname[64];
+	for(int i=0;i<3;i++){
+		sprintf(parname,"benchmark_F%d.xml",i);
+		if(!makeParFile(pParfile,i,parname)){
+			printf("# could not load parameter file %s\n",pParfile);
+			return 1;
+		}
+		if(pTrace==NULL){
+			benchFilter(names[i],parname);
+		} else {
+			benchReplay(names[i],parname,pTrace);
+		}
+	}
+#ifdef USE_CERES
+	if(pTrace==NULL){
+		benchFLS("benchmark_F0.xml");
+	}
+#endif
+
+	// Microbenchmarks
+	double chk = 0;
+	chk += benchGamma("benchmark_F0.xml");
+	chk += benchQuatToRotMat();
+	chk += benchMeasInsert();
+	printf("# checksum %.6f\n",chk);
+
+	return 0;
+}
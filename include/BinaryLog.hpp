@@ -0,0 +1,255 @@
+/*!
+* @file 	BinaryLog.hpp
+* @author 	Michael Blösch
+* @date		10.10.2012
+* @brief	Binary logging of states and measurements
+ */
+
+#ifndef LSE_BINARYLOG_HPP_
+#define LSE_BINARYLOG_HPP_
+
+#include "Common.hpp"
+#include <fstream>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace LSE {
+
+/*! Magic number at the beginning of a binary log file ("BLSE") */
+#define LSE_BINLOG_MAGIC 0x45534C42
+/*! Version of the binary log format */
+#define LSE_BINLOG_VERSION 1
+/*! Size of each of the two write buffers [bytes] */
+#define LSE_BINLOG_BUFSIZE (1<<20)
+
+/*! File header of a binary log */
+struct BinaryLogFileHeader{
+	/*! Magic number (LSE_BINLOG_MAGIC) */
+	unsigned int magic_;
+	/*! Format version (LSE_BINLOG_VERSION) */
+	unsigned int version_;
+};
+
+/*! Record types of a binary log */
+enum BinaryLogRecordType{
+	LSE_RECORD_STATE = 1,
+	LSE_RECORD_IMU = 2,
+	LSE_RECORD_ENC = 3,
+	LSE_RECORD_SLIPPAGE = 4,
+	LSE_RECORD_POS = 5
+};
+
+/*! Header preceding each record */
+struct BinaryLogRecordHeader{
+	/*! Record type (BinaryLogRecordType) */
+	unsigned int type_;
+	/*! Size of the record payload [bytes] */
+	unsigned int size_;
+};
+
+/*! Fixed-size record of a State */
+struct StateRecord{
+	/*! Time */
+	double t_;
+	/*! Position */
+	double r_[3];
+	/*! Velocity */
+	double v_[3];
+	/*! Attitude (quaternion) */
+	double q_[4];
+	/*! Rotational rate */
+	double w_[3];
+	/*! Covariance matrix (column-major) */
+	double P_[12*12];
+};
+
+/*! Fixed-size record of an ImuMeas */
+struct ImuRecord{
+	/*! Time */
+	double t_;
+	/*! Accelerometer measurement */
+	double f_[3];
+	/*! Gyroscope measurement */
+	double w_[3];
+};
+
+/*! Fixed-size record of an EncMeas */
+struct EncRecord{
+	/*! Time */
+	double t_;
+	/*! Encoder position measurement (column-major) */
+	double e_[LSE_DOF_LEG*LSE_N_LEG];
+	/*! Encoder velocity measurement (column-major) */
+	double v_[LSE_DOF_LEG*LSE_N_LEG];
+	/*! Contact flag measurement */
+	int CF_[LSE_N_LEG];
+};
+
+/*! Fixed-size record of a PosMeas */
+struct PosRecord{
+	/*! Time */
+	double t_;
+	/*! Position measurement */
+	double r_[3];
+	/*! Attitude measurement (quaternion) */
+	double q_[4];
+};
+
+/*! Fixed-size record of a SlippageDetection */
+struct SlippageRecord{
+	/*! Time */
+	double t_;
+	/*! Flag for feet */
+	int flag_[LSE_N_LEG];
+	/*! Flag for feet (filtered) */
+	int flagFiltered_[LSE_N_LEG];
+	/*! Axis of slippage (column-major) */
+	double slipAxis_[3*LSE_N_LEG];
+	/*! Estimated (absolute) velocity of foot (column-major) */
+	double slip_[3*LSE_N_LEG];
+};
+
+/*! Double-buffered asynchronous writer of binary log files. Records are
+ * appended into an in-memory buffer (plain memcpy, no formatting), a
+ * background thread flushes full buffers to disk so the update path never
+ * stalls on I/O. */
+class BinaryLogWriter{
+public:
+	/*! Constructor */
+	BinaryLogWriter();
+	/*! Destructor, flushes and closes */
+	~BinaryLogWriter();
+	/*! Opens the log file and starts the flusher thread
+	 * @return	true on success
+	 * @param[in]	pFilename	name of log file
+	 */
+	bool open(const char* pFilename);
+	/*! Flushes all pending records and closes the file */
+	void close();
+	/*! Returns whether the writer is open */
+	bool isOpen();
+	/*! Appends a State record
+	 * @param[in]	x	state estimate
+	 */
+	void logState(const State& x);
+	/*! Appends an ImuMeas record
+	 * @param[in]	t	time of measurement
+	 * @param[in]	m	measurement data
+	 */
+	void logImuMeas(const double& t,const ImuMeas& m);
+	/*! Appends an EncMeas record
+	 * @param[in]	t	time of measurement
+	 * @param[in]	m	measurement data
+	 */
+	void logEncMeas(const double& t,const EncMeas& m);
+	/*! Appends a PosMeas record
+	 * @param[in]	t	time of measurement
+	 * @param[in]	m	measurement data
+	 */
+	void logPosMeas(const double& t,const PosMeas& m);
+	/*! Appends a SlippageDetection record
+	 * @param[in]	t	time of detection
+	 * @param[in]	s	slippage detection
+	 */
+	void logSlippage(const double& t,const SlippageDetection& s);
+
+private:
+	/*! Appends a record to the front buffer, swaps buffers when full
+	 * @param[in]	type	record type
+	 * @param[in]	pData	record payload
+	 * @param[in]	size	payload size [bytes]
+	 */
+	void append(const unsigned int& type,const void* pData,const unsigned int& size);
+	/*! Entry of the flusher thread, writes full back buffers to disk */
+	void flushLoop();
+
+	/*! Output file stream (only touched by the flusher thread after open) */
+	std::ofstream ofs_;
+	/*! The two write buffers */
+	std::vector<char> buf_[2];
+	/*! Index of the front buffer (appended to by the logging thread) */
+	int front_;
+	/*! Flusher thread */
+	std::thread thread_;
+	/*! Mutex protecting buffers and flags */
+	std::mutex mutex_;
+	/*! Signals the flusher thread */
+	std::condition_variable cond_;
+	/*! True while the writer is open */
+	bool mbOpen_;
+	/*! True if the back buffer waits to be flushed */
+	bool mbFlushPending_;
+};
+
+/*! Sequential reader of binary log files (offline tools) */
+class BinaryLogReader{
+public:
+	/*! Constructor */
+	BinaryLogReader();
+	/*! Destructor */
+	~BinaryLogReader();
+	/*! Opens the log file and checks the file header
+	 * @return	true on success
+	 * @param[in]	pFilename	name of log file
+	 */
+	bool open(const char* pFilename);
+	/*! Closes the file */
+	void close();
+	/*! Reads the next record into the corresponding member
+	 * @return	type of record read (BinaryLogRecordType, 0 at end of file)
+	 */
+	int next();
+
+	/*! Last read State record */
+	StateRecord state_;
+	/*! Last read ImuMeas record */
+	ImuRecord imu_;
+	/*! Last read EncMeas record */
+	EncRecord enc_;
+	/*! Last read PosMeas record */
+	PosRecord pos_;
+	/*! Last read SlippageDetection record */
+	SlippageRecord slippage_;
+
+private:
+	/*! Input file stream */
+	std::ifstream ifs_;
+};
+
+/*! Memory-mapped binary log, hands out zero-copy pointers into the mapping
+ * for high-rate offline replay (see Manager::replay) */
+class BinaryLogMapping{
+public:
+	/*! Constructor */
+	BinaryLogMapping();
+	/*! Destructor, unmaps */
+	~BinaryLogMapping();
+	/*! Maps the log file and checks the file header
+	 * @return	true on success
+	 * @param[in]	pFilename	name of log file
+	 */
+	bool open(const char* pFilename);
+	/*! Unmaps the file */
+	void close();
+	/*! Advances to the next record, payload_ points into the mapping
+	 * @return	type of record (BinaryLogRecordType, 0 at end of log)
+	 */
+	int next();
+
+	/*! Payload of the current record (valid until close()) */
+	const void* payload_;
+
+private:
+	/*! Mapped file contents */
+	char* pData_;
+	/*! Size of the mapping [bytes] */
+	unsigned long long size_;
+	/*! Read position [bytes] */
+	unsigned long long pos_;
+};
+
+}
+
+#endif /* LSE_BINARYLOG_HPP_ */
@@ -12,11 +12,38 @@
 #include <vector>
 
 #define LSE_MEAS_N 100000
+#define LSE_QUEUE_N 4096
+#define LSE_SNAPSHOT_N 50
+/* Optical flow: maximal feature count per sample and ring capacity, can be
+ * overridden from the build (the measurement size scales with LSE_OFL_N) */
+#ifndef LSE_OFL_N
+#define LSE_OFL_N 160
+#endif
+#ifndef LSE_OFL_MEAS_N
+#define LSE_OFL_MEAS_N 4096
+#endif
+/* Robot geometry, can be overridden from the build (cmake -DLSE_N_LEG=6),
+ * all fixed-size Eigen types are instantiated for the configured geometry */
+#ifndef LSE_DOF_LEG
 #define LSE_DOF_LEG 3
+#endif
+#ifndef LSE_N_LEG
 #define LSE_N_LEG 4
+#endif
 
 #define LSE_VUKF_N 15
 
+#define LSE_PERF_STAGE_N 4
+#define LSE_PERF_HIST_N 16
+#define LSE_PERF_STAGE_PRE 0
+#define LSE_PERF_STAGE_ENC 1
+#define LSE_PERF_STAGE_SLIP 2
+#define LSE_PERF_STAGE_LOG 3
+
+#ifdef LSE_PERF
+#include <time.h>
+#endif
+
 namespace LSE {
 
 /*! Contact Flag Class */
@@ -28,7 +55,7 @@ public:
 	/*! Returns the number of contact points
 	 * @return	number of contact points
 	 */
-	int sum(){
+	int sum() const{
 		int s = 0;
 		for(int i=0;i<LSE_N_LEG;i++){
 			if(F_[i]){
@@ -81,13 +108,19 @@ struct PosMeas{
 	Rotations::Quat q_;
 };
 
-/*! OF measurement structure */
+/*! OF measurement structure. Fixed-capacity inline storage: up to LSE_OFL_N
+ * features in one contiguous aligned block (one column per feature), no heap
+ * allocation per sample. */
 struct OflMeas{
 	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
-	/*! Bearing vector */
-	std::vector<Eigen::Vector3d> x_;
-	/*! OF measurement */
-	std::vector<Eigen::Vector3d> u_;
+	/*! Number of valid features */
+	int n_;
+	/*! Bearing vectors */
+	Eigen::Matrix<double,3,LSE_OFL_N> x_;
+	/*! OF measurements */
+	Eigen::Matrix<double,3,LSE_OFL_N> u_;
+
+	OflMeas(): n_(0){}
 };
 
 /*! State of robot main body */
@@ -129,6 +162,69 @@ struct SlippageDetection{
 	Eigen::Matrix<double,3,LSE_N_LEG> slip_;
 };
 
+/*! Per-stage latency statistics (cycle counts, filled via LSE_TIC/LSE_TOC) */
+struct PerfStats{
+	PerfStats(){
+		reset();
+	}
+	/*! Clears all counters and histograms */
+	void reset(){
+		for(int i=0;i<LSE_PERF_STAGE_N;i++){
+			count_[i] = 0;
+			cycles_[i] = 0;
+			maxCycles_[i] = 0;
+			for(int j=0;j<LSE_PERF_HIST_N;j++){
+				hist_[i][j] = 0;
+			}
+		}
+	}
+	/*! Accumulates one latency sample for the given stage
+	 * @param[in]	stage	stage index
+	 * @param[in]	c		elapsed cycles
+	 */
+	void add(const int& stage,const unsigned long long& c){
+		count_[stage]++;
+		cycles_[stage] += c;
+		if(c>maxCycles_[stage]) maxCycles_[stage] = c;
+		int bin = 0;
+		unsigned long long v = c>>7;
+		while(v!=0 && bin<LSE_PERF_HIST_N-1){
+			v = v>>1;
+			bin++;
+		}
+		hist_[stage][bin]++;
+	}
+	/*! Number of samples per stage */
+	unsigned long long count_[LSE_PERF_STAGE_N];
+	/*! Accumulated cycles per stage */
+	unsigned long long cycles_[LSE_PERF_STAGE_N];
+	/*! Worst-case cycles per stage */
+	unsigned long long maxCycles_[LSE_PERF_STAGE_N];
+	/*! Latency histograms, log2 binning: bin 0 holds samples below 128 cycles,
+	 * bin i holds samples in [128*2^(i-1),128*2^i) cycles */
+	unsigned long long hist_[LSE_PERF_STAGE_N][LSE_PERF_HIST_N];
+};
+
+#ifdef LSE_PERF
+/*! Reads the CPU cycle counter (nanoseconds on non-x86 targets) */
+inline unsigned long long perfCycles(){
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned int lo,hi;
+	__asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+	return ((unsigned long long)hi << 32) | lo;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC,&ts);
+	return (unsigned long long)ts.tv_sec*1000000000ull+ts.tv_nsec;
+#endif
+}
+#define LSE_TIC(name) unsigned long long perfTic_##name = LSE::perfCycles();
+#define LSE_TOC(stats,stage,name) (stats).add(stage,LSE::perfCycles()-perfTic_##name);
+#else
+#define LSE_TIC(name)
+#define LSE_TOC(stats,stage,name)
+#endif
+
 }
 
 #endif /* LSE_COMMON_HPP_ */
@@ -11,8 +11,9 @@
 #include "Common.hpp"
 #include <Eigen/Dense>
 #include "Rotations.hpp"
-#include <map>
+#include "MeasStorage.hpp"
 #include <vector>
+#include <complex>
 
 namespace LSE {
 
@@ -36,6 +37,27 @@ public:
 	 */
 	int calibrateDelay(const double& t,const double& T);
 
+	/* -------------------- Streaming (online) identification --------------------- */
+	/*! Returns whether the streaming identification is enabled (parameter file)
+	 * @return	true if streaming mode is active
+	 */
+	bool isStreaming() const;
+	/*! Feeds one IMU measurement to the streaming identification
+	 * @param[in]	t	time of measurement
+	 * @param[in]	m	measurement data
+	 */
+	void addImuSample(const double& t,const ImuMeas& m);
+	/*! Feeds one kinematic measurement to the streaming identification
+	 * @param[in]	t	time of measurement
+	 * @param[in]	m	measurement data
+	 */
+	void addEncSample(const double& t,const EncMeas& m);
+	/*! Feeds one pose sensor measurement to the streaming identification
+	 * @param[in]	t	time of measurement
+	 * @param[in]	m	measurement data
+	 */
+	void addPosSample(const double& t,const PosMeas& m);
+
 
 private:
 	/* -------------------- Various private functions --------------------- */
@@ -57,11 +79,93 @@ private:
 	 * @param[in]	p	location of footholds
 	 */
 	Rotations::Quat quatFromFootholds(const EncMeas& m,const Eigen::Matrix<double,3,LSE_N_LEG>& p);
+	/*! In-place iterative radix-2 FFT (inverse includes the 1/L scaling)
+	 * @param[in/out]	a		signal (length must be a power of two)
+	 * @param[in]		inverse	true for inverse transform
+	 */
+	void fft(std::vector<std::complex<double> >& a,const bool& inverse);
+	/*! Searches the delay offset maximizing the cross-correlation between the
+	 * centered length-M window of ref and the signal sig. FFT-based, O(N log N).
+	 * @return	offset (in samples) of the correlation maximum
+	 * @param[in]	sig	signal searched over (length N_)
+	 * @param[in]	ref	signal providing the reference window (length N_)
+	 * @param[in]	M	window length
+	 */
+	int bestCorrelationOffset(const std::vector<double>& sig,const std::vector<double>& ref,const int& M);
 	/*! Loads overall parameters from parameter file
 	 * @param[in]	pFilename	name of parameter file
 	 */
 	void loadParam(const char* pFilename);
 
+	/* -------------------- Streaming identification internals --------------------- */
+	/*! Rate-norm stream of one modality (streaming mode). Resamples the
+	 * incoming rate-norm points onto the common streamDt_ grid (piecewise
+	 * linear, as in the batch routine) and keeps the recent grid samples
+	 * needed by the lagged correlation in a small ring. */
+	struct NormStream{
+		/*! Ring of resampled rate norms (index = grid index modulo size) */
+		std::vector<double> ring_;
+		/*! First produced grid index */
+		long first_;
+		/*! Next grid index to produce */
+		long next_;
+		/*! Time of previous rate-norm point */
+		double lastTime_;
+		/*! Norm of previous rate-norm point */
+		double lastNorm_;
+		/*! True once the first rate-norm point arrived */
+		bool mbInit_;
+
+		/*! Clears the stream and sets the history length
+		 * @param[in]	size	ring size (history length in grid samples)
+		 */
+		void reset(const int& size);
+		/*! Feeds one rate-norm point, resampling onto the grid
+		 * @param[in]	t		time of rate-norm point
+		 * @param[in]	norm	rotational rate norm
+		 * @param[in]	dt		grid spacing
+		 */
+		void push(const double& t,const double& norm,const double& dt);
+		/*! Returns the resampled norm at grid index i (must be within the ring)
+		 * @return	resampled rate norm
+		 * @param[in]	i	grid index
+		 */
+		double at(const long& i) const;
+	};
+	/*! Exponentially forgetting correlation bank of one modality pair
+	 * (streaming mode). Accumulates C_k = sum lambda^age * x[n]*y[n-k] for
+	 * lags k in [-lagN,lagN], the argmax over k tracks the relative delay. */
+	struct CorrBank{
+		/*! Lagged correlation accumulators (entry lagN+k holds lag k) */
+		std::vector<double> c_;
+		/*! Next grid index to consume */
+		long next_;
+		/*! Effective sample count (with forgetting) */
+		double weight_;
+
+		/*! Clears the bank
+		 * @param[in]	lagN	maximal lag in grid samples
+		 */
+		void reset(const int& lagN);
+	};
+	/*! Consumes all grid samples available to both streams of a pair and
+	 * updates the correlation bank
+	 * @param[in/out]	bank	correlation bank of the pair
+	 * @param[in]		sx		stream of the leading modality
+	 * @param[in]		sy		stream of the lagging modality
+	 */
+	void updateCorrelation(CorrBank& bank,const NormStream& sx,const NormStream& sy);
+	/*! Returns the delay estimate of a correlation bank (argmax over the lags,
+	 * refined to sub-grid resolution by parabolic interpolation)
+	 * @return	delay estimate [s]
+	 * @param[in]	bank	correlation bank of the pair
+	 */
+	double bankEstimate(const CorrBank& bank) const;
+	/*! Applies the refined delay estimates to the Manager (throttled)
+	 * @param[in]	t	current measurement time
+	 */
+	void applyStreamEstimates(const double& t);
+
 	/* -------------------- Pointers and timing stuff --------------------- */
 	/*! Pointer to main class Manager */
 	Manager* pManager_;
@@ -82,23 +186,23 @@ private:
 	/*! Storage of pose sensor rotational rate norms */
 	std::vector<double> posRateNorm_;
 	/*! Iterator for the IMU measurements */
-	std::map<double,ImuMeas>::iterator itImu_;
+	MeasStorage<ImuMeas,LSE_MEAS_N>::iterator itImu_;
 	/*! Iterator for the kinematic measurements (first) */
-	std::map<double,EncMeas>::iterator itEnc_;
+	MeasStorage<EncMeas,LSE_MEAS_N>::iterator itEnc_;
 	/*! Iterator for the kinematic measurements (second) */
-	std::map<double,EncMeas>::iterator itEnc2_;
+	MeasStorage<EncMeas,LSE_MEAS_N>::iterator itEnc2_;
 	/*! Reverse iterator for the kinematic measurements (first) */
-	std::map<double,EncMeas>::reverse_iterator ritEnc_;
+	MeasStorage<EncMeas,LSE_MEAS_N>::reverse_iterator ritEnc_;
 	/*! Reverse iterator for the kinematic measurements (second) */
-	std::map<double,EncMeas>::reverse_iterator ritEnc2_;
+	MeasStorage<EncMeas,LSE_MEAS_N>::reverse_iterator ritEnc2_;
 	/*! Iterator for the pose sensor measurements (first) */
-	std::map<double,PosMeas>::iterator itPos_;
+	MeasStorage<PosMeas,LSE_MEAS_N>::iterator itPos_;
 	/*! Iterator for the pose sensor measurements (second) */
-	std::map<double,PosMeas>::iterator itPos2_;
+	MeasStorage<PosMeas,LSE_MEAS_N>::iterator itPos2_;
 	/*! Reverse iterator for the pose sensor measurements (first) */
-	std::map<double,PosMeas>::reverse_iterator ritPos_;
+	MeasStorage<PosMeas,LSE_MEAS_N>::reverse_iterator ritPos_;
 	/*! Reverse iterator for the pose sensor measurements (second) */
-	std::map<double,PosMeas>::reverse_iterator ritPos2_;
+	MeasStorage<PosMeas,LSE_MEAS_N>::reverse_iterator ritPos2_;
 
 	/* -------------------- Temporary quantities used during differentiation and interpolation --------------------- */
 	/*! Time of last evaluation */
@@ -131,6 +235,56 @@ private:
 	bool mbUseEnc_;
 	/*! Flag whether to use the pose sensor measurements */
 	bool mbUsePos_;
+
+	/* -------------------- Streaming identification state and parameters --------------------- */
+	/*! Flag whether the streaming identification is enabled */
+	bool mbStreaming_;
+	/*! Grid spacing of the streaming resampling [s] */
+	double streamDt_;
+	/*! Forgetting time constant of the correlation accumulators [s] */
+	double streamTimeConstant_;
+	/*! Interval between two applications of the refined estimates [s] */
+	double streamInterval_;
+	/*! Maximal lag in grid samples */
+	int lagN_;
+	/*! Per-grid-sample forgetting factor (derived from streamTimeConstant_) */
+	double streamForget_;
+	/*! Time of last application of the estimates */
+	double lastApplyTime_;
+	/*! Running estimate of the IMU sampling time (streaming mode) */
+	double streamTsImu_;
+	/*! Time of previous IMU sample (streaming mode) */
+	double lastImuStamp_;
+	/*! Rate-norm stream of the IMU */
+	NormStream imuStream_;
+	/*! Rate-norm stream of the kinematics */
+	NormStream encStream_;
+	/*! Rate-norm stream of the pose sensor */
+	NormStream posStream_;
+	/*! Correlation bank IMU-kinematics */
+	CorrBank corrImuEnc_;
+	/*! Correlation bank IMU-pose sensor */
+	CorrBank corrImuPos_;
+	/*! Correlation bank kinematics-pose sensor */
+	CorrBank corrEncPos_;
+	/*! Footholds used by the streaming kinematic attitude (refreshed on full stance) */
+	Eigen::Matrix<double,3,LSE_N_LEG> streamFootholds_;
+	/*! True once footholds are available */
+	bool mbStreamFootholds_;
+	/*! True if a leg lost contact since the last foothold refresh */
+	bool mbStanceBroken_;
+	/*! Recent kinematic attitude samples (times, ring of difWindowEnc_+1) */
+	std::vector<double> encQuatTimes_;
+	/*! Recent kinematic attitude samples (quaternions) */
+	std::vector<Rotations::Quat,Eigen::aligned_allocator<Rotations::Quat> > encQuats_;
+	/*! Number of accepted kinematic attitude samples */
+	long encQuatCnt_;
+	/*! Recent pose sensor attitude samples (times, ring of difWindowPos_+1) */
+	std::vector<double> posQuatTimes_;
+	/*! Recent pose sensor attitude samples (quaternions) */
+	std::vector<Rotations::Quat,Eigen::aligned_allocator<Rotations::Quat> > posQuats_;
+	/*! Number of pose sensor attitude samples */
+	long posQuatCnt_;
 };
 
 }
@@ -42,10 +42,30 @@ public:
 	 * @param[in]	t	time used to initialize new state estimate
 	 */
 	virtual void resetEstimate(const double& t) = 0;
+	/*! Rolls the safe state back for a delayed measurement, the next update
+	 * re-filters from the restored state over the buffered measurements only.
+	 * Default implementation does nothing (filter keeps no snapshots).
+	 * @param[in]	t	filter time of the delayed measurement
+	 */
+	virtual void rollback(const double& t){};
 	/*! Returns a string describing the main filter parameters
 	 * @param[out] str	string characterize the parameter set of the filter
 	 */
 	virtual std::string getKeyString() = 0;
+	/*! Returns the accumulated per-stage latency statistics
+	 * @return	per-stage latency statistics
+	 */
+	PerfStats getPerfStats(){
+		return perfStats_;
+	}
+	/*! Clears the per-stage latency statistics */
+	void resetPerfStats(){
+		perfStats_.reset();
+	}
+
+protected:
+	/*! Per-stage latency statistics, filled via LSE_TIC/LSE_TOC */
+	PerfStats perfStats_;
 };
 
 }
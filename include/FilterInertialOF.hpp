@@ -10,6 +10,7 @@
 
 #include "FilterBase.hpp"
 #include "Common.hpp"
+#include "MeasStorage.hpp"
 #include <Eigen/Dense>
 #include "Rotations.hpp"
 
@@ -106,7 +107,7 @@ private:
 		/*! Estimate of covariance matrix */
 		Eigen::Matrix<double,15,15> P_;
 		/*! Innovation of update setp */
-		Eigen::Matrix<double,12,1> y_;
+		Eigen::Matrix<double,3*LSE_N_LEG,1> y_;
 
 		/* -------------------- Operator overloading --------------------- */
 		/*! Assignement operator overloading */
@@ -144,7 +145,7 @@ private:
 	 * @param[in/out]	x		State
 	 * @param[in]		Pyinv	Innovation information matrix
 	 */
-	void outlierDetection(InternState& x,const Eigen::Matrix<double,12,12>& Pyinv);
+	void outlierDetection(InternState& x,const Eigen::Matrix<double,3*LSE_N_LEG,3*LSE_N_LEG>& Pyinv);
 	/*! Makes and entry of the cuurent state into the log-file */
 	void logState();
 
@@ -155,6 +156,10 @@ private:
 	InternState xs_;
 	/*! Predicted state */
 	InternState xp_;
+	/*! Monotonic lookup cursor into the IMU measurements */
+	MeasStorage<ImuMeas,LSE_MEAS_N>::cursor curImu_;
+	/*! Monotonic lookup cursor into the kinematic measurements */
+	MeasStorage<EncMeas,LSE_MEAS_N>::cursor curEnc_;
 
 	/* -------------------- Parameters (can be specified in the parameter file) --------------------- */
 	/*! Initialization state */
@@ -10,12 +10,14 @@
 
 #include "FilterBase.hpp"
 #include "Common.hpp"
+#include "MeasStorage.hpp"
 #include <Eigen/Dense>
 #include "Rotations.hpp"
 
 namespace LSE {
 
 class Manager;
+class SmootherOCEKF;
 
 /*! Observability Constrained Extended Kalman Filter */
 class FilterOCEKF: public FilterBase{
@@ -48,6 +50,10 @@ public:
 	 * @param[in]	t	time used to initialize new state estimate
 	 */
 	virtual void resetEstimate(const double& t);
+	/*! Rolls the safe state back to the newest snapshot older than t
+	 * @param[in]	t	filter time of the delayed measurement
+	 */
+	virtual void rollback(const double& t);
 	/*! Returns a string describing the main filter parameters
 	 * @param[out] str	string characterize the parameter set of the filter
 	 */
@@ -55,6 +61,8 @@ public:
 	/*! Makes and entry of the cuurent state into the log-file */
 	void logState();
 
+	/*! The offline smoother reuses the filtering machinery for its forward pass */
+	friend class SmootherOCEKF;
 
 private:
 	/*! Loads overall parameters from parameter file
@@ -122,14 +130,28 @@ private:
 	 * @param[in]		m	Encoder measurement
 	 */
 	void encUpdateState(InternState& x,const EncMeas& m);
+	/*! Stores the current safe state into the snapshot ring */
+	void storeSnapshot();
 
 	/* -------------------- Pointers and filter states --------------------- */
 	/*! Pointer to main class Manager */
 	Manager* pManager_;
+	/*! Optional recording sink of the offline smoother (not owned, NULL if inactive) */
+	SmootherOCEKF* pRecorder_;
 	/*! Safe state (where the chance is high that all measurements have arrived) */
 	InternState xs_;
 	/*! Predicted state */
 	InternState xp_;
+	/*! Monotonic lookup cursor into the IMU measurements */
+	MeasStorage<ImuMeas,LSE_MEAS_N>::cursor curImu_;
+	/*! Monotonic lookup cursor into the kinematic measurements */
+	MeasStorage<EncMeas,LSE_MEAS_N>::cursor curEnc_;
+	/*! Ring of past safe states (rollback on delayed measurements) */
+	InternState xSnapshot_[LSE_SNAPSHOT_N];
+	/*! Index of the next snapshot slot */
+	int snapshotInd_;
+	/*! Number of valid snapshots */
+	int snapshotCnt_;
 
 	/* -------------------- Parameters (can be specified in the parameter file) --------------------- */
 	/*! Initialization state */
@@ -10,6 +10,7 @@
 
 #include "FilterBase.hpp"
 #include "Common.hpp"
+#include "MeasStorage.hpp"
 #include <Eigen/Dense>
 #include "Rotations.hpp"
 
@@ -106,7 +107,7 @@ private:
 		/*! Estimate of covariance matrix */
 		Eigen::Matrix<double,15,15> P_;
 		/*! Innovation of update setp */
-		Eigen::Matrix<double,12,1> y_;
+		Eigen::Matrix<double,3*LSE_N_LEG,1> y_;
 
 		/* -------------------- Operator overloading --------------------- */
 		/*! Assignement operator overloading */
@@ -123,6 +124,41 @@ private:
 		}
 	};
 
+	/*! Preallocated scratch space for the sigma-point hot path. Owned by the
+	 * filter and reused every update, keeps update() allocation-free and the
+	 * per-call stack frames small. */
+	struct Workspace{
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+		/*! Augmented covariance matrix */
+		Matrix30d PA_;
+		/*! Cholesky factor of augmented covariance matrix */
+		Matrix30d SPA_;
+		/*! Sigma point being propagated/projected */
+		AugmentedState as_;
+		/*! State-space difference vector */
+		Eigen::Matrix<double,LSE_VUKF_N,1> vec15_;
+		/*! Leg kinematics */
+		Eigen::Matrix<double,3*LSE_N_LEG,1> s_;
+		/*! Leg kinematics Jacobian */
+		Eigen::Matrix<double,3*LSE_N_LEG,LSE_DOF_LEG> J_;
+		/*! Sampled kinematic measurement noise */
+		Eigen::Matrix<double,3*LSE_N_LEG,1> nf_;
+		/*! Projected sigma points */
+		Eigen::Matrix<double,3*LSE_N_LEG,2*(2*LSE_VUKF_N+3*LSE_N_LEG)+1> Y_;
+		/*! Innovation covariance */
+		Eigen::Matrix<double,3*LSE_N_LEG,3*LSE_N_LEG> Py_;
+		/*! Innovation information matrix */
+		Eigen::Matrix<double,3*LSE_N_LEG,3*LSE_N_LEG> Pyinv_;
+		/*! State-innovation cross-covariance */
+		Eigen::Matrix<double,LSE_VUKF_N,3*LSE_N_LEG> Pxy_;
+		/*! Kalman gain */
+		Eigen::Matrix<double,LSE_VUKF_N,3*LSE_N_LEG> K_;
+	};
+
+	/*! Per-filter workspace, allocated once in the constructor */
+	Workspace ws_;
+
 	/* -------------------- Filtering/Predicting/Updating --------------------- */
 	/*! Filters the state x up to the given time t
 	 * @param[in/out]	x	Filter state to be filtered
@@ -144,7 +180,7 @@ private:
 	 * @param[in/out]	x		State
 	 * @param[in]		Pyinv	Innovation information matrix
 	 */
-	void outlierDetection(InternState& x,const Eigen::Matrix<double,12,12>& Pyinv);
+	void outlierDetection(InternState& x,const Eigen::Matrix<double,3*LSE_N_LEG,3*LSE_N_LEG>& Pyinv);
 	/*! Makes and entry of the cuurent state into the log-file */
 	void logState();
 
@@ -155,6 +191,10 @@ private:
 	InternState xs_;
 	/*! Predicted state */
 	InternState xp_;
+	/*! Monotonic lookup cursor into the IMU measurements */
+	MeasStorage<ImuMeas,LSE_MEAS_N>::cursor curImu_;
+	/*! Monotonic lookup cursor into the kinematic measurements */
+	MeasStorage<EncMeas,LSE_MEAS_N>::cursor curEnc_;
 
 	/* -------------------- Parameters (can be specified in the parameter file) --------------------- */
 	/*! Initialization state */
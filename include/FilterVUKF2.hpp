@@ -14,45 +14,64 @@
 
 #include "FilterBase.hpp"
 #include "Common.hpp"
+#include "MeasStorage.hpp"
 #include <Eigen/Dense>
 #include "Rotations.hpp"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <vector>
+
+class TiXmlElement;
 
 namespace LSE {
 
 class Manager;
+class SlippageStage;
 class StateVUKF;
 class PreNoiseVUKF;
 class MeasKinNoiseVUKF;
 
-/*! Minimal Filter State */
-class VUKFFilterState{
+/*! Minimal Filter State. Templated on the scalar type: the double
+ * instantiation is the default filter, the float instantiation serves
+ * platforms where single-precision SIMD throughput is twice the double one. */
+template<typename ScalarType>
+class VUKFFilterStateT{
 public:
 	/*! Position estimate */
-	Eigen::Vector3d r_;
+	Eigen::Matrix<ScalarType,3,1> r_;
 	/*! Velocity estimate */
-	Eigen::Vector3d v_;
+	Eigen::Matrix<ScalarType,3,1> v_;
 	/*! Attitude estimate (quaternion) */
-	Rotations::Quat q_;
+	Eigen::Matrix<ScalarType,4,1> q_;
 	/*! Estimate of accelerometer bias */
-	Eigen::Vector3d bf_;
+	Eigen::Matrix<ScalarType,3,1> bf_;
 	/*! Estimate of gyroscope bias */
-	Eigen::Vector3d bw_;
+	Eigen::Matrix<ScalarType,3,1> bw_;
 
-	VUKFFilterState operator +(const Eigen::Matrix<double,VUKFF_state_dim,1> &y) const;
-	Eigen::Matrix<double,VUKFF_state_dim,1> operator -(const VUKFFilterState &y) const;
+	VUKFFilterStateT operator +(const Eigen::Matrix<ScalarType,VUKFF_state_dim,1> &y) const;
+	Eigen::Matrix<ScalarType,VUKFF_state_dim,1> operator -(const VUKFFilterStateT &y) const;
 };
 
-/*! Observability Constrained Extended Kalman Filter */
-class FilterVUKF2: public FilterBase{
+/*! Minimal Filter State (double precision) */
+typedef VUKFFilterStateT<double> VUKFFilterState;
+
+/*! Observability Constrained Extended Kalman Filter. Templated on the scalar
+ * type of the filter-internal arithmetic (covariances, sigma points, GEMMs).
+ * Interfaces (measurements, State, times) stay double, conversion happens
+ * once at the boundaries. Instantiated for double and float (FilterVUKF2 and
+ * FilterVUKF2f), timestamps are always kept in double. */
+template<typename ScalarType>
+class FilterVUKF2T: public FilterBase{
 public:public:
 	/* -------------------- Constructor/Destructor --------------------- */
 	/*! Constructor
 	 * @param[in]	pManager	pointer to main class Manager
 	 * @param[in]	pFilename	filename of parameter-file
 	 */
-	FilterVUKF2(Manager* pManager,const char* pFilename);
+	FilterVUKF2T(Manager* pManager,const char* pFilename);
 	/*! Destructor */
-	virtual ~FilterVUKF2();
+	virtual ~FilterVUKF2T();
 
 	/* -------------------- Filter handling --------------------- */
 	/*! Updates the filter to time t (may include prediction)
@@ -73,19 +92,33 @@ public:public:
 	 * @param[in]	t	time used to initialize new state estimate
 	 */
 	virtual void resetEstimate(const double& t);
+	/*! Rolls the safe state back to the newest snapshot older than t
+	 * @param[in]	t	filter time of the delayed measurement
+	 */
+	virtual void rollback(const double& t);
 	/*! Returns a string describing the main filter parameters
 	 * @param[out] str	string characterize the parameter set of the filter
 	 */
 	virtual std::string getKeyString();
 
 private:
-	typedef Eigen::Matrix<double,VUKFF_state_dim,VUKFF_state_dim> MatrixP;
-	typedef Eigen::Matrix<double,VUKFF_preNoise_dim,VUKFF_preNoise_dim> MatrixPreCov;
-	typedef Eigen::Matrix<double,VUKFF_upNoise_dim,VUKFF_upNoise_dim> MatrixUpCov;
+	typedef Eigen::Matrix<ScalarType,3,1> Vec3;
+	typedef Eigen::Matrix<ScalarType,3,3> Mat3;
+	typedef Eigen::Matrix<ScalarType,4,1> QuatS;
+	typedef Eigen::Matrix<ScalarType,VUKFF_state_dim,VUKFF_state_dim> MatrixP;
+	typedef Eigen::Matrix<ScalarType,VUKFF_preNoise_dim,VUKFF_preNoise_dim> MatrixPreCov;
+	typedef Eigen::Matrix<ScalarType,VUKFF_upNoise_dim,VUKFF_upNoise_dim> MatrixUpCov;
 	/*! Loads overall parameters from parameter file
 	 * @param[in]	pFilename	name of parameter file
 	 */
 	void loadParam(const char* pFilename);
+	/*! Reads a double attribute into a ScalarType target (value untouched if
+	 * the attribute is missing, matching QueryDoubleAttribute)
+	 * @param[in]	pElem	element to read from
+	 * @param[in]	pName	name of attribute
+	 * @param[out]	value	target value
+	 */
+	static void queryScalar(TiXmlElement* pElem,const char* pName,ScalarType& value);
 
 	/*! Structure of filter intern state */
 	struct InternState{
@@ -94,29 +127,74 @@ private:
 		/*! Time of estimate */
 		double t_;
 		/*! Minimal Filter State */
-		VUKFFilterState x_;
+		VUKFFilterStateT<ScalarType> x_;
 		/*! Estimate of covariance matrix */
-		VUKFFilterState X_[1+2*(VUKFF_state_dim+VUKFF_preNoise_dim+VUKFF_upNoise_dim)];
+		VUKFFilterStateT<ScalarType> X_[1+2*(VUKFF_state_dim+VUKFF_preNoise_dim+VUKFF_upNoise_dim)];
 		/*! Estimate of covariance matrix */
 		MatrixP P_;
+		/*! Lower Cholesky factor of covariance matrix (square-root mode) */
+		MatrixP S_;
 		/*! Sigma Samples of Prediction Noise*/
-		Eigen::Matrix<double,VUKFF_preNoise_dim,2*VUKFF_preNoise_dim> PN_;
+		Eigen::Matrix<ScalarType,VUKFF_preNoise_dim,2*VUKFF_preNoise_dim> PN_;
 		/*! Sigma Samples of Update Noise*/
-		Eigen::Matrix<double,VUKFF_upNoise_dim,2*VUKFF_upNoise_dim> UN_;
+		Eigen::Matrix<ScalarType,VUKFF_upNoise_dim,2*VUKFF_upNoise_dim> UN_;
 		/*! Contact flag counter */
 		CF CFC_;
 		/*! Legs used for kinematic update */
 		SlippageDetection slippageDetection_;
 		/*! Rotational rate estimate (bias corrected) */
-		Eigen::Vector3d w_;
+		Vec3 w_;
 		/*! Current corrected accelerometer measurement */
-		Eigen::Vector3d f_;
+		Vec3 f_;
 		/*! Innovation of update setp */
-		Eigen::Matrix<double,12,1> y_;
+		Eigen::Matrix<ScalarType,3*LSE_N_LEG,1> y_;
 		/*! Flag if Sigma points samples */
 		bool mbSigmaSampled_;
 	};
 
+	/*! Preallocated scratch space for the sigma-point hot path. Owned by the
+	 * filter and reused every update, keeps update() allocation-free and the
+	 * per-call stack frames small. */
+	struct Workspace{
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+		/*! State-space difference vector */
+		Eigen::Matrix<ScalarType,VUKFF_state_dim,1> vec_;
+		/*! Sigma-point deviations for the QR-based recombination */
+		Eigen::Matrix<ScalarType,2*(VUKFF_state_dim+VUKFF_preNoise_dim),VUKFF_state_dim> A_;
+		/*! Leg kinematics */
+		Eigen::Matrix<ScalarType,3*LSE_N_LEG,1> s_;
+		/*! Leg kinematics Jacobian */
+		Eigen::Matrix<ScalarType,3*LSE_N_LEG,LSE_DOF_LEG> J_;
+		/*! Sigma point being projected through the measurement function */
+		VUKFFilterStateT<ScalarType> filterState_;
+		/*! Sampled update noise vector */
+		Eigen::Matrix<ScalarType,VUKFF_upNoise_dim,1> upNoi_;
+		/*! Sampled gyroscope noise vector */
+		Vec3 wNoise_;
+		/*! Projected sigma points */
+		Eigen::Matrix<ScalarType,VUKFF_upNoise_dim,1+2*(VUKFF_state_dim+VUKFF_preNoise_dim+VUKFF_upNoise_dim)> Y_;
+		/*! Innovation covariance */
+		MatrixUpCov Py_;
+		/*! Innovation information matrix */
+		MatrixUpCov Pyinv_;
+		/*! Cholesky factor of innovation covariance (square-root mode) */
+		MatrixUpCov Sy_;
+		/*! State-innovation cross-covariance */
+		Eigen::Matrix<ScalarType,VUKFF_state_dim,VUKFF_upNoise_dim> Pxy_;
+		/*! Kalman gain */
+		Eigen::Matrix<ScalarType,VUKFF_state_dim,VUKFF_upNoise_dim> K_;
+		/*! Downdate matrix K*Sy (square-root mode) */
+		Eigen::Matrix<ScalarType,VUKFF_state_dim,VUKFF_upNoise_dim> U_;
+		/*! Attitude deviations of the sigma points (structure-of-arrays) */
+		Rotations::VecBatch<2*VUKFF_state_dim,ScalarType> dv_;
+		/*! Retracted sigma-point attitudes (structure-of-arrays) */
+		Rotations::QuatBatch<2*VUKFF_state_dim,ScalarType> dq_;
+	};
+
+	/*! Per-filter workspace, allocated once in the constructor */
+	Workspace ws_;
+
 	/*! Prediction noise matrix */
 	MatrixPreCov Npre_;
 	/*! Cholesky of Prediction noise matrix */
@@ -149,42 +227,108 @@ private:
 	 * @param[in/out]	x		State
 	 * @param[in]		Pyinv	Innovation information matrix
 	 */
-	void outlierDetection(InternState& x,const Eigen::Matrix<double,12,12>& Pyinv);
+	void outlierDetection(InternState& x,const Eigen::Matrix<ScalarType,3*LSE_N_LEG,3*LSE_N_LEG>& Pyinv);
+	/*! Rank-1 update of a lower triangular Cholesky factor: S*S' + beta*v*v'
+	 * @param[in/out]	x		Lower triangular Cholesky factor
+	 * @param[in]		v		Update vector
+	 * @param[in]		beta	Update weight (negative for downdate)
+	 */
+	void cholUpdate(MatrixP& S,const Eigen::Matrix<ScalarType,VUKFF_state_dim,1>& v,const double& beta);
 	/*! Makes and entry of the cuurent state into the log-file */
 	void logState();
 
 	void samplePredictionNoise(InternState& x,double dt);
 	void sampleUpdateNoise(InternState& x);
+	/*! Stores the current safe state into the snapshot ring */
+	void storeSnapshot();
+	/*! Propagates a single sigma point of the prediction step (the index range
+	 * covers the state part followed by the prediction-noise part)
+	 * @param[in/out]	x	Filter state
+	 * @param[in]		i	Sigma-point index (0 <= i <= 2*(VUKFF_state_dim+VUKFF_preNoise_dim))
+	 * @param[in]		dt	Prediction time step
+	 * @param[in]		m	IMU measurement
+	 */
+	void propagateSigmaPoint(InternState& x,const int& i,const double& dt,const ImuMeas& m);
+	/*! Dispatches the sigma-point propagation of one prediction step to the
+	 * worker pool and waits for its completion
+	 * @param[in/out]	x	Filter state
+	 * @param[in]		dt	Prediction time step
+	 * @param[in]		m	IMU measurement
+	 */
+	void runSigmaJob(InternState& x,const double& dt,const ImuMeas& m);
+	/*! Worker loop of the sigma-point pool, processes a strided shard of the
+	 * sigma points of every dispatched job
+	 * @param[in]	i			worker index
+	 * @param[in]	startJob	job count at the time of pool start
+	 */
+	void sigmaWorker(const int& i,const unsigned long& startJob);
 
 	/* -------------------- P=rediction function --------------------- */
-	void predict(VUKFFilterState& x,double dt,ImuMeas imuMeas);
-	void predict(VUKFFilterState& x,double dt,ImuMeas imuMeas,Eigen::Matrix<double,VUKFF_preNoise_dim,1> n);
+	void predict(VUKFFilterStateT<ScalarType>& x,double dt,ImuMeas imuMeas);
+	void predict(VUKFFilterStateT<ScalarType>& x,double dt,ImuMeas imuMeas,Eigen::Matrix<ScalarType,VUKFF_preNoise_dim,1> n);
 
 	/* -------------------- Pointers and filter states --------------------- */
 	/*! Pointer to main class Manager */
 	Manager* pManager_;
+	/*! Rate-controlled slippage-detection stage (owned) */
+	SlippageStage* pSlippageStage_;
 	/*! Safe state (where the chance is high that all measurements have arrived) */
 	InternState xs_;
 	/*! Predicted state */
 	InternState xp_;
+	/*! Monotonic lookup cursor into the IMU measurements */
+	MeasStorage<ImuMeas,LSE_MEAS_N>::cursor curImu_;
+	/*! Monotonic lookup cursor into the kinematic measurements */
+	MeasStorage<EncMeas,LSE_MEAS_N>::cursor curEnc_;
+	/*! Ring of past safe states (rollback on delayed measurements) */
+	InternState xSnapshot_[LSE_SNAPSHOT_N];
+	/*! Index of the next snapshot slot */
+	int snapshotInd_;
+	/*! Number of valid snapshots */
+	int snapshotCnt_;
+
+	/* -------------------- Sigma-point worker pool (parallel mode only) --------------------- */
+	/*! Worker threads sharding the sigma-point propagation */
+	std::vector<std::thread> workers_;
+	/*! Protects the job state of the pool */
+	std::mutex poolMutex_;
+	/*! Signals a new job (or pool shutdown) to the workers */
+	std::condition_variable poolCond_;
+	/*! Signals job completion to the dispatching thread */
+	std::condition_variable poolDone_;
+	/*! True while the worker pool is running */
+	bool mbPoolRunning_;
+	/*! Counter of dispatched jobs */
+	unsigned long jobId_;
+	/*! Number of workers still processing the current job */
+	int pendingTasks_;
+	/*! Filter state of the current job */
+	InternState* jobX_;
+	/*! Time step of the current job */
+	double jobDt_;
+	/*! IMU measurement of the current job */
+	ImuMeas jobMeas_;
 
 	/* -------------------- Parameters (can be specified in the parameter file) --------------------- */
 	/*! Initialization state */
 	InternState xInit_;
 	/*! Predicition noise of position [m^2/s] (continuous form) */
-	Eigen::Matrix3d Wr_;
+	Mat3 Wr_;
 	/*! Prediction noise of velocity */
-	Eigen::Matrix3d Wv_;
+	Mat3 Wv_;
 	/*! Prediction noise of attitude */
-	Eigen::Matrix3d Wq_;
+	Mat3 Wq_;
 	/*! Predicition noise of accelerometer bias [m^2/s^5] (continuous form */
-	Eigen::Matrix3d Wbf_;
+	Mat3 Wbf_;
 	/*! Predicition noise of gyroscope bias [rad^2/s^3] (continuous form */
-	Eigen::Matrix3d Wbw_;
+	Mat3 Wbw_;
 	/*! Threshold for kinematic outliers (there is an underlying chi-square distribution, dof=3) */
 	double kinOutTh_;
 	/*! Factor used during outlier restoration (must be larger than 1)*/
 	double restorationFactor_;
+	/*! Number of worker threads sharding the sigma-point propagation
+	 * (0: sequential propagation, no pool is started) */
+	int nSigmaThreads_;
 
 	/* -------------------- Parameters of unscented filter --------------------- */
 	/*! Alpha */
@@ -205,12 +349,20 @@ private:
 	bool mbEstimateRotBias_;
 	/*! True if kinematic measurements are used */
 	bool mbUseKin_;
+	/*! True if the covariance is propagated in square-root form (the Cholesky
+	 * factor is carried across updates, avoiding the per-sample refactorization) */
+	bool mbUseSquareRoot_;
 	/*! True if using fixed timestepping (bug handling in SL)*/
 	bool mbFixedTimeStepping_;
 	/*! Timestep used if fixed time stepping*/
 	double timeStep_;
 };
 
+/*! VUKF2 with double-precision internals (default) */
+typedef FilterVUKF2T<double> FilterVUKF2;
+/*! VUKF2 with single-precision internals (for platforms with fast float SIMD) */
+typedef FilterVUKF2T<float> FilterVUKF2f;
+
 }
 
 
@@ -17,16 +17,21 @@
 
 #include "FilterBase.hpp"
 #include "Common.hpp"
+#include "MeasStorage.hpp"
+#include "ManagerParams.hpp"
+#include "BinaryLog.hpp"
 #include "Rotations.hpp"
 #include "OptimizationFramework.hpp"
 #ifdef USE_CERES
 #include "RobotCalibration.hpp"
 #endif
 #include <Eigen/Dense>
-#include <map>
 #include <iostream>
 #include <sstream>
 #include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 namespace LSE {
 
@@ -42,6 +47,14 @@ public:
 	 * @param[in] 	J			function pointer to forward kinematic Jacobian (default = NULL)
 	 */
 	Manager(const char* pFilename,Eigen::Vector3d (*f)(Eigen::Matrix<double,LSE_DOF_LEG,1>,int),Eigen::Matrix<double,3,LSE_DOF_LEG> (*J)(Eigen::Matrix<double,LSE_DOF_LEG,1>,int) = NULL);
+	/*! Constructor with batched kinematics. The callbacks evaluate all
+	 * LSE_N_LEG legs in one call (joint angles column-wise) such that
+	 * implementations can share subexpressions and vectorize across legs.
+	 * @param[in]	pFilename	filename of parameter-file
+	 * @param[in] 	fBatch		function pointer to batched forward kinematic
+	 * @param[in] 	JBatch		function pointer to batched forward kinematic Jacobian, stacked vertically (default = NULL)
+	 */
+	Manager(const char* pFilename,void (*fBatch)(const Eigen::Matrix<double,LSE_DOF_LEG,LSE_N_LEG>&,Eigen::Matrix<double,3,LSE_N_LEG>&),void (*JBatch)(const Eigen::Matrix<double,LSE_DOF_LEG,LSE_N_LEG>&,Eigen::Matrix<double,3*LSE_N_LEG,LSE_DOF_LEG>&) = NULL);
 	/*! Destructor */
 	virtual ~Manager();
 
@@ -83,6 +96,27 @@ public:
 	void addOflMeas(const double& t,const OflMeas& m);
 	const OflMeas* getOflMeas(double& t);
 
+	/* -------------------- Lock-free ingestion --------------------- */
+	/*! Enqueues an IMU measurement from a driver thread. Wait-free for a
+	 * single producer per modality, drained at the beginning of update().
+	 * @return	true on success, false if the queue is full
+	 * @param[in]	t	time of measurement
+	 * @param[in] 	m	measurement data
+	 */
+	bool queueImuMeas(const double& t,const ImuMeas& m);
+	/*! Enqueues an encoders measurement from a driver thread (see queueImuMeas)
+	 * @return	true on success, false if the queue is full
+	 * @param[in]	t	time of measurement
+	 * @param[in] 	m	measurement data
+	 */
+	bool queueEncMeas(const double& t,const EncMeas& m);
+	/*! Enqueues a pose sensor measurement from a driver thread (see queueImuMeas)
+	 * @return	true on success, false if the queue is full
+	 * @param[in]	t	time of measurement
+	 * @param[in] 	m	measurement data
+	 */
+	bool queuePosMeas(const double& t,const PosMeas& m);
+
 	/* -------------------- Filter and Calibration Handling --------------------- */
 	/*! Updates the filter to time t
 	 * @param[in]	t	desired update time
@@ -90,14 +124,50 @@ public:
 	void update(const double& t);
 	/*! Updates the filter to the newest measurement time */
 	void update();
+	/*! Replays the measurements of a binary log. The log is memory-mapped and
+	 * the records are streamed directly into the filter (measurements between
+	 * t0 and t1, filter stepped at IMU rate), no Python round trips and no
+	 * per-sample allocation.
+	 * @return	number of measurements replayed
+	 * @param[in]	pFilename	name of binary log file
+	 * @param[in]	t0	start of replay interval
+	 * @param[in]	t1	end of replay interval
+	 */
+	int replay(const char* pFilename,const double& t0,const double& t1);
 	/*! Return current estimate of robot state (main body)
 	 * @return	current robot state
 	 */
 	State getEst();
+	/*! Return current estimate of a specific filter (comparison mode)
+	 * @return	current robot state
+	 * @param[in]	filter	index of filter (0..NUM_FILTERS-1)
+	 */
+	State getEst(const int& filter);
 	/*! Return slippage detection
 	 * @return	current slippage detection
 	 */
 	SlippageDetection getSlippage();
+	/*! Return slippage detection of a specific filter (comparison mode)
+	 * @return	current slippage detection
+	 * @param[in]	filter	index of filter (0..NUM_FILTERS-1)
+	 */
+	SlippageDetection getSlippage(const int& filter);
+	/*! Return per-stage latency statistics of the active filter. Only filled
+	 * when the library is compiled with USE_PERF, all zero otherwise.
+	 * @return	per-stage latency statistics
+	 */
+	PerfStats getPerfStats();
+	/*! Clears the per-stage latency statistics of all filters */
+	void resetPerfStats();
+	/*! Enables/disables the filter comparison mode. When enabled, update()
+	 * steps all filters in parallel on a worker-thread pool instead of only
+	 * the active one (each filter owns its state, the measurement lists are
+	 * only read during update). Results are accessed per filter via
+	 * getEst(filter)/getSlippage(filter). Not meant to be combined with the
+	 * text logger, which is shared between the filters.
+	 * @param[in]	enable	true to step all filters on update
+	 */
+	void setComparisonMode(const bool& enable);
 	/*! Resets the filter
 	 * @param[in]	t	time used to initialize new state estimate
 	 */
@@ -152,11 +222,32 @@ public:
 	/* -------------------- Logging stuff (unclean) --------------------- */
 	void enableLogging(const char* pLogfile);
 	void disableLogging();
+	/*! Enables binary logging (fixed-size records, asynchronous writer).
+	 * States and slippage detections are logged after each update, IMU and
+	 * encoder measurements as they are added. Read back with BinaryLogReader.
+	 * @param[in]	pLogfile	prefix of log file
+	 */
+	void enableBinaryLogging(const char* pLogfile);
+	/*! Flushes and disables binary logging */
+	void disableBinaryLogging();
 
 	void setReferenceKinematicRates();
 	void computeKinematicPose();
 	Eigen::Vector3d getKinematicRate();
-	Eigen::Matrix<double,3,4> p_;
+	/*! Evaluates the forward kinematics of all legs, uses the batched callback
+	 * when available and falls back to per-leg calls otherwise
+	 * @param[out]	s	foot positions (one column per leg)
+	 * @param[in]	e	joint angles (one column per leg)
+	 */
+	void legKinAll(Eigen::Matrix<double,3,LSE_N_LEG>& s,const Eigen::Matrix<double,LSE_DOF_LEG,LSE_N_LEG>& e);
+	/*! Evaluates the forward kinematics Jacobians of all legs (see legKinAll)
+	 * @param[out]	J	Jacobians (one 3xLSE_DOF_LEG block per leg, stacked vertically)
+	 * @param[in]	e	joint angles (one column per leg)
+	 */
+	void legKinJacAll(Eigen::Matrix<double,3*LSE_N_LEG,LSE_DOF_LEG>& J,const Eigen::Matrix<double,LSE_DOF_LEG,LSE_N_LEG>& e);
+	/*! Returns whether a kinematics Jacobian callback was provided */
+	bool hasLegKinJac();
+	Eigen::Matrix<double,3,LSE_N_LEG> p_;
 	LSE::Rotations::Quat qLast_;
 	double tLast_;
 	Eigen::Vector3d wKin_;
@@ -165,9 +256,11 @@ public:
 
 	/* -------------------- Friends --------------------- */
 	friend class FilterOCEKF;
+	friend class SmootherOCEKF;
 	friend class FilterVUKF;
-	friend class FilterVUKF2;
+	template<typename ScalarType> friend class FilterVUKF2T;
 	friend class DelayCalibration;
+	friend class BenchmarkAccess;
 #ifdef USE_CERES
 	friend class FilterInertialOF;
 	friend class FilterFLS;
@@ -175,10 +268,10 @@ public:
 #endif
 
 private:
-	/*! Loads overall parameters from parameter file
+	/*! Shared part of the constructors, initializes parameters and filters
 	 * @param[in]	pFilename	name of parameter file
 	 */
-	void loadParam(const char* pFilename);
+	void init(const char* pFilename);
 	/*! Returns gamma 3x3 matrix
 	 * @return	Gamma matrix
 	 * @param[in]	k	Order
@@ -192,11 +285,28 @@ private:
 	 * @param[in]	v	Vector
 	 */
 	Eigen::Matrix3d gamma(const int& k,const Eigen::Vector3d& v);
+	/*! Computes the gamma matrices of order 0 to 3 in one pass, sharing the
+	 * norm, skew matrices and trigonometric terms between the orders. The
+	 * result is cached per thread on (w,dt), repeated evaluations with the
+	 * same arguments are free. gamma() delegates here for orders 0 to 3.
+	 * @param[out]	G	gamma matrices of order 0 to 3
+	 * @param[in]	w	Rotational rate
+	 * @param[in]	dt	Time difference
+	 */
+	void gammaAll(Eigen::Matrix3d* G,const Eigen::Vector3d& w,const double& dt);
 	/*! Factorial
 	 * @return	factorial of k
 	 * @param[in]	k	Natural number
 	 */
 	int factorial(const int& k);
+	/*! Drains the ingestion queues into the measurement storages. Must only
+	 * be called from the estimator thread. */
+	void drainMeasQueues();
+	/*! Notifies the updated filters of a delayed measurement such that they
+	 * can roll their safe state back before the next update
+	 * @param[in]	t	filter time of the measurement (delay compensated)
+	 */
+	void rollbackFilters(const double& t);
 
 	/* -------------------- Different pointers --------------------- */
 	/*! Pointer to Filter list */
@@ -209,57 +319,111 @@ private:
 #ifdef USE_CERES
 	RobotCalibration* pRobotCalibration_;
 #endif
-	/*! Function pointer to leg kinematics */
+	/*! Function pointer to leg kinematics (NULL if the batched callback is used) */
 	Eigen::Vector3d (*legKin)(Eigen::Matrix<double,LSE_DOF_LEG,1>,int);
 	/*! Function pointer to leg kinematics Jacobian */
 	Eigen::Matrix<double,3,LSE_DOF_LEG> (*legKinJac)(Eigen::Matrix<double,LSE_DOF_LEG,1>,int);
+	/*! Function pointer to batched leg kinematics (NULL if the per-leg callback is used) */
+	void (*legKinBatch)(const Eigen::Matrix<double,LSE_DOF_LEG,LSE_N_LEG>&,Eigen::Matrix<double,3,LSE_N_LEG>&);
+	/*! Function pointer to batched leg kinematics Jacobian */
+	void (*legKinJacBatch)(const Eigen::Matrix<double,LSE_DOF_LEG,LSE_N_LEG>&,Eigen::Matrix<double,3*LSE_N_LEG,LSE_DOF_LEG>&);
 
 	/* -------------------- Measurement Storage --------------------- */
-	/*! Map storage of Imu Measurements */
-	std::map<double,ImuMeas> imuMeasList_;
-	/*! Map storage of encoder Measurements */
-	std::map<double,EncMeas> encMeasList_;
-	/*! Map storage of pose sensor Measurements */
-	std::map<double,PosMeas> posMeasList_;
-	/*! Map storage of pose sensor Measurements */
-	std::map<double,OflMeas> oflMeasList_;
+	/*! Ring storage of Imu Measurements */
+	MeasStorage<ImuMeas,LSE_MEAS_N> imuMeasList_;
+	/*! Ring storage of encoder Measurements */
+	MeasStorage<EncMeas,LSE_MEAS_N> encMeasList_;
+	/*! Ring storage of pose sensor Measurements */
+	MeasStorage<PosMeas,LSE_MEAS_N> posMeasList_;
+	/*! Ring storage of optical flow Measurements */
+	MeasStorage<OflMeas,LSE_OFL_MEAS_N> oflMeasList_;
+	/*! Lookup cursor of getImuMeas (sequential polling access pattern) */
+	MeasStorage<ImuMeas,LSE_MEAS_N>::cursor curImu_;
+	/*! Lookup cursor of getEncMeas */
+	MeasStorage<EncMeas,LSE_MEAS_N>::cursor curEnc_;
+	/*! Lookup cursor of getPosMeas */
+	MeasStorage<PosMeas,LSE_MEAS_N>::cursor curPos_;
+	/*! Lookup cursor of getOflMeas */
+	MeasStorage<OflMeas,LSE_OFL_MEAS_N>::cursor curOfl_;
+	/*! Wait-free ingestion queue for Imu Measurements */
+	MeasQueue<ImuMeas,LSE_QUEUE_N> imuMeasQueue_;
+	/*! Wait-free ingestion queue for encoder Measurements */
+	MeasQueue<EncMeas,LSE_QUEUE_N> encMeasQueue_;
+	/*! Wait-free ingestion queue for pose sensor Measurements */
+	MeasQueue<PosMeas,LSE_QUEUE_N> posMeasQueue_;
 
 	/* -------------------- Parameters --------------------- */
 	/*! Gravity vector in world coordinate frame */
 	const Eigen::Vector3d g_;
+	/*! Shared read-only parameter block (one per parameter file and process) */
+	const ManagerParams* pParams_;
 	/*! Imu time offset, real time = timestamp + tImu_ */
 	double tImu_;
 	/*! Encoder time offset, real time = timestamp + tEnc_ */
 	double tEnc_;
 	/*! Pose sensor time offset, real time = timestamp + tPos_ */
 	double tPos_;
-	/*! Position of Imu frame w.r.t the body frame (expressed in body frame) */
-	Eigen::Vector3d B_r_BI_;
-	/*! Rotation from body frame to Imu frame */
-	Rotations::Quat q_IB_;
-	/*! Position of kinematic frame w.r.t the body frame (expressed in body frame) */
-	Eigen::Vector3d B_r_BK_;
-	/*! Rotation from body frame to kinematic frame */
-	Rotations::Quat q_KB_;
-	/*! Noise of accelerometer [m^2/s^3] (continuous form) */
-	Eigen::Matrix3d Rf_;
-	/*! Noise of gyroscope [rad^2/s] (continuous form) */
-	Eigen::Matrix3d Rw_;
-	/*! Noise of foothold measurements [m^2] (discrete form) */
-	Eigen::Matrix3d Rs_;
-	/*! Noise of pose measurements [m^2] (discrete form) */
-	Eigen::Matrix3d Rposr_;
-	/*! Noise of pose measurements [rad^2] (discrete form) */
-	Eigen::Matrix3d Rposq_;
-	/*! Noise of encoder measurement [rad^2] (position) (discrete form) */
-	Eigen::Matrix<double,LSE_DOF_LEG,LSE_DOF_LEG> Ra_;
-	/*! Noise of encoder measurement [rad^2/s^2] (velocity) (discrete form) */
-	Eigen::Matrix<double,LSE_DOF_LEG,LSE_DOF_LEG> Rda_;
+	/*! Position of Imu frame w.r.t the body frame (expressed in body frame, shared) */
+	const Eigen::Vector3d& B_r_BI_;
+	/*! Rotation from body frame to Imu frame (shared) */
+	const Rotations::Quat& q_IB_;
+	/*! Position of kinematic frame w.r.t the body frame (expressed in body frame, shared) */
+	const Eigen::Vector3d& B_r_BK_;
+	/*! Rotation from body frame to kinematic frame (shared) */
+	const Rotations::Quat& q_KB_;
+	/*! Noise of accelerometer [m^2/s^3] (continuous form, shared) */
+	const Eigen::Matrix3d& Rf_;
+	/*! Noise of gyroscope [rad^2/s] (continuous form, shared) */
+	const Eigen::Matrix3d& Rw_;
+	/*! Noise of foothold measurements [m^2] (discrete form, shared) */
+	const Eigen::Matrix3d& Rs_;
+	/*! Noise of pose measurements [m^2] (discrete form, shared) */
+	const Eigen::Matrix3d& Rposr_;
+	/*! Noise of pose measurements [rad^2] (discrete form, shared) */
+	const Eigen::Matrix3d& Rposq_;
+	/*! Noise of encoder measurement [rad^2] (position) (discrete form, shared) */
+	const Eigen::Matrix<double,LSE_DOF_LEG,LSE_DOF_LEG>& Ra_;
+	/*! Noise of encoder measurement [rad^2/s^2] (velocity) (discrete form, shared) */
+	const Eigen::Matrix<double,LSE_DOF_LEG,LSE_DOF_LEG>& Rda_;
 
 
 	/* -------------------- Logging stuff (unclean) --------------------- */
 	std::ofstream ofsLog_;
 	bool isLogging_;
+	/*! Binary log writer (inactive unless enableBinaryLogging was called) */
+	BinaryLogWriter binLog_;
+
+	/* -------------------- Comparison mode (parallel filter bank) --------------------- */
+	/*! Entry of worker thread i, steps pFilterList_[i] once per job
+	 * @param[in]	i			index of the assigned filter
+	 * @param[in]	startJob	job counter at the time the worker was spawned
+	 */
+	void filterWorker(const int& i,const unsigned long& startJob);
+	/*! Dispatches one update job to all workers and waits for completion
+	 * @param[in]	hasTime	true if a desired update time is given
+	 * @param[in]	t		desired update time
+	 */
+	void runComparisonUpdate(const bool& hasTime,const double& t);
+	/*! True if update() steps all filters in parallel */
+	bool mbComparisonMode_;
+	/*! True while the worker threads are alive */
+	bool mbPoolRunning_;
+	/*! One worker thread per filter */
+	std::thread workers_[NUM_FILTERS];
+	/*! Mutex protecting the job bookkeeping */
+	std::mutex poolMutex_;
+	/*! Signals the workers that a new job is available (or shutdown) */
+	std::condition_variable poolCond_;
+	/*! Signals the dispatcher that all workers finished */
+	std::condition_variable poolDone_;
+	/*! Monotonic job counter */
+	unsigned long jobId_;
+	/*! Number of workers still busy with the current job */
+	int pendingJobs_;
+	/*! True if the current job has a desired update time */
+	bool mbJobHasTime_;
+	/*! Desired update time of the current job */
+	double jobTime_;
 
 
 };
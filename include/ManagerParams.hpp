@@ -0,0 +1,72 @@
+/*!
+* @file 	ManagerParams.hpp
+* @author 	Michael Blösch
+* @date		10.10.2012
+* @brief	Shared read-only Manager parameter block
+ */
+
+#ifndef LSE_MANAGERPARAMS_HPP_
+#define LSE_MANAGERPARAMS_HPP_
+
+#include "Common.hpp"
+#include <Eigen/Dense>
+#include "Rotations.hpp"
+
+namespace LSE {
+
+/*! Shared read-only Manager parameter block. The measurement settings of a
+ * parameter file are parsed once per process and every Manager instance
+ * references the same block, instead of each instance walking the document
+ * and holding its own copy of the noise matrices. */
+class ManagerParams{
+public:
+	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+	/*! Returns the parameter block for the given file, loading it on the
+	 * first call. Never returns NULL: a missing file yields a block with the
+	 * default parameters.
+	 * @return	shared parameter block
+	 * @param[in]	pFilename	filename of parameter file
+	 */
+	static const ManagerParams* get(const char* pFilename);
+	/*! Drops all cached blocks (they get reloaded on the next get()). Must
+	 * not be called while Manager instances referencing them are alive. */
+	static void clear();
+
+	/*! Index of the active filter */
+	int activeFilter_;
+	/*! Position of Imu frame w.r.t the body frame (expressed in body frame) */
+	Eigen::Vector3d B_r_BI_;
+	/*! Rotation from body frame to Imu frame */
+	Rotations::Quat q_IB_;
+	/*! Position of kinematic frame w.r.t the body frame (expressed in body frame) */
+	Eigen::Vector3d B_r_BK_;
+	/*! Rotation from body frame to kinematic frame */
+	Rotations::Quat q_KB_;
+	/*! Noise of accelerometer [m^2/s^3] (continuous form) */
+	Eigen::Matrix3d Rf_;
+	/*! Noise of gyroscope [rad^2/s] (continuous form) */
+	Eigen::Matrix3d Rw_;
+	/*! Noise of foothold measurements [m^2] (discrete form) */
+	Eigen::Matrix3d Rs_;
+	/*! Noise of pose measurements [m^2] (discrete form) */
+	Eigen::Matrix3d Rposr_;
+	/*! Noise of pose measurements [rad^2] (discrete form) */
+	Eigen::Matrix3d Rposq_;
+	/*! Noise of encoder measurement [rad^2] (position) (discrete form) */
+	Eigen::Matrix<double,LSE_DOF_LEG,LSE_DOF_LEG> Ra_;
+	/*! Noise of encoder measurement [rad^2/s^2] (velocity) (discrete form) */
+	Eigen::Matrix<double,LSE_DOF_LEG,LSE_DOF_LEG> Rda_;
+
+private:
+	/*! Constructor (defaults, use get()) */
+	ManagerParams();
+	/*! Loads the measurement settings from the parameter file
+	 * @param[in]	pFilename	name of parameter file
+	 */
+	void loadParam(const char* pFilename);
+};
+
+}
+
+#endif /* LSE_MANAGERPARAMS_HPP_ */
@@ -0,0 +1,317 @@
+/*!
+* @file 	MeasStorage.hpp
+* @author 	Michael Blösch
+* @date		10.10.2012
+* @brief	Time-indexed circular buffer for measurement series
+* 			Preallocated and contiguous, replaces the std::map queues
+ */
+
+#ifndef LSE_MEASSTORAGE_HPP_
+#define LSE_MEASSTORAGE_HPP_
+
+#include <Eigen/Dense>
+#include <vector>
+#include <utility>
+#include <atomic>
+
+namespace LSE {
+
+/*! Fixed-capacity circular measurement storage.
+ * Keeps up to Capacity timestamped measurements in a preallocated contiguous
+ * buffer. Samples are kept sorted by timestamp: late arrivals are inserted in
+ * order (bounded shift of the newer entries), duplicates are ignored (matching
+ * the former std::map behavior). Once full, the oldest entry is overwritten.
+ * Lookups by time are binary searches on the contiguous timestamp sequence.
+ * The iterator interface mimics the std::map<double,Meas> subset used by the
+ * filters. */
+template<typename Meas,int Capacity>
+class MeasStorage{
+public:
+	/*! Storage entry, mimics the std::map value_type */
+	struct Entry{
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+		/*! Measurement timestamp */
+		double first;
+		/*! Measurement data */
+		Meas second;
+	};
+
+	/*! Forward iterator over the ring, addressed by monotonic sequence number.
+	 * Stays valid across inserts, gets invalidated for entries that have been
+	 * overwritten by newer data. */
+	class iterator{
+	public:
+		iterator(): pStore_(0),seq_(0){}
+		iterator(MeasStorage* pStore,const unsigned long& seq): pStore_(pStore),seq_(seq){}
+		Entry& operator*() const{ return pStore_->at(seq_);}
+		Entry* operator->() const{ return &pStore_->at(seq_);}
+		iterator& operator++(){ seq_++; return *this;}
+		iterator operator++(int){ iterator temp = *this; seq_++; return temp;}
+		iterator& operator--(){ seq_--; return *this;}
+		iterator operator--(int){ iterator temp = *this; seq_--; return temp;}
+		bool operator==(const iterator& it) const{ return seq_ == it.seq_;}
+		bool operator!=(const iterator& it) const{ return seq_ != it.seq_;}
+	private:
+		friend class MeasStorage;
+		/*! Pointer to the underlying storage */
+		MeasStorage* pStore_;
+		/*! Monotonic sequence number of referenced entry */
+		unsigned long seq_;
+	};
+
+	/*! Reverse iterator, stores the sequence number one past the referenced
+	 * entry (like std::reverse_iterator) */
+	class reverse_iterator{
+	public:
+		reverse_iterator(): pStore_(0),seq_(0){}
+		reverse_iterator(MeasStorage* pStore,const unsigned long& seq): pStore_(pStore),seq_(seq){}
+		Entry& operator*() const{ return pStore_->at(seq_-1);}
+		Entry* operator->() const{ return &pStore_->at(seq_-1);}
+		reverse_iterator& operator++(){ seq_--; return *this;}
+		reverse_iterator operator++(int){ reverse_iterator temp = *this; seq_--; return temp;}
+		reverse_iterator& operator--(){ seq_++; return *this;}
+		reverse_iterator operator--(int){ reverse_iterator temp = *this; seq_++; return temp;}
+		bool operator==(const reverse_iterator& it) const{ return seq_ == it.seq_;}
+		bool operator!=(const reverse_iterator& it) const{ return seq_ != it.seq_;}
+	private:
+		friend class MeasStorage;
+		/*! Pointer to the underlying storage */
+		MeasStorage* pStore_;
+		/*! Monotonic sequence number, one past referenced entry */
+		unsigned long seq_;
+	};
+
+	/*! Monotonic lookup cursor. Remembers the position of the previous query
+	 * such that a sequence of lookups with non-decreasing query times (the
+	 * access pattern of the filters, which scan the measurements forward in
+	 * time) advances in O(1) amortized instead of running a fresh binary
+	 * search per call. Falls back to a binary search when the query time
+	 * jumps backwards or when the remembered entry has been overwritten.
+	 * One cursor per consumer and modality, not thread-safe. */
+	class cursor{
+	public:
+		cursor(): pStore_(0),seq_(0){}
+		/*! Binds the cursor to a storage, resets the position on change
+		 * @param[in]	pStore	storage to operate on
+		 */
+		void attach(MeasStorage* pStore){
+			if(pStore_ != pStore){
+				pStore_ = pStore;
+				seq_ = 0;
+			}
+		}
+		/*! First entry with timestamp >= t (see MeasStorage::lower_bound)
+		 * @return	iterator to entry, end() if none
+		 * @param[in]	t	time of measurement
+		 */
+		iterator lower_bound(const double& t){
+			if(seq_ < pStore_->head_ || seq_ > pStore_->tail_ || (seq_ > pStore_->head_ && pStore_->at(seq_-1).first >= t)){
+				seq_ = pStore_->lower_bound(t).seq_;
+			} else {
+				while(seq_ < pStore_->tail_ && pStore_->at(seq_).first < t) seq_++;
+			}
+			return iterator(pStore_,seq_);
+		}
+		/*! First entry with timestamp > t (see MeasStorage::upper_bound)
+		 * @return	iterator to entry, end() if none
+		 * @param[in]	t	time of measurement
+		 */
+		iterator upper_bound(const double& t){
+			if(seq_ < pStore_->head_ || seq_ > pStore_->tail_ || (seq_ > pStore_->head_ && pStore_->at(seq_-1).first > t)){
+				seq_ = pStore_->upper_bound(t).seq_;
+			} else {
+				while(seq_ < pStore_->tail_ && pStore_->at(seq_).first <= t) seq_++;
+			}
+			return iterator(pStore_,seq_);
+		}
+	private:
+		/*! Pointer to the underlying storage */
+		MeasStorage* pStore_;
+		/*! Sequence number of the previous query result */
+		unsigned long seq_;
+	};
+
+	/*! Constructor, preallocates the full buffer */
+	MeasStorage(): buffer_(Capacity),head_(0),tail_(0){}
+
+	/*! Checks if the storage is empty
+	 * @return	true if empty
+	 */
+	bool empty() const{
+		return head_ == tail_;
+	}
+	/*! Returns the number of stored measurements
+	 * @return	number of stored measurements
+	 */
+	unsigned long size() const{
+		return tail_-head_;
+	}
+	/*! Iterator to oldest entry */
+	iterator begin(){
+		return iterator(this,head_);
+	}
+	/*! Iterator past newest entry */
+	iterator end(){
+		return iterator(this,tail_);
+	}
+	/*! Reverse iterator to newest entry */
+	reverse_iterator rbegin(){
+		return reverse_iterator(this,tail_);
+	}
+	/*! Reverse iterator past oldest entry */
+	reverse_iterator rend(){
+		return reverse_iterator(this,head_);
+	}
+	/*! Searches for the first entry with timestamp >= t (binary search)
+	 * @return	iterator to entry, end() if none
+	 * @param[in]	t	time of measurement
+	 */
+	iterator lower_bound(const double& t){
+		unsigned long lo = head_;
+		unsigned long hi = tail_;
+		while(lo < hi){
+			unsigned long mid = lo+(hi-lo)/2;
+			if(at(mid).first < t){
+				lo = mid+1;
+			} else {
+				hi = mid;
+			}
+		}
+		return iterator(this,lo);
+	}
+	/*! Searches for the first entry with timestamp > t (binary search)
+	 * @return	iterator to entry, end() if none
+	 * @param[in]	t	time of measurement
+	 */
+	iterator upper_bound(const double& t){
+		unsigned long lo = head_;
+		unsigned long hi = tail_;
+		while(lo < hi){
+			unsigned long mid = lo+(hi-lo)/2;
+			if(at(mid).first <= t){
+				lo = mid+1;
+			} else {
+				hi = mid;
+			}
+		}
+		return iterator(this,lo);
+	}
+	/*! Inserts a timestamped measurement, drops the oldest entry when full.
+	 * Late arrivals are placed in timestamp order by shifting the newer
+	 * entries up by one (cost bounded by the lag), exact duplicates and
+	 * samples older than the whole full buffer are ignored. Iterators behind
+	 * the insertion point stay valid, iterators past it shift by one entry.
+	 * @param[in]	m	pair of timestamp and measurement data
+	 */
+	void insert(const std::pair<double,Meas>& m){
+		if(tail_ > head_ && m.first <= at(tail_-1).first){
+			// Late sample, insert in order
+			iterator it = lower_bound(m.first);
+			if(it != end() && it->first == m.first) return;
+			if(it == begin() && tail_-head_ >= Capacity) return;
+			unsigned long pos = it.seq_;
+			if(tail_-head_ >= Capacity){
+				head_++;
+			}
+			for(unsigned long s = tail_; s > pos; s--){
+				at(s) = at(s-1);
+			}
+			at(pos).first = m.first;
+			at(pos).second = m.second;
+			tail_++;
+			return;
+		}
+		if(tail_-head_ >= Capacity){
+			head_++;
+		}
+		at(tail_).first = m.first;
+		at(tail_).second = m.second;
+		tail_++;
+	}
+	/*! Clears all entries */
+	void clear(){
+		head_ = tail_;
+	}
+
+private:
+	/*! Maps a sequence number to the corresponding ring entry
+	 * @return	reference to entry
+	 * @param[in]	seq	sequence number
+	 */
+	Entry& at(const unsigned long& seq){
+		return buffer_[seq%Capacity];
+	}
+
+	/*! Preallocated contiguous ring buffer */
+	std::vector<Entry,Eigen::aligned_allocator<Entry> > buffer_;
+	/*! Sequence number of oldest valid entry */
+	unsigned long head_;
+	/*! Sequence number one past newest valid entry */
+	unsigned long tail_;
+};
+
+/*! Wait-free single-producer single-consumer measurement queue.
+ * Allows one driver thread to hand timestamped measurements to the estimator
+ * thread without locking. The producer calls push(), the consumer (the thread
+ * running Manager::update) drains via pop(). Preallocated, no allocation on
+ * either side. */
+template<typename Meas,int Capacity>
+class MeasQueue{
+public:
+	/*! Constructor, preallocates the full buffer */
+	MeasQueue(): buffer_(Capacity),head_(0),tail_(0){}
+
+	/*! Enqueues a timestamped measurement (producer side only)
+	 * @return	true on success, false if the queue is full
+	 * @param[in]	t	time of measurement
+	 * @param[in]	m	measurement data
+	 */
+	bool push(const double& t,const Meas& m){
+		unsigned long tail = tail_.load(std::memory_order_relaxed);
+		unsigned long head = head_.load(std::memory_order_acquire);
+		if(tail-head >= (unsigned long)Capacity){
+			return false;
+		}
+		buffer_[tail%Capacity].first = t;
+		buffer_[tail%Capacity].second = m;
+		tail_.store(tail+1,std::memory_order_release);
+		return true;
+	}
+	/*! Dequeues the oldest measurement (consumer side only)
+	 * @return	true on success, false if the queue is empty
+	 * @param[out]	t	time of measurement
+	 * @param[out]	m	measurement data
+	 */
+	bool pop(double& t,Meas& m){
+		unsigned long head = head_.load(std::memory_order_relaxed);
+		unsigned long tail = tail_.load(std::memory_order_acquire);
+		if(head == tail){
+			return false;
+		}
+		t = buffer_[head%Capacity].first;
+		m = buffer_[head%Capacity].second;
+		head_.store(head+1,std::memory_order_release);
+		return true;
+	}
+
+private:
+	/*! Queue entry */
+	struct Entry{
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+		/*! Measurement timestamp */
+		double first;
+		/*! Measurement data */
+		Meas second;
+	};
+
+	/*! Preallocated contiguous ring buffer */
+	std::vector<Entry,Eigen::aligned_allocator<Entry> > buffer_;
+	/*! Sequence number of next entry to dequeue (consumer owned) */
+	std::atomic<unsigned long> head_;
+	/*! Sequence number of next free slot (producer owned) */
+	std::atomic<unsigned long> tail_;
+};
+
+}
+
+#endif /* LSE_MEASSTORAGE_HPP_ */
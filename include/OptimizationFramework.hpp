@@ -305,6 +305,228 @@ public:
 	ExpressionBase<T2>* exp2_;
 };
 
+//---------------------------------------------------------------------------------------------------------------------------------------------------------//
+//------------------------------------------------------------------- Static expressions ------------------------------------------------------------------//
+// Compile-time counterpart of the Operation/Expression graph above. Nodes are
+// composed via operator overloading and dispatch statically, so a whole chain
+// fuses into a single inlined evaluation (no virtual calls, no heap nodes).
+// Child expressions are held by reference: name every sub-expression that has
+// to outlive the statement it is built in (same rules as Eigen expressions).
+
+/*! Jacobian type of an expression of type TR with respect to an argument of type TA */
+template<class TR,class TA>
+struct StaticJacType;
+template<>
+struct StaticJacType<double,double>{
+	typedef double type;
+};
+template<>
+struct StaticJacType<double,Eigen::Vector3d>{
+	typedef Eigen::Matrix<double,1,3> type;
+};
+template<>
+struct StaticJacType<Eigen::Vector3d,double>{
+	typedef Eigen::Vector3d type;
+};
+template<>
+struct StaticJacType<Eigen::Vector3d,Eigen::Vector3d>{
+	typedef Eigen::Matrix<double,3,3> type;
+};
+
+/*! CRTP base of the static expressions */
+template<class E,class T>
+class StaticExpressionBase{
+public:
+	typedef T value_type;
+	const E& derived() const{
+		return static_cast<const E&>(*this);
+	}
+};
+
+/*! Named input of a static expression (counterpart of the name constructors of Expression) */
+template<class T>
+class StaticLeaf: public StaticExpressionBase<StaticLeaf<T>,T>{
+public:
+	StaticLeaf(){
+		name_ = "";
+		x_ = T();
+	}
+	StaticLeaf(std::string name){
+		name_ = name;
+		x_ = T();
+	}
+	StaticLeaf(std::string name, const T& x){
+		name_ = name;
+		x_ = x;
+	}
+	const T& eval() const{
+		return x_;
+	}
+	std::string print() const{
+		return name_;
+	}
+	T x_;
+	std::string name_;
+};
+
+template<class T1,class T2>
+struct StaticAddition;
+template<>
+struct StaticAddition<double,double>{
+	typedef double result_type;
+	static double f(const double& x1, const double& x2){
+		return x1 + x2;
+	}
+	static double J1(const double& x1, const double& x2){
+		return 1.0;
+	}
+	static double J2(const double& x1, const double& x2){
+		return 1.0;
+	}
+	static std::string symbol(){
+		return " + ";
+	}
+};
+template<>
+struct StaticAddition<double,Eigen::Vector3d>{
+	typedef Eigen::Vector3d result_type;
+	static Eigen::Vector3d f(const double& x1, const Eigen::Vector3d& x2){
+		return x1*Eigen::Vector3d::Ones() + x2;
+	}
+	static Eigen::Vector3d J1(const double& x1, const Eigen::Vector3d& x2){
+		return Eigen::Vector3d::Ones();
+	}
+	static Eigen::Matrix<double,3,3> J2(const double& x1, const Eigen::Vector3d& x2){
+		return Eigen::Matrix<double,3,3>::Identity();
+	}
+	static std::string symbol(){
+		return " + ";
+	}
+};
+template<>
+struct StaticAddition<Eigen::Vector3d,Eigen::Vector3d>{
+	typedef Eigen::Vector3d result_type;
+	static Eigen::Vector3d f(const Eigen::Vector3d& x1, const Eigen::Vector3d& x2){
+		return x1 + x2;
+	}
+	static Eigen::Matrix<double,3,3> J1(const Eigen::Vector3d& x1, const Eigen::Vector3d& x2){
+		return Eigen::Matrix<double,3,3>::Identity();
+	}
+	static Eigen::Matrix<double,3,3> J2(const Eigen::Vector3d& x1, const Eigen::Vector3d& x2){
+		return Eigen::Matrix<double,3,3>::Identity();
+	}
+	static std::string symbol(){
+		return " + ";
+	}
+};
+
+template<class T1,class T2>
+struct StaticMult;
+template<>
+struct StaticMult<double,double>{
+	typedef double result_type;
+	static double f(const double& x1, const double& x2){
+		return x1*x2;
+	}
+	static double J1(const double& x1, const double& x2){
+		return x2;
+	}
+	static double J2(const double& x1, const double& x2){
+		return x1;
+	}
+	static std::string symbol(){
+		return " * ";
+	}
+};
+template<>
+struct StaticMult<double,Eigen::Vector3d>{
+	typedef Eigen::Vector3d result_type;
+	static Eigen::Vector3d f(const double& x1, const Eigen::Vector3d& x2){
+		return x1*x2;
+	}
+	static Eigen::Vector3d J1(const double& x1, const Eigen::Vector3d& x2){
+		return x2;
+	}
+	static Eigen::Matrix<double,3,3> J2(const double& x1, const Eigen::Vector3d& x2){
+		return x1*Eigen::Matrix<double,3,3>::Identity();
+	}
+	static std::string symbol(){
+		return " * ";
+	}
+};
+/*! Vector times vector is the dot product (as in the dynamic DotProduct) */
+template<>
+struct StaticMult<Eigen::Vector3d,Eigen::Vector3d>{
+	typedef double result_type;
+	static double f(const Eigen::Vector3d& x1, const Eigen::Vector3d& x2){
+		return x1.dot(x2);
+	}
+	static Eigen::Matrix<double,1,3> J1(const Eigen::Vector3d& x1, const Eigen::Vector3d& x2){
+		return x2.transpose();
+	}
+	static Eigen::Matrix<double,1,3> J2(const Eigen::Vector3d& x1, const Eigen::Vector3d& x2){
+		return x1.transpose();
+	}
+	static std::string symbol(){
+		return " * ";
+	}
+};
+
+struct StaticCross{
+	typedef Eigen::Vector3d result_type;
+	static Eigen::Vector3d f(const Eigen::Vector3d& x1, const Eigen::Vector3d& x2){
+		return x1.cross(x2);
+	}
+	static Eigen::Matrix<double,3,3> J1(const Eigen::Vector3d& x1, const Eigen::Vector3d& x2){
+		return -Rotations::vecToSqew(x2);
+	}
+	static Eigen::Matrix<double,3,3> J2(const Eigen::Vector3d& x1, const Eigen::Vector3d& x2){
+		return Rotations::vecToSqew(x1);
+	}
+	static std::string symbol(){
+		return " x ";
+	}
+};
+
+/*! Binary node of a static expression, Op provides value and Jacobians */
+template<class Op,class E1,class E2>
+class StaticExpression: public StaticExpressionBase<StaticExpression<Op,E1,E2>,typename Op::result_type>{
+public:
+	StaticExpression(const E1& exp1, const E2& exp2): exp1_(exp1), exp2_(exp2){}
+	typename Op::result_type eval() const{
+		return Op::f(exp1_.eval(),exp2_.eval());
+	}
+	/*! Jacobian with respect to the first direct child */
+	typename StaticJacType<typename Op::result_type,typename E1::value_type>::type J1() const{
+		return Op::J1(exp1_.eval(),exp2_.eval());
+	}
+	/*! Jacobian with respect to the second direct child */
+	typename StaticJacType<typename Op::result_type,typename E2::value_type>::type J2() const{
+		return Op::J2(exp1_.eval(),exp2_.eval());
+	}
+	std::string print() const{
+		return "("+exp1_.print()+Op::symbol()+exp2_.print()+")";
+	}
+
+	const E1& exp1_;
+	const E2& exp2_;
+};
+
+template<class E1,class T1,class E2,class T2>
+inline StaticExpression<StaticAddition<T1,T2>,E1,E2> operator+(const StaticExpressionBase<E1,T1>& exp1, const StaticExpressionBase<E2,T2>& exp2){
+	return StaticExpression<StaticAddition<T1,T2>,E1,E2>(exp1.derived(),exp2.derived());
+}
+
+template<class E1,class T1,class E2,class T2>
+inline StaticExpression<StaticMult<T1,T2>,E1,E2> operator*(const StaticExpressionBase<E1,T1>& exp1, const StaticExpressionBase<E2,T2>& exp2){
+	return StaticExpression<StaticMult<T1,T2>,E1,E2>(exp1.derived(),exp2.derived());
+}
+
+template<class E1,class E2>
+inline StaticExpression<StaticCross,E1,E2> cross(const StaticExpressionBase<E1,Eigen::Vector3d>& exp1, const StaticExpressionBase<E2,Eigen::Vector3d>& exp2){
+	return StaticExpression<StaticCross,E1,E2>(exp1.derived(),exp2.derived());
+}
+
 
 }
 }
@@ -0,0 +1,54 @@
+/*!
+* @file 	ParamCache.hpp
+* @author 	Michael Blösch
+* @date		10.10.2012
+* @brief	Binary parameter cache, skips the XML parse on restarts
+ */
+
+#ifndef LSE_PARAMCACHE_HPP_
+#define LSE_PARAMCACHE_HPP_
+
+#include "tinyxml.h"
+
+namespace LSE {
+
+/*! Magic number at the beginning of a parameter cache file ("PLSE") */
+#define LSE_PARCACHE_MAGIC 0x45534C50
+/*! Version of the parameter cache format */
+#define LSE_PARCACHE_VERSION 1
+
+/*! File header of a parameter cache */
+struct ParamCacheFileHeader{
+	/*! Magic number (LSE_PARCACHE_MAGIC) */
+	unsigned int magic_;
+	/*! Format version (LSE_PARCACHE_VERSION) */
+	unsigned int version_;
+	/*! FNV-1a hash of the XML file contents */
+	unsigned long long xmlHash_;
+	/*! Size of the XML file [bytes] */
+	unsigned long long xmlSize_;
+};
+
+/*! Process-wide parameter document cache. The parameter file is loaded once
+ * per process and the parsed element tree is shared between Manager, the
+ * filters and the calibration routines. On the first load the tree is
+ * additionally serialized to a compact binary snapshot (<file>.bin) next to
+ * the XML file. Subsequent process starts mmap the snapshot, validate it
+ * against a hash of the XML contents and rebuild the tree from it directly,
+ * skipping the DOM parse. A stale or unreadable snapshot silently falls
+ * back to the XML parser and is rewritten. */
+class ParamCache{
+public:
+	/*! Returns the parameter document for the given file, loading it on the
+	 * first call (from the binary snapshot if valid, from the XML otherwise)
+	 * @return	parsed document, NULL if the file could not be loaded
+	 * @param[in]	pFilename	filename of parameter file
+	 */
+	static TiXmlDocument* get(const char* pFilename);
+	/*! Drops all cached documents (they get reloaded on the next get()) */
+	static void clear();
+};
+
+}
+
+#endif /* LSE_PARAMCACHE_HPP_ */
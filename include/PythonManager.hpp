@@ -89,8 +89,10 @@ public:
 #ifdef WRAP_PYTHON
 	void addImuMeas_python(double t, PyObject* pyf, PyObject* pyw);
 	//	M = PyArray_SimpleNew(2, dims, NPY_DOUBLE);
+	void addImuMeasBatch_python(PyObject* pyt, PyObject* pyM);
 	int getImuMeas_python(double t, PyObject* pyf, PyObject* pyw);
 	void addEncMeas_python(double t, PyObject* pye, PyObject* pyv, PyObject* pyCF);
+	void addEncMeasBatch_python(PyObject* pyt, PyObject* pye, PyObject* pyv, PyObject* pyCF);
 	int getEncMeas_python(double t, PyObject* pye, PyObject* pyv, PyObject* pyCF);
 	void addPosMeas_python(double t, PyObject* pyr, PyObject* pyq);
 	int getPosMeas_python(double t, PyObject* pyr, PyObject* pyq);
@@ -100,6 +102,11 @@ public:
 	void update_python();
 	void getEst_python(PyObject* pyx);
 	void getSlippage_python(PyObject* pyx);
+	void enableBinaryLogging_python(std::string filename);
+	void disableBinaryLogging_python();
+	PyObject* getEstTrajectory_python(std::string filename);
+	PyObject* getPerfStats_python();
+	void resetPerfStats_python();
 	void resetEstimate_python(double t);
 	int delayIdentification_python(double t,double T);
 	void setImuTD_python(double TD);
@@ -11,8 +11,9 @@
 #include "Common.hpp"
 #include <Eigen/Dense>
 #include "Rotations.hpp"
-#include <map>
+#include "MeasStorage.hpp"
 #include <vector>
+#include <string>
 
 namespace LSE {
 
@@ -77,6 +78,23 @@ private:
 	 * @param[in]	T	length of identification interval
 	 */
 	int initialize(const double& t,const double& T);
+	/*! Incremental-mode calibration. Keeps the Ceres problem alive across
+	 * calls, appends residual blocks for new measurements and removes the
+	 * state blocks that slide out of the window.
+	 * @return	results of identification (0:fail, 1:success)
+	 * @param[in]	t	end of identification interval
+	 * @param[in]	T	length of identification interval
+	 */
+	int calibrateRobotIncremental(const double& t,const double& T);
+	/*! Folds the states sliding out of the window into a prior factor on the
+	 * boundary state (Schur complement of the accumulated information), such
+	 * that the problem size and the solve time stay bounded without
+	 * discarding the information of the removed states
+	 * @param[in]	departing	slots of PB_states_ leaving the window
+	 */
+	void marginalize(const std::vector<int>& departing);
+	/*! Discards the persistent problem (forces a rebuild on the next call) */
+	void resetIncremental();
 	/*! Loads overall parameters from parameter file
 	 * @param[in]	pFilename	name of parameter file
 	 */
@@ -92,27 +110,27 @@ private:
 
 	/* -------------------- Vectors and map iterators --------------------- */
 	/*! Iterator for the IMU measurements */
-	std::map<double,ImuMeas>::iterator itImu_;
+	MeasStorage<ImuMeas,LSE_MEAS_N>::iterator itImu_;
 	/*! Iterator for the IMU measurements (first) */
-	std::map<double,ImuMeas>::iterator itImu1_;
+	MeasStorage<ImuMeas,LSE_MEAS_N>::iterator itImu1_;
 	/*! Iterator for the IMU measurements (second) */
-	std::map<double,ImuMeas>::iterator itImu2_;
+	MeasStorage<ImuMeas,LSE_MEAS_N>::iterator itImu2_;
 	/*! Iterator for the kinematic measurements (first) */
-	std::map<double,EncMeas>::iterator itEnc_;
+	MeasStorage<EncMeas,LSE_MEAS_N>::iterator itEnc_;
 //	/*! Iterator for the kinematic measurements (second) */
-//	std::map<double,EncMeas>::iterator itEnc2_;
+//	MeasStorage<EncMeas,LSE_MEAS_N>::iterator itEnc2_;
 //	/*! Reverse iterator for the kinematic measurements (first) */
-//	std::map<double,EncMeas>::reverse_iterator ritEnc_;
+//	MeasStorage<EncMeas,LSE_MEAS_N>::reverse_iterator ritEnc_;
 //	/*! Reverse iterator for the kinematic measurements (second) */
-//	std::map<double,EncMeas>::reverse_iterator ritEnc2_;
+//	MeasStorage<EncMeas,LSE_MEAS_N>::reverse_iterator ritEnc2_;
 	/*! Iterator for the pose sensor measurements (first) */
-	std::map<double,PosMeas>::iterator itPos_;
+	MeasStorage<PosMeas,LSE_MEAS_N>::iterator itPos_;
 //	/*! Iterator for the pose sensor measurements (second) */
-//	std::map<double,PosMeas>::iterator itPos2_;
+//	MeasStorage<PosMeas,LSE_MEAS_N>::iterator itPos2_;
 //	/*! Reverse iterator for the pose sensor measurements (first) */
-//	std::map<double,PosMeas>::reverse_iterator ritPos_;
+//	MeasStorage<PosMeas,LSE_MEAS_N>::reverse_iterator ritPos_;
 //	/*! Reverse iterator for the pose sensor measurements (second) */
-//	std::map<double,PosMeas>::reverse_iterator ritPos2_;
+//	MeasStorage<PosMeas,LSE_MEAS_N>::reverse_iterator ritPos2_;
 
 	/* -------------------- Temporary quantities used during differentiation and interpolation --------------------- */
 //	/*! Time of last evaluation */
@@ -133,12 +151,24 @@ private:
 	/* -------------------- Calibration routine parameters --------------------- */
 	/*! Timesteps between interpolation points, if 0 use IMU timesteps */
 	double dt_;
+	/*! Flag whether the Ceres problem is kept alive across calibrateRobot
+	 * calls (incremental mode, avoids re-building the whole problem) */
+	bool mbIncremental_;
+	/*! Opaque storage of the persistent Ceres problem (incremental mode),
+	 * defined in the translation unit to keep the ceres include out of here */
+	struct Incremental;
+	Incremental* pInc_;
 	/*! Flag whether to use the IMU measurements */
 	bool mbUseImu_;
 	/*! Flag whether to use the kinematic measurements */
 	bool mbUseEnc_;
 	/*! Flag whether to use the pose sensor measurements */
 	bool mbUsePos_;
+	/*! Number of threads handed to the Ceres solver */
+	int numThreads_;
+	/*! Name of the Ceres linear solver (mapped to the enum in the
+	 * translation unit to keep the ceres include out of here) */
+	std::string linearSolver_;
 
 	Eigen::Matrix3d Wr_;
 	Eigen::Matrix3d Wv_;
@@ -146,7 +176,7 @@ private:
 
 	int N_;
 	double PB_T_BI_[7];
-	double PB_p_[12];
+	double PB_p_[3*LSE_N_LEG];
 	double PB_IrIB_[3];
 	double PB_qBI_[4];
 	double PB_bf_[3];
@@ -0,0 +1,91 @@
+/*!
+* @file 	SlippageStage.hpp
+* @author 	Michael Blösch
+* @date		10.10.2012
+* @brief	Rate-controlled slippage-detection stage
+ */
+
+#ifndef SLIPPAGESTAGE_HPP_
+#define SLIPPAGESTAGE_HPP_
+
+#include "Common.hpp"
+#include <Eigen/Dense>
+
+namespace LSE {
+
+/*! Rate-controlled slippage-detection stage. The filter hot path only hands
+ * over its per-update contact flags and slip velocities (the kinematic
+ * innovations it computes anyway), which get accumulated as cheap sufficient
+ * statistics. The derived quantities consumed by the gait supervisor
+ * (filtered flags and slip axes) are recomputed at the configured output
+ * rate only. Disabled by default. */
+class SlippageStage{
+public:
+	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+	/* -------------------- Constructor/Destructor --------------------- */
+	/*! Constructor
+	 * @param[in]	pFilename	filename of parameter-file
+	 */
+	SlippageStage(const char* pFilename);
+	/*! Destructor */
+	~SlippageStage();
+
+	/* -------------------- Stage handling --------------------- */
+	/*! Returns whether the stage is enabled (output rate specified)
+	 * @return	true if enabled
+	 */
+	bool isEnabled() const;
+	/*! Accumulates the sufficient statistics of one filter update and
+	 * refreshes the derived quantities if the output interval elapsed
+	 * @param[in]	t	time of update
+	 * @param[in]	CFC	contact flag counter of the filter
+	 * @param[in]	s	slippage detection of the update (raw flags and slip velocities)
+	 */
+	void accumulate(const double& t,const CF& CFC,const SlippageDetection& s);
+	/*! Fills the derived quantities into a slippage detection
+	 * @param[in/out]	s	slippage detection to be completed
+	 */
+	void fill(SlippageDetection& s) const;
+	/*! Resets the accumulated statistics and derived quantities */
+	void reset();
+
+private:
+	/*! Recomputes the derived quantities from the accumulated statistics and
+	 * restarts the accumulation window
+	 * @param[in]	t	time of refresh
+	 */
+	void refresh(const double& t);
+	/*! Loads overall parameters from parameter file
+	 * @param[in]	pFilename	name of parameter file
+	 */
+	void loadParam(const char* pFilename);
+
+	/* -------------------- Sufficient statistics (current window) --------------------- */
+	/*! Sum of slip velocities of the flagged samples */
+	Eigen::Matrix<double,3,LSE_N_LEG> sumSlip_;
+	/*! Number of samples with ground contact */
+	int cntContact_[LSE_N_LEG];
+	/*! Number of contact samples flagged as slipping */
+	int cntSlip_[LSE_N_LEG];
+	/*! Time of last refresh */
+	double lastRefresh_;
+
+	/* -------------------- Derived quantities (refreshed at the output rate) --------------------- */
+	/*! Filtered slippage flags */
+	int flagFiltered_[LSE_N_LEG];
+	/*! Normalized mean slip directions */
+	Eigen::Matrix<double,3,LSE_N_LEG> slipAxis_;
+
+	/* -------------------- Parameters (can be specified in the parameter file) --------------------- */
+	/*! Output rate [Hz] (0: stage disabled) */
+	double rate_;
+	/*! Fraction of flagged contact samples above which a leg is considered slipping */
+	double slipRatioTh_;
+	/*! True if the stage is enabled */
+	bool mbEnabled_;
+};
+
+}
+
+#endif /* SLIPPAGESTAGE_HPP_ */
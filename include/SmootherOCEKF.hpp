@@ -0,0 +1,142 @@
+/*!
+* @file 	SmootherOCEKF.hpp
+* @author 	Michael Blösch
+* @date		10.10.2012
+* @brief	Offline RTS smoother based on the OCEKF
+ */
+
+#ifndef SMOOTHEROCEKF_HPP_
+#define SMOOTHEROCEKF_HPP_
+
+#include "FilterOCEKF.hpp"
+#include "Common.hpp"
+#include <Eigen/Dense>
+#include "Rotations.hpp"
+#include <vector>
+
+namespace LSE {
+
+class Manager;
+
+/*! Offline Rauch-Tung-Striebel smoother. Runs the OCEKF forward over the
+ * buffered measurements, records the per-update prior, posterior and
+ * linearization of the 15-dimensional base state, and then performs the
+ * backward smoothing pass. The backward pass is partitioned into chunks
+ * processed in parallel: each chunk is seeded with the filtered estimate and
+ * recursed over an additional warm-up overlap, whose results get discarded,
+ * such that the kept range is insensitive to the seeding. */
+class SmootherOCEKF{
+public:
+	/* -------------------- Constructor/Destructor and smoothing call --------------------- */
+	/*! Constructor
+	 * @param[in]	pManager	pointer to main class Manager
+	 * @param[in]	pFilename	filename of parameter-file
+	 */
+	SmootherOCEKF(Manager* pManager,const char* pFilename);
+	/*! Destructor */
+	~SmootherOCEKF();
+	/*! Smoothes the buffered measurements over the given interval
+	 * @return	results of smoothing (0:fail, 1:success)
+	 * @param[in]	t1	start of smoothing interval
+	 * @param[in]	t2	end of smoothing interval
+	 */
+	int smooth(const double& t1,const double& t2);
+	/*! Returns the number of smoothed samples
+	 * @return	number of smoothed samples
+	 */
+	int getN() const;
+	/*! Return the smoothed estimate of the robot state (main body)
+	 * @return	smoothed robot state
+	 * @param[in]	i	sample index (0 <= i < getN())
+	 */
+	State getSmoothed(const int& i);
+
+	/* -------------------- Recording hooks (called by the forward filter) --------------------- */
+	/*! Records the predicted (prior) base state of one correction step
+	 * @param[in]	x	filter state after covariance prediction, before correction
+	 * @param[in]	F	base-state transition Jacobian since the last correction
+	 */
+	void recordPrior(const FilterOCEKF::InternState& x,const Eigen::Matrix<double,15,15>& F);
+	/*! Records the corrected (posterior) base state of one correction step
+	 * @param[in]	x	filter state after correction
+	 */
+	void recordPosterior(const FilterOCEKF::InternState& x);
+
+private:
+	/*! Storage of one forward correction step */
+	struct SmootherStep{
+		EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+
+		/*! Time of correction step */
+		double t_;
+		/*! Prior position estimate */
+		Eigen::Vector3d rPre_;
+		/*! Prior velocity estimate */
+		Eigen::Vector3d vPre_;
+		/*! Prior attitude estimate */
+		Rotations::Quat qPre_;
+		/*! Prior accelerometer bias estimate */
+		Eigen::Vector3d bfPre_;
+		/*! Prior gyroscope bias estimate */
+		Eigen::Vector3d bwPre_;
+		/*! Prior base covariance */
+		Eigen::Matrix<double,15,15> PPre_;
+		/*! Base-state transition Jacobian from the previous step */
+		Eigen::Matrix<double,15,15> F_;
+		/*! Posterior position estimate */
+		Eigen::Vector3d rPost_;
+		/*! Posterior velocity estimate */
+		Eigen::Vector3d vPost_;
+		/*! Posterior attitude estimate */
+		Rotations::Quat qPost_;
+		/*! Posterior accelerometer bias estimate */
+		Eigen::Vector3d bfPost_;
+		/*! Posterior gyroscope bias estimate */
+		Eigen::Vector3d bwPost_;
+		/*! Posterior rotational rate estimate (bias corrected) */
+		Eigen::Vector3d wPost_;
+		/*! Posterior base covariance */
+		Eigen::Matrix<double,15,15> PPost_;
+		/*! Smoothed position estimate */
+		Eigen::Vector3d rSm_;
+		/*! Smoothed velocity estimate */
+		Eigen::Vector3d vSm_;
+		/*! Smoothed attitude estimate */
+		Rotations::Quat qSm_;
+		/*! Smoothed accelerometer bias estimate */
+		Eigen::Vector3d bfSm_;
+		/*! Smoothed gyroscope bias estimate */
+		Eigen::Vector3d bwSm_;
+		/*! Smoothed base covariance */
+		Eigen::Matrix<double,15,15> PSm_;
+	};
+
+	/*! Runs the backward recursion over one chunk of steps, seeding above the
+	 * kept range and discarding the warm-up results
+	 * @param[in]	b	first step of the kept range
+	 * @param[in]	e	one past the last step of the kept range
+	 */
+	void backwardChunk(const int& b,const int& e);
+	/*! Loads overall parameters from parameter file
+	 * @param[in]	pFilename	name of parameter file
+	 */
+	void loadParam(const char* pFilename);
+
+	/* -------------------- Pointers and recorded steps --------------------- */
+	/*! Pointer to main class Manager */
+	Manager* pManager_;
+	/*! Dedicated forward filter instance (owned) */
+	FilterOCEKF* pFilter_;
+	/*! Recorded correction steps of the forward pass */
+	std::vector<SmootherStep,Eigen::aligned_allocator<SmootherStep> > steps_;
+
+	/* -------------------- Parameters (can be specified in the parameter file) --------------------- */
+	/*! Number of parallel chunks of the backward pass */
+	int nThreads_;
+	/*! Warm-up overlap of each chunk (in steps) */
+	int overlap_;
+};
+
+}
+
+#endif /* SMOOTHEROCEKF_HPP_ */
@@ -0,0 +1,296 @@
+/*!
+* @file 	BinaryLog.cpp
+* @author 	Michael Blösch
+* @date		10.10.2012
+ */
+
+#include "BinaryLog.hpp"
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace LSE {
+
+BinaryLogWriter::BinaryLogWriter(){
+	front_ = 0;
+	mbOpen_ = false;
+	mbFlushPending_ = false;
+	buf_[0].reserve(LSE_BINLOG_BUFSIZE);
+	buf_[1].reserve(LSE_BINLOG_BUFSIZE);
+}
+
+BinaryLogWriter::~BinaryLogWriter(){
+	close();
+}
+
+bool BinaryLogWriter::open(const char* pFilename){
+	if(mbOpen_) return false;
+	ofs_.open(pFilename,std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+	if(!ofs_.is_open()) return false;
+	BinaryLogFileHeader fileHeader;
+	fileHeader.magic_ = LSE_BINLOG_MAGIC;
+	fileHeader.version_ = LSE_BINLOG_VERSION;
+	ofs_.write((const char*)&fileHeader,sizeof(fileHeader));
+	front_ = 0;
+	buf_[0].clear();
+	buf_[1].clear();
+	mbFlushPending_ = false;
+	mbOpen_ = true;
+	thread_ = std::thread(&BinaryLogWriter::flushLoop,this);
+	return true;
+}
+
+void BinaryLogWriter::close(){
+	if(!mbOpen_) return;
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		mbOpen_ = false;
+		cond_.notify_all();
+	}
+	thread_.join();
+	// Flush whatever is left in either buffer (single-threaded now)
+	if(!buf_[1-front_].empty()){
+		ofs_.write(&buf_[1-front_][0],buf_[1-front_].size());
+		buf_[1-front_].clear();
+	}
+	if(!buf_[front_].empty()){
+		ofs_.write(&buf_[front_][0],buf_[front_].size());
+		buf_[front_].clear();
+	}
+	ofs_.close();
+}
+
+bool BinaryLogWriter::isOpen(){
+	return mbOpen_;
+}
+
+void BinaryLogWriter::logState(const State& x){
+	StateRecord rec;
+	rec.t_ = x.t_;
+	for(int i=0;i<3;i++){
+		rec.r_[i] = x.r_(i);
+		rec.v_[i] = x.v_(i);
+		rec.w_[i] = x.w_(i);
+	}
+	for(int i=0;i<4;i++){
+		rec.q_[i] = x.q_(i);
+	}
+	memcpy(rec.P_,x.P_.data(),sizeof(rec.P_));
+	append(LSE_RECORD_STATE,&rec,sizeof(rec));
+}
+
+void BinaryLogWriter::logImuMeas(const double& t,const ImuMeas& m){
+	ImuRecord rec;
+	rec.t_ = t;
+	for(int i=0;i<3;i++){
+		rec.f_[i] = m.f_(i);
+		rec.w_[i] = m.w_(i);
+	}
+	append(LSE_RECORD_IMU,&rec,sizeof(rec));
+}
+
+void BinaryLogWriter::logEncMeas(const double& t,const EncMeas& m){
+	EncRecord rec;
+	rec.t_ = t;
+	memcpy(rec.e_,m.e_.data(),sizeof(rec.e_));
+	memcpy(rec.v_,m.v_.data(),sizeof(rec.v_));
+	for(int i=0;i<LSE_N_LEG;i++){
+		rec.CF_[i] = m.CF_[i];
+	}
+	append(LSE_RECORD_ENC,&rec,sizeof(rec));
+}
+
+void BinaryLogWriter::logPosMeas(const double& t,const PosMeas& m){
+	PosRecord rec;
+	rec.t_ = t;
+	for(int i=0;i<3;i++){
+		rec.r_[i] = m.r_(i);
+	}
+	for(int i=0;i<4;i++){
+		rec.q_[i] = m.q_(i);
+	}
+	append(LSE_RECORD_POS,&rec,sizeof(rec));
+}
+
+void BinaryLogWriter::logSlippage(const double& t,const SlippageDetection& s){
+	SlippageRecord rec;
+	rec.t_ = t;
+	for(int i=0;i<LSE_N_LEG;i++){
+		rec.flag_[i] = s.flag_[i];
+		rec.flagFiltered_[i] = s.flagFiltered_[i];
+	}
+	memcpy(rec.slipAxis_,s.slipAxis_.data(),sizeof(rec.slipAxis_));
+	memcpy(rec.slip_,s.slip_.data(),sizeof(rec.slip_));
+	append(LSE_RECORD_SLIPPAGE,&rec,sizeof(rec));
+}
+
+void BinaryLogWriter::append(const unsigned int& type,const void* pData,const unsigned int& size){
+	if(!mbOpen_) return;
+	BinaryLogRecordHeader recordHeader;
+	recordHeader.type_ = type;
+	recordHeader.size_ = size;
+	std::unique_lock<std::mutex> lock(mutex_);
+	std::vector<char>& buf = buf_[front_];
+	const unsigned int n = buf.size();
+	buf.resize(n+sizeof(recordHeader)+size);
+	memcpy(&buf[n],&recordHeader,sizeof(recordHeader));
+	memcpy(&buf[n+sizeof(recordHeader)],pData,size);
+	if(buf.size() >= LSE_BINLOG_BUFSIZE && !mbFlushPending_){
+		// Swap buffers and hand the full one to the flusher thread
+		front_ = 1-front_;
+		mbFlushPending_ = true;
+		cond_.notify_all();
+	}
+}
+
+void BinaryLogWriter::flushLoop(){
+	std::unique_lock<std::mutex> lock(mutex_);
+	while(true){
+		while(mbOpen_ && !mbFlushPending_){
+			cond_.wait(lock);
+		}
+		if(!mbOpen_) return;
+		std::vector<char>& buf = buf_[1-front_];
+		lock.unlock();
+		ofs_.write(&buf[0],buf.size());
+		buf.clear();
+		lock.lock();
+		mbFlushPending_ = false;
+	}
+}
+
+BinaryLogReader::BinaryLogReader(){
+}
+
+BinaryLogReader::~BinaryLogReader(){
+	close();
+}
+
+bool BinaryLogReader::open(const char* pFilename){
+	ifs_.open(pFilename,std::ios_base::in | std::ios_base::binary);
+	if(!ifs_.is_open()) return false;
+	BinaryLogFileHeader fileHeader;
+	ifs_.read((char*)&fileHeader,sizeof(fileHeader));
+	if(!ifs_.good() || fileHeader.magic_ != LSE_BINLOG_MAGIC || fileHeader.version_ != LSE_BINLOG_VERSION){
+		ifs_.close();
+		return false;
+	}
+	return true;
+}
+
+void BinaryLogReader::close(){
+	if(ifs_.is_open()) ifs_.close();
+}
+
+int BinaryLogReader::next(){
+	if(!ifs_.is_open()) return 0;
+	BinaryLogRecordHeader recordHeader;
+	ifs_.read((char*)&recordHeader,sizeof(recordHeader));
+	if(!ifs_.good()) return 0;
+	switch(recordHeader.type_){
+	case LSE_RECORD_STATE:
+		if(recordHeader.size_ != sizeof(state_)) return 0;
+		ifs_.read((char*)&state_,sizeof(state_));
+		break;
+	case LSE_RECORD_IMU:
+		if(recordHeader.size_ != sizeof(imu_)) return 0;
+		ifs_.read((char*)&imu_,sizeof(imu_));
+		break;
+	case LSE_RECORD_ENC:
+		if(recordHeader.size_ != sizeof(enc_)) return 0;
+		ifs_.read((char*)&enc_,sizeof(enc_));
+		break;
+	case LSE_RECORD_SLIPPAGE:
+		if(recordHeader.size_ != sizeof(slippage_)) return 0;
+		ifs_.read((char*)&slippage_,sizeof(slippage_));
+		break;
+	case LSE_RECORD_POS:
+		if(recordHeader.size_ != sizeof(pos_)) return 0;
+		ifs_.read((char*)&pos_,sizeof(pos_));
+		break;
+	default:
+		// Unknown record, skip its payload
+		ifs_.seekg(recordHeader.size_,std::ios_base::cur);
+		return ifs_.good() ? next() : 0;
+	}
+	if(!ifs_.good()) return 0;
+	return recordHeader.type_;
+}
+
+BinaryLogMapping::BinaryLogMapping(){
+	payload_ = NULL;
+	pData_ = NULL;
+	size_ = 0;
+	pos_ = 0;
+}
+
+BinaryLogMapping::~BinaryLogMapping(){
+	close();
+}
+
+bool BinaryLogMapping::open(const char* pFilename){
+	close();
+	int fd = ::open(pFilename,O_RDONLY);
+	if(fd<0) return false;
+	struct stat st;
+	if(fstat(fd,&st)<0 || (unsigned long long)st.st_size<sizeof(BinaryLogFileHeader)){
+		::close(fd);
+		return false;
+	}
+	char* pData = (char*)mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+	::close(fd);
+	if(pData==MAP_FAILED) return false;
+	const BinaryLogFileHeader* pFileHeader = (const BinaryLogFileHeader*)pData;
+	if(pFileHeader->magic_ != LSE_BINLOG_MAGIC || pFileHeader->version_ != LSE_BINLOG_VERSION){
+		munmap(pData,st.st_size);
+		return false;
+	}
+	pData_ = pData;
+	size_ = st.st_size;
+	pos_ = sizeof(BinaryLogFileHeader);
+	return true;
+}
+
+void BinaryLogMapping::close(){
+	if(pData_!=NULL){
+		munmap(pData_,size_);
+	}
+	payload_ = NULL;
+	pData_ = NULL;
+	size_ = 0;
+	pos_ = 0;
+}
+
+int BinaryLogMapping::next(){
+	while(pData_!=NULL && pos_+sizeof(BinaryLogRecordHeader)<=size_){
+		const BinaryLogRecordHeader* pHeader = (const BinaryLogRecordHeader*)(pData_+pos_);
+		if(pos_+sizeof(BinaryLogRecordHeader)+pHeader->size_>size_) return 0;
+		payload_ = pData_+pos_+sizeof(BinaryLogRecordHeader);
+		pos_ += sizeof(BinaryLogRecordHeader)+pHeader->size_;
+		switch(pHeader->type_){
+		case LSE_RECORD_STATE:
+			if(pHeader->size_ != sizeof(StateRecord)) return 0;
+			return pHeader->type_;
+		case LSE_RECORD_IMU:
+			if(pHeader->size_ != sizeof(ImuRecord)) return 0;
+			return pHeader->type_;
+		case LSE_RECORD_ENC:
+			if(pHeader->size_ != sizeof(EncRecord)) return 0;
+			return pHeader->type_;
+		case LSE_RECORD_SLIPPAGE:
+			if(pHeader->size_ != sizeof(SlippageRecord)) return 0;
+			return pHeader->type_;
+		case LSE_RECORD_POS:
+			if(pHeader->size_ != sizeof(PosRecord)) return 0;
+			return pHeader->type_;
+		default:
+			// Unknown record, skip its payload
+			break;
+		}
+	}
+	return 0;
+}
+
+}
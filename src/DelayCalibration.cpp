@@ -5,6 +5,7 @@
  */
 
 #include "DelayCalibration.hpp"
+#include "ParamCache.hpp"
 #include "Manager.hpp"
 #include "tinyxml.h"
 
@@ -33,7 +34,37 @@ DelayCalibration::DelayCalibration(Manager* pManager,const char* pFilename){
 	mbUseEnc_ = 0;
 	mbUsePos_ = 0;
 
+	// Streaming identification parameters
+	mbStreaming_ = 0;
+	streamDt_ = 0.01;
+	streamTimeConstant_ = 30;
+	streamInterval_ = 1;
+
 	loadParam(pFilename);
+
+	// Derived streaming quantities and state. The ring length leaves room for
+	// the lag depth plus the skew between the modality streams (the rate norms
+	// of the kinematics and the pose sensor trail the IMU by the
+	// differentiation window and the actual sensor delay).
+	lagN_ = ceil(maxDelay_/streamDt_);
+	streamForget_ = exp(-streamDt_/streamTimeConstant_);
+	lastApplyTime_ = 0;
+	streamTsImu_ = 0.01;
+	lastImuStamp_ = 0;
+	imuStream_.reset(4*(lagN_+1));
+	encStream_.reset(4*(lagN_+1));
+	posStream_.reset(4*(lagN_+1));
+	corrImuEnc_.reset(lagN_);
+	corrImuPos_.reset(lagN_);
+	corrEncPos_.reset(lagN_);
+	mbStreamFootholds_ = false;
+	mbStanceBroken_ = false;
+	encQuatTimes_.assign(difWindowEnc_+1,0.0);
+	encQuats_.assign(difWindowEnc_+1,Rotations::quatIdentity());
+	encQuatCnt_ = 0;
+	posQuatTimes_.assign(difWindowPos_+1,0.0);
+	posQuats_.assign(difWindowPos_+1,Rotations::quatIdentity());
+	posQuatCnt_ = 0;
 }
 
 DelayCalibration::~DelayCalibration(){
@@ -53,64 +84,280 @@ int DelayCalibration::calibrateDelay(const double& t,const double& T){
 	if(mbUsePos_) getPosNorms();
 
 	int M = std::max(floor(N_/2),N_-2*ceil(maxDelay_/dt_));
-	double cc;
-	double ccMax;
-	int ccMaxIndex;
 
 	// Align Encoders and IMU by evaluating crosscorrelation
 	if(mbUseImu_ && mbUseEnc_){
-		ccMax = 0;
-		ccMaxIndex = 0;
-		for(int i=0;i<N_-M+1;i++){
-			cc = 0;
-			for(int j=0;j<M;j++){
-				cc += encRateNorm_[floor((N_-M)/2)+j]*imuRateNorm_[i+j];
-			}
-			if(cc>ccMax){
-				ccMax = cc;
-				ccMaxIndex = i-floor((N_-M)/2);
-			}
-		}
 		pManager_->tImu_ = 0;
-		pManager_->tEnc_ = ccMaxIndex*dt_;
+		pManager_->tEnc_ = bestCorrelationOffset(imuRateNorm_,encRateNorm_,M)*dt_;
 	}
 
 	// Align 6DOF pose and IMU by evaluating crosscorrelation
 	if(mbUseImu_ && mbUsePos_){
-		ccMax = 0;
-		ccMaxIndex = 0;
-		for(int i=0;i<N_-M+1;i++){
-			cc = 0;
-			for(int j=0;j<M;j++){
-				cc += posRateNorm_[floor((N_-M)/2)+j]*imuRateNorm_[i+j];
-			}
-			if(cc>ccMax){
-				ccMax = cc;
-				ccMaxIndex = i-floor((N_-M)/2);
-			}
-		}
 		pManager_->tImu_ = 0;
-		pManager_->tPos_ = ccMaxIndex*dt_;
+		pManager_->tPos_ = bestCorrelationOffset(imuRateNorm_,posRateNorm_,M)*dt_;
 	} else if(mbUseEnc_ && mbUsePos_){
-		ccMax = 0;
-		ccMaxIndex = 0;
-		for(int i=0;i<N_-M+1;i++){
-			cc = 0;
-			for(int j=0;j<M;j++){
-				cc += posRateNorm_[floor((N_-M)/2)+j]*encRateNorm_[i+j];
-			}
-			if(cc>ccMax){
-				ccMax = cc;
-				ccMaxIndex = i-floor((N_-M)/2);
-			}
-		}
 		pManager_->tEnc_ = 0;
-		pManager_->tPos_ = ccMaxIndex*dt_;
+		pManager_->tPos_ = bestCorrelationOffset(encRateNorm_,posRateNorm_,M)*dt_;
 	}
 
 	return 1;
 }
 
+bool DelayCalibration::isStreaming() const{
+	return mbStreaming_;
+}
+
+void DelayCalibration::NormStream::reset(const int& size){
+	ring_.assign(size,0.0);
+	first_ = 0;
+	next_ = 0;
+	lastTime_ = 0;
+	lastNorm_ = 0;
+	mbInit_ = false;
+}
+
+void DelayCalibration::NormStream::push(const double& t,const double& norm,const double& dt){
+	if(!mbInit_){
+		first_ = (long)ceil(t/dt);
+		next_ = first_;
+		lastTime_ = t;
+		lastNorm_ = norm;
+		mbInit_ = true;
+		return;
+	}
+	if(t <= lastTime_) return;
+	while(next_*dt <= t){
+		ring_[next_%(long)ring_.size()] = lastNorm_+(norm-lastNorm_)/(t-lastTime_)*(next_*dt-lastTime_);
+		next_++;
+	}
+	lastTime_ = t;
+	lastNorm_ = norm;
+}
+
+double DelayCalibration::NormStream::at(const long& i) const{
+	return ring_[i%(long)ring_.size()];
+}
+
+void DelayCalibration::CorrBank::reset(const int& lagN){
+	c_.assign(2*lagN+1,0.0);
+	next_ = -1;
+	weight_ = 0;
+}
+
+void DelayCalibration::updateCorrelation(CorrBank& bank,const NormStream& sx,const NormStream& sy){
+	if(!sx.mbInit_ || !sy.mbInit_) return;
+
+	// Last grid index fully produced by both streams
+	long avail = std::min(sx.next_,sy.next_)-1;
+	if(bank.next_ < 0) bank.next_ = std::max(sx.first_,sy.first_)+lagN_;
+	// Skip ahead if the bank fell behind the ring history
+	if(bank.next_ < avail-lagN_-1) bank.next_ = avail-lagN_-1;
+
+	while(bank.next_ <= avail){
+		const long n = bank.next_;
+		for(int i=0;i<2*lagN_+1;i++){
+			bank.c_[i] *= streamForget_;
+		}
+		// Entry lagN_+k holds lag k: x[n]*y[n-k] peaks at the lag by which
+		// the timestamps of y trail those of x
+		for(int k=0;k<=lagN_;k++){
+			bank.c_[lagN_+k] += sx.at(n)*sy.at(n-k);
+		}
+		for(int j=1;j<=lagN_;j++){
+			bank.c_[lagN_-j] += sx.at(n-j)*sy.at(n);
+		}
+		bank.weight_ = streamForget_*bank.weight_+1;
+		bank.next_++;
+	}
+}
+
+double DelayCalibration::bankEstimate(const CorrBank& bank) const{
+	// Search correlation maximum over the lags
+	double ccMax = bank.c_[0];
+	int ccMaxIndex = 0;
+	for(int i=1;i<2*lagN_+1;i++){
+		if(bank.c_[i]>ccMax){
+			ccMax = bank.c_[i];
+			ccMaxIndex = i;
+		}
+	}
+
+	// Parabolic sub-grid refinement
+	double refine = 0;
+	if(ccMaxIndex>0 && ccMaxIndex<2*lagN_){
+		const double d = bank.c_[ccMaxIndex-1]-2*bank.c_[ccMaxIndex]+bank.c_[ccMaxIndex+1];
+		if(d<0) refine = 0.5*(bank.c_[ccMaxIndex-1]-bank.c_[ccMaxIndex+1])/d;
+	}
+	return (ccMaxIndex-lagN_+refine)*streamDt_;
+}
+
+void DelayCalibration::applyStreamEstimates(const double& t){
+	if(t < lastApplyTime_+streamInterval_) return;
+	lastApplyTime_ = t;
+
+	// Require enough effective support to cover the full lag range
+	const double minWeight = 2.0*lagN_;
+
+	// Align Encoders and IMU
+	if(mbUseImu_ && mbUseEnc_ && corrImuEnc_.weight_ >= minWeight){
+		pManager_->tImu_ = 0;
+		pManager_->tEnc_ = bankEstimate(corrImuEnc_);
+	}
+
+	// Align 6DOF pose and IMU
+	if(mbUseImu_ && mbUsePos_ && corrImuPos_.weight_ >= minWeight){
+		pManager_->tImu_ = 0;
+		pManager_->tPos_ = bankEstimate(corrImuPos_);
+	} else if(mbUseEnc_ && mbUsePos_ && corrEncPos_.weight_ >= minWeight){
+		pManager_->tEnc_ = 0;
+		pManager_->tPos_ = bankEstimate(corrEncPos_);
+	}
+}
+
+void DelayCalibration::addImuSample(const double& t,const ImuMeas& m){
+	if(!mbUseImu_) return;
+
+	// Track the IMU sampling time (used for the half-sample timestamp shift)
+	if(lastImuStamp_ > 0 && t > lastImuStamp_){
+		streamTsImu_ += 0.1*((t-lastImuStamp_)-streamTsImu_);
+	}
+	lastImuStamp_ = t;
+
+	imuStream_.push(t-0.5*streamTsImu_,m.w_.norm(),streamDt_);
+	if(mbUseEnc_) updateCorrelation(corrImuEnc_,imuStream_,encStream_);
+	if(mbUsePos_) updateCorrelation(corrImuPos_,imuStream_,posStream_);
+	applyStreamEstimates(t);
+}
+
+void DelayCalibration::addEncSample(const double& t,const EncMeas& m){
+	if(!mbUseEnc_) return;
+
+	// Refresh the footholds once a full stance is available after a step. The
+	// differentiation window gets restarted on a refresh since attitudes
+	// relative to different foothold sets must not be compared.
+	if(m.CF_.sum() < LSE_N_LEG) mbStanceBroken_ = true;
+	if(m.CF_.sum() == LSE_N_LEG && (!mbStreamFootholds_ || mbStanceBroken_)){
+		pManager_->legKinAll(streamFootholds_,m.e_);
+		mbStreamFootholds_ = true;
+		mbStanceBroken_ = false;
+		encQuatCnt_ = 0;
+	}
+	if(!mbStreamFootholds_ || m.CF_.sum() < 3) return;
+
+	// Differentiate the kinematic attitude over difWindowEnc_ accepted samples
+	const int size = difWindowEnc_+1;
+	encQuatTimes_[encQuatCnt_%size] = t;
+	encQuats_[encQuatCnt_%size] = quatFromFootholds(m,streamFootholds_);
+	encQuatCnt_++;
+	if(encQuatCnt_ > difWindowEnc_){
+		q1_ = encQuats_[encQuatCnt_%size];
+		q2_ = encQuats_[(encQuatCnt_-1)%size];
+		const double dT = t-encQuatTimes_[encQuatCnt_%size];
+		if(dT > 0){
+			encStream_.push(t-0.5*dT,Rotations::rangePi(Rotations::quatToRotVec(Rotations::quatR(q1_).transpose()*q2_)).norm()/dT,streamDt_);
+		}
+	}
+	if(mbUseImu_) updateCorrelation(corrImuEnc_,imuStream_,encStream_);
+	if(mbUsePos_) updateCorrelation(corrEncPos_,encStream_,posStream_);
+	applyStreamEstimates(t);
+}
+
+void DelayCalibration::addPosSample(const double& t,const PosMeas& m){
+	if(!mbUsePos_) return;
+
+	// Differentiate the pose sensor attitude over difWindowPos_ samples
+	const int size = difWindowPos_+1;
+	posQuatTimes_[posQuatCnt_%size] = t;
+	posQuats_[posQuatCnt_%size] = m.q_;
+	posQuatCnt_++;
+	if(posQuatCnt_ > difWindowPos_){
+		q1_ = posQuats_[posQuatCnt_%size];
+		q2_ = posQuats_[(posQuatCnt_-1)%size];
+		const double dT = t-posQuatTimes_[posQuatCnt_%size];
+		if(dT > 0){
+			posStream_.push(t-0.5*dT,Rotations::rangePi(Rotations::quatToRotVec(Rotations::quatR(q1_).transpose()*q2_)).norm()/dT,streamDt_);
+		}
+	}
+	if(mbUseImu_) updateCorrelation(corrImuPos_,imuStream_,posStream_);
+	if(mbUseEnc_) updateCorrelation(corrEncPos_,encStream_,posStream_);
+	applyStreamEstimates(t);
+}
+
+void DelayCalibration::fft(std::vector<std::complex<double> >& a,const bool& inverse){
+	int L = a.size();
+
+	// Bit-reversal permutation
+	int j = 0;
+	for(int i=1;i<L;i++){
+		int bit = L >> 1;
+		for(;j & bit;bit >>= 1){
+			j ^= bit;
+		}
+		j |= bit;
+		if(i<j){
+			std::swap(a[i],a[j]);
+		}
+	}
+
+	// Butterfly passes
+	for(int len=2;len<=L;len <<= 1){
+		double arg = 2*M_PI/len;
+		if(inverse) arg = -arg;
+		std::complex<double> wl(cos(arg),sin(arg));
+		for(int i=0;i<L;i+=len){
+			std::complex<double> w(1.0,0.0);
+			for(int k=0;k<len/2;k++){
+				std::complex<double> u = a[i+k];
+				std::complex<double> v = a[i+k+len/2]*w;
+				a[i+k] = u+v;
+				a[i+k+len/2] = u-v;
+				w = w*wl;
+			}
+		}
+	}
+
+	if(inverse){
+		for(int i=0;i<L;i++){
+			a[i] /= L;
+		}
+	}
+}
+
+int DelayCalibration::bestCorrelationOffset(const std::vector<double>& sig,const std::vector<double>& ref,const int& M){
+	int c0 = floor((N_-M)/2);
+
+	// Zero-padded power-of-two length
+	int L = 1;
+	while(L < N_+M) L <<= 1;
+
+	// Correlate via FFT: IFFT(FFT(sig)*conj(FFT(window)))
+	std::vector<std::complex<double> > X(L,std::complex<double>(0.0,0.0));
+	std::vector<std::complex<double> > W(L,std::complex<double>(0.0,0.0));
+	for(int i=0;i<N_;i++){
+		X[i] = sig[i];
+	}
+	for(int i=0;i<M;i++){
+		W[i] = ref[c0+i];
+	}
+	fft(X,false);
+	fft(W,false);
+	for(int i=0;i<L;i++){
+		X[i] = X[i]*std::conj(W[i]);
+	}
+	fft(X,true);
+
+	// Search correlation maximum over the candidate offsets
+	double ccMax = 0;
+	int ccMaxIndex = 0;
+	for(int i=0;i<N_-M+1;i++){
+		if(X[i].real()>ccMax){
+			ccMax = X[i].real();
+			ccMaxIndex = i-c0;
+		}
+	}
+	return ccMaxIndex;
+}
+
 int DelayCalibration::initialize(const double& t,const double& T){
 	t1_ = t-T;
 	t2_ = t;
@@ -231,11 +478,9 @@ void DelayCalibration::getImuNorms(){
 void DelayCalibration::getEncNorms(){
 	// Get footholds based on first full stance
 	Eigen::Matrix<double,3,LSE_N_LEG> p;
-	for(int i=0;i<LSE_N_LEG;i++){
-		itEnc_ = pManager_->encMeasList_.lower_bound(t1_);
-		while((*itEnc_).second.CF_.sum() < LSE_N_LEG && itEnc_ != pManager_->encMeasList_.end()) itEnc_++;
-		p.col(i) = (*pManager_->legKin)((*itEnc_).second.e_.col(i),i);
-	}
+	itEnc_ = pManager_->encMeasList_.lower_bound(t1_);
+	while((*itEnc_).second.CF_.sum() < LSE_N_LEG && itEnc_ != pManager_->encMeasList_.end()) itEnc_++;
+	pManager_->legKinAll(p,(*itEnc_).second.e_);
 
 	// Calculate and interpolate enc norms
 	// Initialize iterators
@@ -327,6 +572,8 @@ Rotations::Quat DelayCalibration::quatFromFootholds(const EncMeas& m,const Eigen
 	Rotations::Quat b;
 	Eigen::Matrix4d A;
 	Eigen::Matrix4d B;
+	Eigen::Matrix<double,3,LSE_N_LEG> sKin;
+	pManager_->legKinAll(sKin,m.e_);
 	A.setZero();
 	for(int i=0;i<LSE_N_LEG;i++){
 		if(m.CF_[i]){
@@ -334,7 +581,7 @@ Rotations::Quat DelayCalibration::quatFromFootholds(const EncMeas& m,const Eigen
 				if(m.CF_[j]){
 					a.block(0,0,3,1) = p.col(i)-p.col(j);
 					a(3) = 0;
-					b.block(0,0,3,1) = (*pManager_->legKin)(m.e_.col(i),i)-(*pManager_->legKin)(m.e_.col(j),j);
+					b.block(0,0,3,1) = sKin.col(i)-sKin.col(j);
 					b(3) = 0;
 					B = Rotations::quatR(a)-Rotations::quatL(b);
 					A = A + B.transpose()*B;
@@ -356,11 +603,11 @@ Rotations::Quat DelayCalibration::quatFromFootholds(const EncMeas& m,const Eigen
 
 void DelayCalibration::loadParam(const char* pFilename){
 	// Open parameter file
-	TiXmlDocument doc(pFilename);
-	if (!doc.LoadFile()) return;
+	TiXmlDocument* doc = ParamCache::get(pFilename);
+	if (doc==NULL) return;
 
 	// Define handles and elements
-	TiXmlHandle hDoc(&doc);
+	TiXmlHandle hDoc(doc);
 	TiXmlElement* pElem;
 	TiXmlHandle hRoot(0);
 
@@ -396,6 +643,14 @@ void DelayCalibration::loadParam(const char* pFilename){
 			mbUsePos_ = mInt;
 			pElem->QueryIntAttribute("difWindow", &difWindowPos_);
 		}
+
+		pElem=hRoot.FirstChild("DelayCalibrationSettings").FirstChild("Streaming").Element();
+		if (pElem){
+			if(pElem->QueryIntAttribute("use", &mInt)==TIXML_SUCCESS) mbStreaming_ = mInt;
+			pElem->QueryDoubleAttribute("dt", &streamDt_);
+			pElem->QueryDoubleAttribute("timeConstant", &streamTimeConstant_);
+			pElem->QueryDoubleAttribute("interval", &streamInterval_);
+		}
 	}
 }
 
@@ -5,6 +5,7 @@
  */
 
 #include "FilterFLS.hpp"
+#include "ParamCache.hpp"
 #include "Manager.hpp"
 #include "tinyxml.h"
 #include <map>
@@ -148,14 +149,16 @@ void FilterFLS::resetEstimate(const double& t){
 }
 
 void FilterFLS::filterState(InternState& x,const double& tEnd){
-	std::map<double,ImuMeas>::iterator itImu;
-	std::map<double,EncMeas>::iterator itEnc;
+	MeasStorage<ImuMeas,LSE_MEAS_N>::iterator itImu;
+	MeasStorage<EncMeas,LSE_MEAS_N>::iterator itEnc;
 	ImuMeas imuMeas;
 	double tNext;
 
 	// Get current measurements
-	itImu = pManager_->imuMeasList_.upper_bound(x.t_-pManager_->tImu_);
-	itEnc = pManager_->encMeasList_.upper_bound(x.t_-pManager_->tEnc_);
+	curImu_.attach(&pManager_->imuMeasList_);
+	curEnc_.attach(&pManager_->encMeasList_);
+	itImu = curImu_.upper_bound(x.t_-pManager_->tImu_);
+	itEnc = curEnc_.upper_bound(x.t_-pManager_->tEnc_);
 
 	// Get current IMU measurement
 	if(itImu != pManager_->imuMeasList_.end()){
@@ -367,13 +370,17 @@ void FilterFLS::encUpdateState(InternState& x, const EncMeas& m){
 			}
 		}
 
-		// Compute forward kinematics and Jacobians
+		// Compute forward kinematics and Jacobians (all legs in one call)
 		Eigen::Matrix<double,3*LSE_N_LEG,1> s;
 		Eigen::Matrix<double,3*LSE_N_LEG,LSE_DOF_LEG> J;
+		Eigen::Matrix<double,3,LSE_N_LEG> sKin;
+		Eigen::Matrix<double,3*LSE_N_LEG,LSE_DOF_LEG> JKin;
+		pManager_->legKinAll(sKin,m.e_);
+		pManager_->legKinJacAll(JKin,m.e_);
 		for(int i=0;i<LSE_N_LEG;i++){
 			// I_r_IF = C(q_IB)*(-B_r_BI + B_r_BK + C'(q_KB)*K_r_KF
-			s.block(3*i,0,3,1) = Rotations::quatToRotMat(pManager_->q_IB_)*(-pManager_->B_r_BI_+pManager_->B_r_BK_+Rotations::quatToRotMat(pManager_->q_KB_).transpose()*(*pManager_->legKin)(m.e_.col(i),i));
-			J.block(3*i,0,3,LSE_DOF_LEG) = Rotations::quatToRotMat(pManager_->q_IB_)*Rotations::quatToRotMat(pManager_->q_KB_).transpose()*(*pManager_->legKinJac)(m.e_.col(i),i);
+			s.block(3*i,0,3,1) = Rotations::quatToRotMat(pManager_->q_IB_)*(-pManager_->B_r_BI_+pManager_->B_r_BK_+Rotations::quatToRotMat(pManager_->q_KB_).transpose()*sKin.col(i));
+			J.block(3*i,0,3,LSE_DOF_LEG) = Rotations::quatToRotMat(pManager_->q_IB_)*Rotations::quatToRotMat(pManager_->q_KB_).transpose()*JKin.block(3*i,0,3,LSE_DOF_LEG);
 		}
 
 		// Compute measurement noise sigma points using Cholesky decomposition
@@ -485,7 +492,7 @@ void FilterFLS::encUpdateState(InternState& x, const EncMeas& m){
 	}
 }
 
-void FilterFLS::outlierDetection(InternState& x,const Eigen::Matrix<double,12,12>& Pyinv){
+void FilterFLS::outlierDetection(InternState& x,const Eigen::Matrix<double,3*LSE_N_LEG,3*LSE_N_LEG>& Pyinv){
 	bool outliers[LSE_N_LEG];
 	double ratio[LSE_N_LEG];
 
@@ -543,11 +550,11 @@ void FilterFLS::outlierDetection(InternState& x,const Eigen::Matrix<double,12,12
 
 void FilterFLS::loadParam(const char* pFilename){
 	// Open parameter file
-	TiXmlDocument doc(pFilename);
-	if (!doc.LoadFile()) return;
+	TiXmlDocument* doc = ParamCache::get(pFilename);
+	if (doc==NULL) return;
 
 	// Define handles and elements
-	TiXmlHandle hDoc(&doc);
+	TiXmlHandle hDoc(doc);
 	TiXmlElement* pElem;
 	TiXmlHandle hRoot(0);
 
@@ -691,7 +698,7 @@ void FilterFLS::logState(){
 	  pManager_->ofsLog_ << xs_.x_.q_(0) << "\t" << xs_.x_.q_(1) << "\t" << xs_.x_.q_(2) << "\t" << xs_.x_.q_(3) << "\t";
 	  pManager_->ofsLog_ << xs_.x_.bf_(0) << "\t" << xs_.x_.bf_(1) << "\t" << xs_.x_.bf_(2) << "\t";
 	  pManager_->ofsLog_ << xs_.x_.bw_(0) << "\t" << xs_.x_.bw_(1) << "\t" << xs_.x_.bw_(2) << "\t";
-	  pManager_->ofsLog_ << xs_.LegArray_[0] << "\t" << xs_.LegArray_[1] << "\t" << xs_.LegArray_[2] << "\t" << xs_.LegArray_[3] << "\t";
+	  for(int i=0;i<LSE_N_LEG;i++) pManager_->ofsLog_ << xs_.LegArray_[i] << "\t";
 	  for(int i=0;i<LSE_VUKF_N;i++){
 		  pManager_->ofsLog_ << xs_.P_(i,i) << "\t";
 	  }
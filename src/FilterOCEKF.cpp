@@ -5,6 +5,8 @@
  */
 
 #include "FilterOCEKF.hpp"
+#include "SmootherOCEKF.hpp"
+#include "ParamCache.hpp"
 #include "Manager.hpp"
 #include "tinyxml.h"
 #include <map>
@@ -13,6 +15,7 @@ namespace LSE {
 
 FilterOCEKF::FilterOCEKF(Manager* pManager,const char* pFilename): FilterBase(){
 	pManager_ = pManager;
+	pRecorder_ = NULL;
 
 	// Init all parameters
 	xInit_.t_ = 0;
@@ -54,6 +57,10 @@ FilterOCEKF::FilterOCEKF(Manager* pManager,const char* pFilename): FilterBase(){
 	mbFixedTimeStepping_ = false;
 	timeStep_ = 0.0;
 
+	// Snapshot ring
+	snapshotInd_ = 0;
+	snapshotCnt_ = 0;
+
 	loadParam(pFilename);
 }
 
@@ -68,8 +75,11 @@ void FilterOCEKF::update(const double& t){
 		tsNew = std::min(tsNew,pManager_->encMeasList_.rbegin()->first+pManager_->tEnc_);
 		if(xs_.t_<tsNew){
 			filterState(xs_,tsNew);
+			storeSnapshot();
 			if(pManager_->isLogging_){
+				LSE_TIC(log)
 				logState();
+				LSE_TOC(perfStats_,LSE_PERF_STAGE_LOG,log)
 			}
 		}
 	}
@@ -130,17 +140,53 @@ void FilterOCEKF::resetEstimate(const double& t){
 	xs_.t_ = t;
 	xs_.tLast_ = t;
 	xp_ = xs_;
+	snapshotInd_ = 0;
+	snapshotCnt_ = 0;
+}
+
+void FilterOCEKF::storeSnapshot(){
+	xSnapshot_[snapshotInd_] = xs_;
+	snapshotInd_ = (snapshotInd_+1)%LSE_SNAPSHOT_N;
+	if(snapshotCnt_<LSE_SNAPSHOT_N) snapshotCnt_++;
+}
+
+void FilterOCEKF::rollback(const double& t){
+	if(snapshotCnt_==0 || t>=xs_.t_) return;
+	// Search backwards for the newest snapshot strictly older than t (the
+	// re-filtering only applies measurements newer than the restored state)
+	int ind = snapshotInd_;
+	int steps = 0;
+	int found = -1;
+	while(steps<snapshotCnt_){
+		ind = (ind+LSE_SNAPSHOT_N-1)%LSE_SNAPSHOT_N;
+		steps++;
+		if(xSnapshot_[ind].t_<t){
+			found = ind;
+			break;
+		}
+	}
+	if(found<0){
+		// Older than the whole ring, best effort: restore the oldest snapshot
+		found = ind;
+	}
+	xs_ = xSnapshot_[found];
+	// Drop snapshots newer than the restored state, the next update recreates
+	// them while re-filtering over the buffered measurements
+	snapshotCnt_ -= steps-1;
+	snapshotInd_ = (found+1)%LSE_SNAPSHOT_N;
 }
 
 void FilterOCEKF::filterState(InternState& x,const double& tEnd){
-	std::map<double,ImuMeas>::iterator itImu;
-	std::map<double,EncMeas>::iterator itEnc;
+	MeasStorage<ImuMeas,LSE_MEAS_N>::iterator itImu;
+	MeasStorage<EncMeas,LSE_MEAS_N>::iterator itEnc;
 	ImuMeas imuMeas;
 	double tNext;
 
 	// Get current measurements
-	itImu = pManager_->imuMeasList_.upper_bound(x.t_-pManager_->tImu_);
-	itEnc = pManager_->encMeasList_.upper_bound(x.t_-pManager_->tEnc_);
+	curImu_.attach(&pManager_->imuMeasList_);
+	curEnc_.attach(&pManager_->encMeasList_);
+	itImu = curImu_.upper_bound(x.t_-pManager_->tImu_);
+	itEnc = curEnc_.upper_bound(x.t_-pManager_->tEnc_);
 
 	// Get current IMU measurement
 	if(itImu != pManager_->imuMeasList_.end()){
@@ -161,12 +207,16 @@ void FilterOCEKF::filterState(InternState& x,const double& tEnd){
 		if(itEnc != pManager_->encMeasList_.end()) tNext = std::min(tNext,itEnc->first+pManager_->tEnc_);
 
 		// Predict state
+		LSE_TIC(pre)
 		predictState(x,tNext,imuMeas);
+		LSE_TOC(perfStats_,LSE_PERF_STAGE_PRE,pre)
 
 		// Correct state if necessary
 		if(itEnc != pManager_->encMeasList_.end() && tNext >= itEnc->first+pManager_->tEnc_){
 			if(mbUseKin_){
+				LSE_TIC(enc)
 				encUpdateState(x,itEnc->second);
+				LSE_TOC(perfStats_,LSE_PERF_STAGE_ENC,enc)
 			}
 			itEnc++;
 		}
@@ -205,11 +255,13 @@ void FilterOCEKF::predictState(InternState& x, const double& tPre, const ImuMeas
 }
 
 void FilterOCEKF::encUpdateState(InternState& x, const EncMeas& m){
-	// Compute forward kinematic
+	// Compute forward kinematic (all legs in one call)
 	Eigen::Matrix<double,3,LSE_N_LEG> s;
+	Eigen::Matrix<double,3,LSE_N_LEG> sKin;
+	pManager_->legKinAll(sKin,m.e_);
 	for(int i=0;i<LSE_N_LEG;i++){
 		// I_r_IF = C(q_IB)*(-B_r_BI + B_r_BK + C'(q_KB)*K_r_KF
-		s.col(i) = Rotations::quatToRotMat(pManager_->q_IB_)*(-pManager_->B_r_BI_+pManager_->B_r_BK_+Rotations::quatToRotMat(pManager_->q_KB_).transpose()*(*pManager_->legKin)(m.e_.col(i),i));
+		s.col(i) = Rotations::quatToRotMat(pManager_->q_IB_)*(-pManager_->B_r_BI_+pManager_->B_r_BK_+Rotations::quatToRotMat(pManager_->q_KB_).transpose()*sKin.col(i));
 	}
 
 	// Update Contact count
@@ -265,15 +317,19 @@ void FilterOCEKF::encUpdateState(InternState& x, const EncMeas& m){
 	x.vLast_ = x.v_;
 	x.qLast_ = x.q_;
 
-	// Get Gamma Matrices
-	Eigen::Matrix3d G0,G1,G2,G3;
-	G0 = pManager_->gamma(0,x.wLin_,dt);
-	G1 = pManager_->gamma(1,x.wLin_,dt);
-	G2 = pManager_->gamma(2,x.wLin_,dt);
-	G3 = pManager_->gamma(3,x.wLin_,dt);
-
-	// Predict covariance
-	Eigen::Matrix<double,15+3*LSE_N_LEG,15+3*LSE_N_LEG> F;
+	// Get Gamma Matrices (all orders in one pass)
+	Eigen::Matrix3d G[4];
+	pManager_->gammaAll(G,x.wLin_,dt);
+	Eigen::Matrix3d& G0 = G[0];
+	Eigen::Matrix3d& G1 = G[1];
+	Eigen::Matrix3d& G2 = G[2];
+	Eigen::Matrix3d& G3 = G[3];
+
+	// Predict covariance (partitioned: F is identity on the foothold blocks,
+	// such that only the base block and the base-foothold cross terms move.
+	// Swing-leg blocks are skipped entirely, they get reinitialized at the
+	// next touchdown anyway)
+	Eigen::Matrix<double,15,15> F;
 	F.setIdentity();
 	F.block(0,3,3,3) = dt*Eigen::Matrix3d::Identity();
 	F.block(0,6,3,3) = -R_WI_last*Rotations::vecToSqew(pow(dt,2)/2.0*x.f1Lin_);
@@ -291,7 +347,7 @@ void FilterOCEKF::encUpdateState(InternState& x, const EncMeas& m){
 		F.block(6,12,3,3).setZero();
 	}
 
-	Eigen::Matrix<double,15+3*LSE_N_LEG,15+3*LSE_N_LEG> W;
+	Eigen::Matrix<double,15,15> W;
 	W.setZero();
 	if(mbEstimateAccBias_){
 		W.block(0,0,3,3) = pow(dt,3)/3.0*pManager_->Rf_+pow(dt,5)/20.0*Wbf_+dt*Wr_;
@@ -317,11 +373,17 @@ void FilterOCEKF::encUpdateState(InternState& x, const EncMeas& m){
 	} else {
 		W.block(6,6,3,3) = pow(dt,1)/1.0*pManager_->Rw_+dt*Wq_;
 	}
+
+	x.P_.block(0,0,15,15) = F*x.P_.block(0,0,15,15)*F.transpose()+W;
 	for(int i=0;i<LSE_N_LEG;i++){
-		W.block(15+i*3,15+i*3,3,3) = dt*R_WI_last*Wp_*R_IW_last;
+		if(x.CFC_[i]>0){
+			x.P_.block(0,15+3*i,15,3) = F*x.P_.block(0,15+3*i,15,3);
+			x.P_.block(15+3*i,0,3,15) = x.P_.block(0,15+3*i,15,3).transpose();
+			x.P_.block(15+3*i,15+3*i,3,3) += dt*R_WI_last*Wp_*R_IW_last;
+		}
 	}
 
-	x.P_ = F*x.P_*F.transpose()+W;
+	if(pRecorder_!=NULL) pRecorder_->recordPrior(x,F);
 
 	// Update state and covariance
 	Eigen::Matrix<double,15+3*LSE_N_LEG,1> dx;
@@ -332,68 +394,104 @@ void FilterOCEKF::encUpdateState(InternState& x, const EncMeas& m){
 		}
 	}
 	if(contactNo>0){
+		// The measurement only involves the base states and the footholds of
+		// the contact legs, gather the corresponding sub-covariance and run
+		// the update on it. The swing-leg blocks are untouched, they get
+		// reinitialized at the next touchdown anyway.
+		const int activeNo = 15+3*contactNo;
+		int legInd[LSE_N_LEG];
+		int c = 0;
+		for(int i=0;i < LSE_N_LEG;i++){
+			if(x.CFC_[i]>0){
+				legInd[c] = i;
+				c++;
+			}
+		}
+		Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic> Pa(activeNo,activeNo);
+		Pa.block(0,0,15,15) = x.P_.block(0,0,15,15);
+		for(int j=0;j<contactNo;j++){
+			Pa.block(0,15+3*j,15,3) = x.P_.block(0,15+3*legInd[j],15,3);
+			Pa.block(15+3*j,0,3,15) = x.P_.block(15+3*legInd[j],0,3,15);
+			for(int k=0;k<contactNo;k++){
+				Pa.block(15+3*j,15+3*k,3,3) = x.P_.block(15+3*legInd[j],15+3*legInd[k],3,3);
+			}
+		}
+
 		// Init matrices
-		Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic> G(3*contactNo,15+3*LSE_N_LEG);
+		Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic> G(3*contactNo,activeNo);
 		Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic> R(3*contactNo,3*contactNo);
 		Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic> S(3*contactNo,3*contactNo);
-		Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic> K(15+3*LSE_N_LEG,3*contactNo);
+		Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic> K(activeNo,3*contactNo);
 		Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic> y(3*contactNo,1);
+		Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic> dxa(activeNo,1);
 		G.setZero();
 		R.setZero();
 		S.setZero();
 		K.setZero();
 		y.setZero();
 
-		int j=0;
-		for(int i=0;i < LSE_N_LEG;i++){
-			if(x.CFC_[i]>0){
-				G.block(3*j,0,3,3) = -R_IW;
-				G.block(3*j,6,3,3) = R_IW*Rotations::vecToSqew(x.pLin_.col(i)-x.r_)*R_WI;
-				G.block(3*j,15+3*i,3,3) = R_IW;
-				if(mbAssumeFlatFloor_){
-					G.block(3*j,17+3*i,3,1).setZero();
-				}
-				if(pManager_->legKinJac!=NULL){
-					R.block(3*j,3*j,3,3) = pManager_->Rs_ + (*pManager_->legKinJac)(m.e_.col(i),i)*pManager_->Ra_*((*pManager_->legKinJac)(m.e_.col(i),i)).transpose();
-				} else {
-					R.block(3*j,3*j,3,3) = pManager_->Rs_;
-				}
-				y.block(3*j,0,3,1) = s.col(i)-R_IW*(x.p_.col(i)-x.r_);
-				j++;
+		Eigen::Matrix<double,3*LSE_N_LEG,LSE_DOF_LEG> JKin;
+		const bool hasJac = pManager_->hasLegKinJac();
+		if(hasJac){
+			pManager_->legKinJacAll(JKin,m.e_);
+		}
+		for(int j=0;j<contactNo;j++){
+			const int i = legInd[j];
+			G.block(3*j,0,3,3) = -R_IW;
+			G.block(3*j,6,3,3) = R_IW*Rotations::vecToSqew(x.pLin_.col(i)-x.r_)*R_WI;
+			G.block(3*j,15+3*j,3,3) = R_IW;
+			if(mbAssumeFlatFloor_){
+				G.block(3*j,17+3*j,3,1).setZero();
 			}
+			if(hasJac){
+				R.block(3*j,3*j,3,3) = pManager_->Rs_ + JKin.block(3*i,0,3,LSE_DOF_LEG)*pManager_->Ra_*JKin.block(3*i,0,3,LSE_DOF_LEG).transpose();
+			} else {
+				R.block(3*j,3*j,3,3) = pManager_->Rs_;
+			}
+			y.block(3*j,0,3,1) = s.col(i)-R_IW*(x.p_.col(i)-x.r_);
 		}
 
-		S = G*x.P_*G.transpose() + R;
-		K = x.P_*G.transpose()*S.inverse();
+		S = G*Pa*G.transpose() + R;
+		K = Pa*G.transpose()*S.inverse();
 		// Correction vector
-		dx = K*y;
-		x.P_ = (Eigen::Matrix<double,15+3*LSE_N_LEG,15+3*LSE_N_LEG>::Identity() - K*G)*x.P_;
+		dxa = K*y;
+		Pa = (Eigen::Matrix<double,Eigen::Dynamic,Eigen::Dynamic>::Identity(activeNo,activeNo) - K*G)*Pa;
+
+		// Scatter the updated sub-covariance back
+		x.P_.block(0,0,15,15) = Pa.block(0,0,15,15);
+		for(int j=0;j<contactNo;j++){
+			x.P_.block(0,15+3*legInd[j],15,3) = Pa.block(0,15+3*j,15,3);
+			x.P_.block(15+3*legInd[j],0,3,15) = Pa.block(15+3*j,0,3,15);
+			for(int k=0;k<contactNo;k++){
+				x.P_.block(15+3*legInd[j],15+3*legInd[k],3,3) = Pa.block(15+3*j,15+3*k,3,3);
+			}
+		}
 
 		// Get corrected state
-		x.r_ = x.r_ + dx.block(0,0,3,1);
-		x.v_ = x.v_ + dx.block(3,0,3,1);
-		x.q_ = Rotations::quatL(Rotations::rotVecToQuat(-dx.block(6,0,3,1)))*x.q_;
+		x.r_ = x.r_ + dxa.block(0,0,3,1);
+		x.v_ = x.v_ + dxa.block(3,0,3,1);
+		x.q_ = Rotations::quatL(Rotations::rotVecToQuat(-dxa.block(6,0,3,1)))*x.q_;
 		x.q_.normalize();
-		if(mbEstimateAccBias_) x.bf_ = x.bf_ + dx.block(9,0,3,1);
-		if(mbEstimateRotBias_) x.bw_ = x.bw_ + dx.block(12,0,3,1);
-		for(int i=0;i < LSE_N_LEG;i++){
-			if(x.CFC_[i]>0){
-				x.p_.col(i) = x.p_.col(i) + dx.block(15+3*i,0,3,1);
-				if(mbAssumeFlatFloor_){
-					x.p_(2,i) = 0;
-				}
+		if(mbEstimateAccBias_) x.bf_ = x.bf_ + dxa.block(9,0,3,1);
+		if(mbEstimateRotBias_) x.bw_ = x.bw_ + dxa.block(12,0,3,1);
+		for(int j=0;j<contactNo;j++){
+			x.p_.col(legInd[j]) = x.p_.col(legInd[j]) + dxa.block(15+3*j,0,3,1);
+			if(mbAssumeFlatFloor_){
+				x.p_(2,legInd[j]) = 0;
 			}
 		}
 	}
+
+	if(pRecorder_!=NULL) pRecorder_->recordPosterior(x);
 }
 
 void FilterOCEKF::loadParam(const char* pFilename){
 	// Open parameter file
-	TiXmlDocument doc(pFilename);
-	if (!doc.LoadFile()) return;
+	TiXmlDocument* doc = ParamCache::get(pFilename);
+	if (doc==NULL) return;
 
 	// Define handles and elements
-	TiXmlHandle hDoc(&doc);
+	TiXmlHandle hDoc(doc);
 	TiXmlElement* pElem;
 	TiXmlHandle hRoot(0);
 
@@ -5,6 +5,7 @@
  */
 
 #include "FilterVUKF.hpp"
+#include "ParamCache.hpp"
 #include "Manager.hpp"
 #include "tinyxml.h"
 #include <map>
@@ -87,7 +88,9 @@ void FilterVUKF::update(const double& t){
 		if(xs_.t_<tsNew){
 			filterState(xs_,tsNew);
 			if(pManager_->isLogging_){
+				LSE_TIC(log)
 				logState();
+				LSE_TOC(perfStats_,LSE_PERF_STAGE_LOG,log)
 			}
 		}
 	}
@@ -150,14 +153,16 @@ void FilterVUKF::resetEstimate(const double& t){
 }
 
 void FilterVUKF::filterState(InternState& x,const double& tEnd){
-	std::map<double,ImuMeas>::iterator itImu;
-	std::map<double,EncMeas>::iterator itEnc;
+	MeasStorage<ImuMeas,LSE_MEAS_N>::iterator itImu;
+	MeasStorage<EncMeas,LSE_MEAS_N>::iterator itEnc;
 	ImuMeas imuMeas;
 	double tNext;
 
 	// Get current measurements
-	itImu = pManager_->imuMeasList_.upper_bound(x.t_-pManager_->tImu_);
-	itEnc = pManager_->encMeasList_.upper_bound(x.t_-pManager_->tEnc_);
+	curImu_.attach(&pManager_->imuMeasList_);
+	curEnc_.attach(&pManager_->encMeasList_);
+	itImu = curImu_.upper_bound(x.t_-pManager_->tImu_);
+	itEnc = curEnc_.upper_bound(x.t_-pManager_->tEnc_);
 
 	// Get current IMU measurement
 	if(itImu != pManager_->imuMeasList_.end()){
@@ -178,12 +183,16 @@ void FilterVUKF::filterState(InternState& x,const double& tEnd){
 		if(itEnc != pManager_->encMeasList_.end()) tNext = std::min(tNext,itEnc->first+pManager_->tEnc_);
 
 		// Predict state
+		LSE_TIC(pre)
 		predictState(x,tNext,imuMeas);
+		LSE_TOC(perfStats_,LSE_PERF_STAGE_PRE,pre)
 
 		// Correct state if necessary
 		if(itEnc != pManager_->encMeasList_.end() && tNext >= itEnc->first+pManager_->tEnc_){
 			if(mbUseKin_){
+				LSE_TIC(enc)
 				encUpdateState(x,itEnc->second);
+				LSE_TOC(perfStats_,LSE_PERF_STAGE_ENC,enc)
 			}
 			itEnc++;
 		}
@@ -209,18 +218,17 @@ void FilterVUKF::predictState(InternState& x, const double& tPre, const ImuMeas&
 	x.x_.w_ = m.w_;
 	x.x_.f_ = m.f_;
 
-	Matrix30d PA;
-	PA.setZero();
-	PA.block(0,0,15,15) = x.P_;
-	PA.block(15,15,3,3) = Wr_/dt;
-	PA.block(18,18,3,3) = pManager_->Rf_/dt;
-	PA.block(21,21,3,3) = pManager_->Rw_/dt;
-	PA.block(24,24,3,3) = Wbf_/dt;
-	PA.block(27,27,3,3) = Wbw_/dt;
+	ws_.PA_.setZero();
+	ws_.PA_.block(0,0,15,15) = x.P_;
+	ws_.PA_.block(15,15,3,3) = Wr_/dt;
+	ws_.PA_.block(18,18,3,3) = pManager_->Rf_/dt;
+	ws_.PA_.block(21,21,3,3) = pManager_->Rw_/dt;
+	ws_.PA_.block(24,24,3,3) = Wbf_/dt;
+	ws_.PA_.block(27,27,3,3) = Wbw_/dt;
 
 	// Cholesky decomposition
-	Eigen::LLT<Matrix30d> lltOfPA(PA);
-	Matrix30d SPA = lltOfPA.matrixL();
+	Eigen::LLT<Matrix30d> lltOfPA(ws_.PA_);
+	ws_.SPA_ = lltOfPA.matrixL();
 
 
 //	Eigen::Matrix<double,LSE_VUKF_N,LSE_VUKF_N> F;
@@ -239,69 +247,69 @@ void FilterVUKF::predictState(InternState& x, const double& tPre, const ImuMeas&
 	// Sample sigma points for prediction
 	x.X_[0] = x.x_;
 	for(int i=1;i<=2*LSE_VUKF_N;i++){
-		x.X_[i].r_ = x.x_.r_ + UKFGamma_*SPA.block(0,i-1,3,1);
-		x.X_[i].v_ = x.x_.v_ + UKFGamma_*SPA.block(3,i-1,3,1);
-		x.X_[i].q_ = Rotations::quatL(Rotations::rotVecToQuat(UKFGamma_*SPA.block(6,i-1,3,1)))*x.x_.q_;
+		x.X_[i].r_ = x.x_.r_ + UKFGamma_*ws_.SPA_.block(0,i-1,3,1);
+		x.X_[i].v_ = x.x_.v_ + UKFGamma_*ws_.SPA_.block(3,i-1,3,1);
+		x.X_[i].q_ = Rotations::quatL(Rotations::rotVecToQuat(UKFGamma_*ws_.SPA_.block(6,i-1,3,1)))*x.x_.q_;
 		if(!mbEstimateAccBias_){
 			x.X_[i].bf_ = x.x_.bf_;
 		} else {
-			x.X_[i].bf_ = x.x_.bf_ + UKFGamma_*SPA.block(9,i-1,3,1);
+			x.X_[i].bf_ = x.x_.bf_ + UKFGamma_*ws_.SPA_.block(9,i-1,3,1);
 		}
 		if(!mbEstimateRotBias_){
 			x.X_[i].bw_ = x.x_.bw_;
 		} else {
-			x.X_[i].bw_ = x.x_.bw_ + UKFGamma_*SPA.block(12,i-1,3,1);
+			x.X_[i].bw_ = x.x_.bw_ + UKFGamma_*ws_.SPA_.block(12,i-1,3,1);
 		}
-		x.X_[i].nr_ = UKFGamma_*SPA.block(15,i-1,3,1);
-		x.X_[i].f_ = x.x_.f_ + UKFGamma_*SPA.block(18,i-1,3,1);
-		x.X_[i].w_ = x.x_.w_ + UKFGamma_*SPA.block(21,i-1,3,1);
-		x.X_[i].nbf_ = UKFGamma_*SPA.block(24,i-1,3,1);
-		x.X_[i].nbw_ = UKFGamma_*SPA.block(27,i-1,3,1);
+		x.X_[i].nr_ = UKFGamma_*ws_.SPA_.block(15,i-1,3,1);
+		x.X_[i].f_ = x.x_.f_ + UKFGamma_*ws_.SPA_.block(18,i-1,3,1);
+		x.X_[i].w_ = x.x_.w_ + UKFGamma_*ws_.SPA_.block(21,i-1,3,1);
+		x.X_[i].nbf_ = UKFGamma_*ws_.SPA_.block(24,i-1,3,1);
+		x.X_[i].nbw_ = UKFGamma_*ws_.SPA_.block(27,i-1,3,1);
 
-		x.X_[i+2*LSE_VUKF_N].r_ = x.x_.r_ - UKFGamma_*SPA.block(0,i-1,3,1);
-		x.X_[i+2*LSE_VUKF_N].v_ = x.x_.v_ - UKFGamma_*SPA.block(3,i-1,3,1);
-		x.X_[i+2*LSE_VUKF_N].q_ = Rotations::quatL(Rotations::rotVecToQuat(-UKFGamma_*SPA.block(6,i-1,3,1)))*x.x_.q_;
+		x.X_[i+2*LSE_VUKF_N].r_ = x.x_.r_ - UKFGamma_*ws_.SPA_.block(0,i-1,3,1);
+		x.X_[i+2*LSE_VUKF_N].v_ = x.x_.v_ - UKFGamma_*ws_.SPA_.block(3,i-1,3,1);
+		x.X_[i+2*LSE_VUKF_N].q_ = Rotations::quatL(Rotations::rotVecToQuat(-UKFGamma_*ws_.SPA_.block(6,i-1,3,1)))*x.x_.q_;
 		if(!mbEstimateAccBias_){
 			x.X_[i+2*LSE_VUKF_N].bf_ = x.x_.bf_;
 		} else {
-			x.X_[i+2*LSE_VUKF_N].bf_ = x.x_.bf_ - UKFGamma_*SPA.block(9,i-1,3,1);
+			x.X_[i+2*LSE_VUKF_N].bf_ = x.x_.bf_ - UKFGamma_*ws_.SPA_.block(9,i-1,3,1);
 		}
 		if(!mbEstimateRotBias_){
 			x.X_[i+2*LSE_VUKF_N].bw_ = x.x_.bw_;
 		} else {
-			x.X_[i+2*LSE_VUKF_N].bw_ = x.x_.bw_ - UKFGamma_*SPA.block(12,i-1,3,1);
+			x.X_[i+2*LSE_VUKF_N].bw_ = x.x_.bw_ - UKFGamma_*ws_.SPA_.block(12,i-1,3,1);
 		}
-		x.X_[i+2*LSE_VUKF_N].nr_ = -UKFGamma_*SPA.block(15,i-1,3,1);
-		x.X_[i+2*LSE_VUKF_N].f_ = x.x_.f_ - UKFGamma_*SPA.block(18,i-1,3,1);
-		x.X_[i+2*LSE_VUKF_N].w_ = x.x_.w_ - UKFGamma_*SPA.block(21,i-1,3,1);
-		x.X_[i+2*LSE_VUKF_N].nbf_ = -UKFGamma_*SPA.block(24,i-1,3,1);
-		x.X_[i+2*LSE_VUKF_N].nbw_ = -UKFGamma_*SPA.block(27,i-1,3,1);
+		x.X_[i+2*LSE_VUKF_N].nr_ = -UKFGamma_*ws_.SPA_.block(15,i-1,3,1);
+		x.X_[i+2*LSE_VUKF_N].f_ = x.x_.f_ - UKFGamma_*ws_.SPA_.block(18,i-1,3,1);
+		x.X_[i+2*LSE_VUKF_N].w_ = x.x_.w_ - UKFGamma_*ws_.SPA_.block(21,i-1,3,1);
+		x.X_[i+2*LSE_VUKF_N].nbf_ = -UKFGamma_*ws_.SPA_.block(24,i-1,3,1);
+		x.X_[i+2*LSE_VUKF_N].nbw_ = -UKFGamma_*ws_.SPA_.block(27,i-1,3,1);
 	}
 
 	// Propagate sigma points
-	AugmentedState as = x.x_;
-	Eigen::Matrix3d G0T = pManager_->gamma(0,-dt*(as.w_-as.bw_));
-	Eigen::Matrix3d G1T = pManager_->gamma(1,-dt*(as.w_-as.bw_));
-	Eigen::Matrix3d G2T = pManager_->gamma(2,-dt*(as.w_-as.bw_));
+	ws_.as_ = x.x_;
+	Eigen::Matrix3d G0T = pManager_->gamma(0,-dt*(ws_.as_.w_-ws_.as_.bw_));
+	Eigen::Matrix3d G1T = pManager_->gamma(1,-dt*(ws_.as_.w_-ws_.as_.bw_));
+	Eigen::Matrix3d G2T = pManager_->gamma(2,-dt*(ws_.as_.w_-ws_.as_.bw_));
 	Eigen::Matrix3d R_IW, R_WI;
 	bool upGyroStuff = true;
 	for(int i=0;i<=2*(2*LSE_VUKF_N);i++){
-		if (as.w_-as.bw_ == x.X_[i].w_ - x.X_[i].bw_) upGyroStuff = false;
-		as = x.X_[i];
+		if (ws_.as_.w_-ws_.as_.bw_ == x.X_[i].w_ - x.X_[i].bw_) upGyroStuff = false;
+		ws_.as_ = x.X_[i];
 		if(upGyroStuff){
-			G0T = pManager_->gamma(0,-dt*(as.w_-as.bw_));
-			G1T = pManager_->gamma(1,-dt*(as.w_-as.bw_));
-			G2T = pManager_->gamma(2,-dt*(as.w_-as.bw_));
+			G0T = pManager_->gamma(0,-dt*(ws_.as_.w_-ws_.as_.bw_));
+			G1T = pManager_->gamma(1,-dt*(ws_.as_.w_-ws_.as_.bw_));
+			G2T = pManager_->gamma(2,-dt*(ws_.as_.w_-ws_.as_.bw_));
 		}
-		R_WI = Rotations::quatToRotMat(as.q_);
+		R_WI = Rotations::quatToRotMat(ws_.as_.q_);
 		R_IW = R_WI.transpose();
 
-		as.r_ = G0T*(as.r_+dt*as.v_-dt*dt/2*(2*G2T*(as.f_-as.bf_)+R_IW*pManager_->g_))+as.nr_*dt;
-		as.v_ = G0T*(as.v_-dt*(G1T*(as.f_-as.bf_)+R_IW*pManager_->g_));
-		as.q_ = Rotations::quatL(as.q_)*Rotations::rotVecToQuat(dt*(as.w_-as.bw_));
-		as.bf_ = as.bf_ + as.nbf_*dt;
-		as.bw_ = as.bw_ + as.nbw_*dt;
-		x.X_[i] = as;
+		ws_.as_.r_ = G0T*(ws_.as_.r_+dt*ws_.as_.v_-dt*dt/2*(2*G2T*(ws_.as_.f_-ws_.as_.bf_)+R_IW*pManager_->g_))+ws_.as_.nr_*dt;
+		ws_.as_.v_ = G0T*(ws_.as_.v_-dt*(G1T*(ws_.as_.f_-ws_.as_.bf_)+R_IW*pManager_->g_));
+		ws_.as_.q_ = Rotations::quatL(ws_.as_.q_)*Rotations::rotVecToQuat(dt*(ws_.as_.w_-ws_.as_.bw_));
+		ws_.as_.bf_ = ws_.as_.bf_ + ws_.as_.nbf_*dt;
+		ws_.as_.bw_ = ws_.as_.bw_ + ws_.as_.nbw_*dt;
+		x.X_[i] = ws_.as_;
 		bool upGyroStuff = true;
 	}
 
@@ -320,25 +328,24 @@ void FilterVUKF::predictState(InternState& x, const double& tPre, const ImuMeas&
 		x.x_.bw_ += UKFWi_*x.X_[i].bw_;
 	}
 	x.x_.q_ = Rotations::quatL(Rotations::rotVecToQuat(vec))*x.X_[0].q_;
-	Eigen::Matrix<double,LSE_VUKF_N,1> vec15;
-	vec15.block(0,0,3,1) = x.X_[0].r_-x.x_.r_ ;
-	vec15.block(3,0,3,1) = x.X_[0].v_-x.x_.v_ ;
-	vec15.block(6,0,3,1) = Rotations::quatToRotVec(Rotations::quatL(x.X_[0].q_)*Rotations::quatInverse(x.x_.q_));
-	vec15.block(9,0,3,1) = x.X_[0].bf_-x.x_.bf_ ;
-	vec15.block(12,0,3,1) = x.X_[0].bw_-x.x_.bw_ ;
-	x.P_ = (UKFWc_+2*3*LSE_N_LEG*UKFWi_)*vec15*vec15.transpose();
+	ws_.vec15_.block(0,0,3,1) = x.X_[0].r_-x.x_.r_ ;
+	ws_.vec15_.block(3,0,3,1) = x.X_[0].v_-x.x_.v_ ;
+	ws_.vec15_.block(6,0,3,1) = Rotations::quatToRotVec(Rotations::quatL(x.X_[0].q_)*Rotations::quatInverse(x.x_.q_));
+	ws_.vec15_.block(9,0,3,1) = x.X_[0].bf_-x.x_.bf_ ;
+	ws_.vec15_.block(12,0,3,1) = x.X_[0].bw_-x.x_.bw_ ;
+	x.P_ = (UKFWc_+2*3*LSE_N_LEG*UKFWi_)*ws_.vec15_*ws_.vec15_.transpose();
 	for(int i=1;i<=2*(2*LSE_VUKF_N);i++){
-		vec15.block(0,0,3,1) = x.X_[i].r_-x.x_.r_ ;
-		vec15.block(3,0,3,1) = x.X_[i].v_-x.x_.v_ ;
-		vec15.block(6,0,3,1) = Rotations::quatToRotVec(Rotations::quatL(x.X_[i].q_)*Rotations::quatInverse(x.x_.q_));
-		vec15.block(9,0,3,1) = x.X_[i].bf_-x.x_.bf_ ;
-		vec15.block(12,0,3,1) = x.X_[i].bw_-x.x_.bw_ ;
-		x.P_ += UKFWi_*vec15*vec15.transpose();
+		ws_.vec15_.block(0,0,3,1) = x.X_[i].r_-x.x_.r_ ;
+		ws_.vec15_.block(3,0,3,1) = x.X_[i].v_-x.x_.v_ ;
+		ws_.vec15_.block(6,0,3,1) = Rotations::quatToRotVec(Rotations::quatL(x.X_[i].q_)*Rotations::quatInverse(x.x_.q_));
+		ws_.vec15_.block(9,0,3,1) = x.X_[i].bf_-x.x_.bf_ ;
+		ws_.vec15_.block(12,0,3,1) = x.X_[i].bw_-x.x_.bw_ ;
+		x.P_ += UKFWi_*ws_.vec15_*ws_.vec15_.transpose();
 	}
 
 //	//EKF
 //	x.x_ = x.X_[0];
-//	x.P_ = F*x.P_*F.transpose() + PA.block(15,15,15,15)*dt*dt;
+//	x.P_ = F*x.P_*F.transpose() + ws_.PA_.block(15,15,15,15)*dt*dt;
 
 
 	// Avoid singular P
@@ -369,13 +376,15 @@ void FilterVUKF::encUpdateState(InternState& x, const EncMeas& m){
 			}
 		}
 
-		// Compute forward kinematics and Jacobians
-		Eigen::Matrix<double,3*LSE_N_LEG,1> s;
-		Eigen::Matrix<double,3*LSE_N_LEG,LSE_DOF_LEG> J;
+		// Compute forward kinematics and Jacobians (all legs in one call)
+		Eigen::Matrix<double,3,LSE_N_LEG> sKin;
+		Eigen::Matrix<double,3*LSE_N_LEG,LSE_DOF_LEG> JKin;
+		pManager_->legKinAll(sKin,m.e_);
+		pManager_->legKinJacAll(JKin,m.e_);
 		for(int i=0;i<LSE_N_LEG;i++){
 			// I_r_IF = C(q_IB)*(-B_r_BI + B_r_BK + C'(q_KB)*K_r_KF
-			s.block(3*i,0,3,1) = Rotations::quatToRotMat(pManager_->q_IB_)*(-pManager_->B_r_BI_+pManager_->B_r_BK_+Rotations::quatToRotMat(pManager_->q_KB_).transpose()*(*pManager_->legKin)(m.e_.col(i),i));
-			J.block(3*i,0,3,LSE_DOF_LEG) = Rotations::quatToRotMat(pManager_->q_IB_)*Rotations::quatToRotMat(pManager_->q_KB_).transpose()*(*pManager_->legKinJac)(m.e_.col(i),i);
+			ws_.s_.block(3*i,0,3,1) = Rotations::quatToRotMat(pManager_->q_IB_)*(-pManager_->B_r_BI_+pManager_->B_r_BK_+Rotations::quatToRotMat(pManager_->q_KB_).transpose()*sKin.col(i));
+			ws_.J_.block(3*i,0,3,LSE_DOF_LEG) = Rotations::quatToRotMat(pManager_->q_IB_)*Rotations::quatToRotMat(pManager_->q_KB_).transpose()*JKin.block(3*i,0,3,LSE_DOF_LEG);
 		}
 
 		// Compute measurement noise sigma points using Cholesky decomposition
@@ -384,110 +393,109 @@ void FilterVUKF::encUpdateState(InternState& x, const EncMeas& m){
 		SRda = UKFGamma_*SRda;
 
 		// Project through measurement function
-		AugmentedState as = x.x_;
-		Eigen::Matrix<double,3*LSE_N_LEG,1> nf;
-		Eigen::Matrix<double,3*LSE_N_LEG,2*(2*LSE_VUKF_N+3*LSE_N_LEG)+1> Y;
+		ws_.as_ = x.x_;
 		int noiColInd = 0;
 		for(int i=0;i<=2*(2*LSE_VUKF_N+3*LSE_N_LEG);i++){
 			if(i<=2*(2*LSE_VUKF_N)){
-				as = x.X_[i];
-				nf.setZero();
+				ws_.as_ = x.X_[i];
+				ws_.nf_.setZero();
 			} else if (i<=2*(2*LSE_VUKF_N)+3*LSE_N_LEG) {
-				as = x.X_[0];
-				nf.setZero();
+				ws_.as_ = x.X_[0];
+				ws_.nf_.setZero();
 				noiColInd = std::floor((i-2*(2*LSE_VUKF_N)-1)/3);
-				nf.block(3*noiColInd,0,3,1) = SRda.col((i-2*(2*LSE_VUKF_N)-1)%3);
+				ws_.nf_.block(3*noiColInd,0,3,1) = SRda.col((i-2*(2*LSE_VUKF_N)-1)%3);
 			} else {
-				as = x.X_[0];
-				nf.setZero();
+				ws_.as_ = x.X_[0];
+				ws_.nf_.setZero();
 				noiColInd = std::floor((i-2*(2*LSE_VUKF_N)-3*LSE_N_LEG-1)/3);
-				nf.block(3*noiColInd,0,3,1) = -SRda.col((i-2*(2*LSE_VUKF_N)-3*LSE_N_LEG-1)%3);
+				ws_.nf_.block(3*noiColInd,0,3,1) = -SRda.col((i-2*(2*LSE_VUKF_N)-3*LSE_N_LEG-1)%3);
 			}
 			for(int j=0;j<LSE_N_LEG;j++){
-				Y.block(j*3,i,3,1) = -as.v_ + Rotations::vecToSqew(as.w_-as.bw_)*s.block(3*j,0,3,1) + J.block(3*j,0,3,LSE_DOF_LEG)*m.v_.col(j) - nf.block(3*j,0,3,1);
+				ws_.Y_.block(j*3,i,3,1) = -ws_.as_.v_ + Rotations::vecToSqew(ws_.as_.w_-ws_.as_.bw_)*ws_.s_.block(3*j,0,3,1) + ws_.J_.block(3*j,0,3,LSE_DOF_LEG)*m.v_.col(j) - ws_.nf_.block(3*j,0,3,1);
 			}
 		}
 
 		// Update: compute innovation, corresponding covariance, cross-covariance, Kalman gain
-		x.y_ = UKFWs_*Y.col(0);
+		x.y_ = UKFWs_*ws_.Y_.col(0);
 		for(int i=1;i<=2*(2*LSE_VUKF_N+3*LSE_N_LEG);i++){
-			x.y_ += UKFWi_*Y.col(i);
+			x.y_ += UKFWi_*ws_.Y_.col(i);
 		}
 
-		Eigen::Matrix<double,3*LSE_N_LEG,3*LSE_N_LEG> Py = UKFWc_*(Y.col(0)-x.y_)*(Y.col(0)-x.y_).transpose();
+		ws_.Py_ = UKFWc_*(ws_.Y_.col(0)-x.y_)*(ws_.Y_.col(0)-x.y_).transpose();
 		for(int i=1;i<=2*(2*LSE_VUKF_N+3*LSE_N_LEG);i++){
-			Py += UKFWi_*(Y.col(i)-x.y_)*(Y.col(i)-x.y_).transpose();
+			ws_.Py_ += UKFWi_*(ws_.Y_.col(i)-x.y_)*(ws_.Y_.col(i)-x.y_).transpose();
 		}
 
-		Eigen::Matrix<double,LSE_VUKF_N,1> vec15;
-		vec15.block(0,0,3,1) = x.X_[0].r_-x.x_.r_ ;
-		vec15.block(3,0,3,1) = x.X_[0].v_-x.x_.v_ ;
-		vec15.block(6,0,3,1) = Rotations::quatToRotVec(Rotations::quatL(x.X_[0].q_)*Rotations::quatInverse(x.x_.q_));
-		vec15.block(9,0,3,1) = x.X_[0].bf_-x.x_.bf_ ;
-		vec15.block(12,0,3,1) = x.X_[0].bw_-x.x_.bw_ ;
-		Eigen::Matrix<double,LSE_VUKF_N,3*LSE_N_LEG> Pxy = UKFWc_*vec15*(Y.col(0)-x.y_).transpose();
+			ws_.vec15_.block(0,0,3,1) = x.X_[0].r_-x.x_.r_ ;
+		ws_.vec15_.block(3,0,3,1) = x.X_[0].v_-x.x_.v_ ;
+		ws_.vec15_.block(6,0,3,1) = Rotations::quatToRotVec(Rotations::quatL(x.X_[0].q_)*Rotations::quatInverse(x.x_.q_));
+		ws_.vec15_.block(9,0,3,1) = x.X_[0].bf_-x.x_.bf_ ;
+		ws_.vec15_.block(12,0,3,1) = x.X_[0].bw_-x.x_.bw_ ;
+		ws_.Pxy_ = UKFWc_*ws_.vec15_*(ws_.Y_.col(0)-x.y_).transpose();
 		for(int i=1;i<=2*(2*LSE_VUKF_N+3*LSE_N_LEG);i++){
 			if(i<=2*(2*LSE_VUKF_N)){
-				as = x.X_[i];
+				ws_.as_ = x.X_[i];
 			} else {
-				as = x.X_[0];
+				ws_.as_ = x.X_[0];
 			}
-			vec15.block(0,0,3,1) = as.r_-x.x_.r_ ;
-			vec15.block(3,0,3,1) = as.v_-x.x_.v_ ;
-			vec15.block(6,0,3,1) = Rotations::quatToRotVec(Rotations::quatL(as.q_)*Rotations::quatInverse(x.x_.q_));
-			vec15.block(9,0,3,1) = as.bf_-x.x_.bf_ ;
-			vec15.block(12,0,3,1) = as.bw_-x.x_.bw_ ;
-			Pxy += UKFWi_*vec15*(Y.col(i)-x.y_).transpose();
+			ws_.vec15_.block(0,0,3,1) = ws_.as_.r_-x.x_.r_ ;
+			ws_.vec15_.block(3,0,3,1) = ws_.as_.v_-x.x_.v_ ;
+			ws_.vec15_.block(6,0,3,1) = Rotations::quatToRotVec(Rotations::quatL(ws_.as_.q_)*Rotations::quatInverse(x.x_.q_));
+			ws_.vec15_.block(9,0,3,1) = ws_.as_.bf_-x.x_.bf_ ;
+			ws_.vec15_.block(12,0,3,1) = ws_.as_.bw_-x.x_.bw_ ;
+			ws_.Pxy_ += UKFWi_*ws_.vec15_*(ws_.Y_.col(i)-x.y_).transpose();
 		}
 
 		// Compute inverse of innovation covariance and reject outliers (the probability to find y out of the 3-sigma bound is about 0.25%
-		Eigen::Matrix<double,3*LSE_N_LEG,3*LSE_N_LEG> Pyinv = Py.inverse();
-		outlierDetection(x,Pyinv);
+		ws_.Pyinv_ = ws_.Py_.inverse();
+		LSE_TIC(slip)
+		outlierDetection(x,ws_.Pyinv_);
+		LSE_TOC(perfStats_,LSE_PERF_STAGE_SLIP,slip)
 		for(int i=0;i<LSE_N_LEG;i++){
 			if(x.LegArray_[i]==0){
-				Pyinv.block(3*i,0,3,3*LSE_N_LEG).setZero();
-				Pyinv.block(0,3*i,3*LSE_N_LEG,3).setZero();
+				ws_.Pyinv_.block(3*i,0,3,3*LSE_N_LEG).setZero();
+				ws_.Pyinv_.block(0,3*i,3*LSE_N_LEG,3).setZero();
 			}
 		}
 
-		Eigen::Matrix<double,LSE_VUKF_N,3*LSE_N_LEG> K = Pxy*Pyinv;
+		ws_.K_ = ws_.Pxy_*ws_.Pyinv_;
 
 
 //		// EKF
-//		y = Y.col(0);
+//		y = ws_.Y_.col(0);
 //		Eigen::Matrix<double,3*LSE_N_LEG,LSE_VUKF_N> G;
 //		G.setZero();
 //		for(int i=0;i<LSE_N_LEG;i++){
 //			G.block(3*i,3,3,3) = -Eigen::Matrix3d::Identity();
-//			G.block(3*i,12,3,3) = Rotations::vecToSqew(s.block(3*i,0,3,1));
+//			G.block(3*i,12,3,3) = Rotations::vecToSqew(ws_.s_.block(3*i,0,3,1));
 //		}
-//		Py = G*x.P_*G.transpose();
+//		ws_.Py_ = G*x.P_*G.transpose();
 //		for(int i=0;i<LSE_N_LEG;i++){
-//			Py.block(3*i,3*i,3,3) += pManager_->Rda_;
+//			ws_.Py_.block(3*i,3*i,3,3) += pManager_->Rda_;
 //		}
-//		Pyinv = Py.inverse();
+//		ws_.Pyinv_ = ws_.Py_.inverse();
 //		for(int i=0;i<LSE_N_LEG;i++){
 //			if(x.LegArray_[i]==0){
-//				Pyinv.block(3*i,0,3,3*LSE_N_LEG).setZero();
-//				Pyinv.block(0,3*i,3*LSE_N_LEG,3).setZero();
+//				ws_.Pyinv_.block(3*i,0,3,3*LSE_N_LEG).setZero();
+//				ws_.Pyinv_.block(0,3*i,3*LSE_N_LEG,3).setZero();
 //			}
 //		}
-//		K = x.P_*G.transpose()*Pyinv;
+//		ws_.K_ = x.P_*G.transpose()*ws_.Pyinv_;
 
 		// Update state and covariance matrix
-		vec15 = -K*x.y_;
-		x.x_.r_ = x.x_.r_ + vec15.block(0,0,3,1);
-		x.x_.v_ = x.x_.v_ + vec15.block(3,0,3,1);
-		x.x_.q_ = Rotations::quatL(Rotations::rotVecToQuat(vec15.block(6,0,3,1)))*x.x_.q_;
-		x.x_.bf_ = x.x_.bf_ + vec15.block(9,0,3,1);
-		x.x_.bw_ = x.x_.bw_ + vec15.block(12,0,3,1);
-		x.P_ = x.P_ - K*Py*K.transpose();
+		ws_.vec15_ = -ws_.K_*x.y_;
+		x.x_.r_ = x.x_.r_ + ws_.vec15_.block(0,0,3,1);
+		x.x_.v_ = x.x_.v_ + ws_.vec15_.block(3,0,3,1);
+		x.x_.q_ = Rotations::quatL(Rotations::rotVecToQuat(ws_.vec15_.block(6,0,3,1)))*x.x_.q_;
+		x.x_.bf_ = x.x_.bf_ + ws_.vec15_.block(9,0,3,1);
+		x.x_.bw_ = x.x_.bw_ + ws_.vec15_.block(12,0,3,1);
+		x.P_ = x.P_ - ws_.K_*ws_.Py_*ws_.K_.transpose();
 
 		// TODO check unobservability
 	}
 }
 
-void FilterVUKF::outlierDetection(InternState& x,const Eigen::Matrix<double,12,12>& Pyinv){
+void FilterVUKF::outlierDetection(InternState& x,const Eigen::Matrix<double,3*LSE_N_LEG,3*LSE_N_LEG>& Pyinv){
 	bool outliers[LSE_N_LEG];
 	double ratio[LSE_N_LEG];
 
@@ -545,11 +553,11 @@ void FilterVUKF::outlierDetection(InternState& x,const Eigen::Matrix<double,12,1
 
 void FilterVUKF::loadParam(const char* pFilename){
 	// Open parameter file
-	TiXmlDocument doc(pFilename);
-	if (!doc.LoadFile()) return;
+	TiXmlDocument* doc = ParamCache::get(pFilename);
+	if (doc==NULL) return;
 
 	// Define handles and elements
-	TiXmlHandle hDoc(&doc);
+	TiXmlHandle hDoc(doc);
 	TiXmlElement* pElem;
 	TiXmlHandle hRoot(0);
 
@@ -693,7 +701,7 @@ void FilterVUKF::logState(){
 	  pManager_->ofsLog_ << xs_.x_.q_(0) << "\t" << xs_.x_.q_(1) << "\t" << xs_.x_.q_(2) << "\t" << xs_.x_.q_(3) << "\t";
 	  pManager_->ofsLog_ << xs_.x_.bf_(0) << "\t" << xs_.x_.bf_(1) << "\t" << xs_.x_.bf_(2) << "\t";
 	  pManager_->ofsLog_ << xs_.x_.bw_(0) << "\t" << xs_.x_.bw_(1) << "\t" << xs_.x_.bw_(2) << "\t";
-	  pManager_->ofsLog_ << xs_.LegArray_[0] << "\t" << xs_.LegArray_[1] << "\t" << xs_.LegArray_[2] << "\t" << xs_.LegArray_[3] << "\t";
+	  for(int i=0;i<LSE_N_LEG;i++) pManager_->ofsLog_ << xs_.LegArray_[i] << "\t";
 	  for(int i=0;i<LSE_VUKF_N;i++){
 		  pManager_->ofsLog_ << xs_.P_(i,i) << "\t";
 	  }
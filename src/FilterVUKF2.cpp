@@ -5,7 +5,9 @@
  */
 
 #include "FilterVUKF2.hpp"
+#include "ParamCache.hpp"
 #include "Manager.hpp"
+#include "SlippageStage.hpp"
 #include "tinyxml.h"
 #include <map>
 #include <Eigen/Cholesky>
@@ -19,18 +21,20 @@ using namespace std;
 
 namespace LSE {
 
-FilterVUKF2::FilterVUKF2(Manager* pManager,const char* pFilename): FilterBase(){
+template<typename ScalarType>
+FilterVUKF2T<ScalarType>::FilterVUKF2T(Manager* pManager,const char* pFilename): FilterBase(){
 	pManager_ = pManager;
+	pSlippageStage_ = new SlippageStage(pFilename);
 
 	// Init all parameters
 	xInit_.t_ = 0;
 	xInit_.x_.r_.setZero();
 	xInit_.x_.v_.setZero();
-	xInit_.x_.q_ = Rotations::quatIdentity();
+	xInit_.x_.q_ = Rotations::quatIdentity<ScalarType>();
 	xInit_.x_.bf_.setZero();
 	xInit_.x_.bw_.setZero();
 	xInit_.w_.setZero();
-	xInit_.f_ = -pManager_->g_;
+	xInit_.f_ = (-pManager_->g_).template cast<ScalarType>();
 	for(int i=0;i<LSE_N_LEG;i++){
 		xInit_.CFC_[i] = 0;
 		xInit_.slippageDetection_.flag_[i] = 0;
@@ -40,15 +44,16 @@ FilterVUKF2::FilterVUKF2(Manager* pManager,const char* pFilename): FilterBase(){
 	}
 	xInit_.mbSigmaSampled_ = false;
 	xInit_.P_.setIdentity();
+	xInit_.S_.setIdentity();
 	xInit_.PN_.setZero();
 	xInit_.UN_.setZero();
 
 	// This is the square root of the final value!!!
-	Wr_ = 0.0001*Eigen::Matrix3d::Identity();
-	Wv_ = 0.003*Eigen::Matrix3d::Identity();
-	Wq_ = 0.00001*Eigen::Matrix3d::Identity();
-	Wbf_ = 0.0001*Eigen::Matrix3d::Identity();
-	Wbw_ = 0.000618*Eigen::Matrix3d::Identity();
+	Wr_ = 0.0001*Mat3::Identity();
+	Wv_ = 0.003*Mat3::Identity();
+	Wq_ = 0.00001*Mat3::Identity();
+	Wbf_ = 0.0001*Mat3::Identity();
+	Wbw_ = 0.000618*Mat3::Identity();
 	kinOutTh_ = 7.82;
 	restorationFactor_ = 1;
 
@@ -56,6 +61,15 @@ FilterVUKF2::FilterVUKF2(Manager* pManager,const char* pFilename): FilterBase(){
 	mbEstimateRotBias_ = true;
 	mbEstimateAccBias_ = true;
 	mbUseKin_ = true;
+	mbUseSquareRoot_ = false;
+	nSigmaThreads_ = 0;
+
+	// Sigma-point worker pool
+	mbPoolRunning_ = false;
+	jobId_ = 0;
+	pendingTasks_ = 0;
+	jobX_ = NULL;
+	jobDt_ = 0;
 
 	// Time stepping
 	mbFixedTimeStepping_ = false;
@@ -68,6 +82,10 @@ FilterVUKF2::FilterVUKF2(Manager* pManager,const char* pFilename): FilterBase(){
 
 	loadParam(pFilename);
 
+	// Initialize Cholesky factor of covariance matrix (square-root mode)
+	Eigen::LLT<MatrixP> lltOfPInit(xInit_.P_);
+	xInit_.S_ = lltOfPInit.matrixL();
+
 	// Compute derived UKF parameters (weights and lambda)
 	int L = VUKFF_state_dim+VUKFF_preNoise_dim+VUKFF_upNoise_dim;
 	UKFLambda_ = UKFAlpha_*UKFAlpha_*(L+UKFKappa_)-L;
@@ -77,12 +95,36 @@ FilterVUKF2::FilterVUKF2(Manager* pManager,const char* pFilename): FilterBase(){
 	UKFWi_ = 1/(2*(L+UKFLambda_));
 
 	resetEstimate(0);
+
+	// Start the sigma-point worker pool (parallel mode only)
+	if(nSigmaThreads_>0){
+		mbPoolRunning_ = true;
+		workers_.resize(nSigmaThreads_);
+		for(int i=0;i<nSigmaThreads_;i++){
+			// Hand the workers the current job count, they may start after
+			// the first job got dispatched
+			workers_[i] = std::thread(&FilterVUKF2T<ScalarType>::sigmaWorker,this,i,jobId_);
+		}
+	}
 }
 
-FilterVUKF2::~FilterVUKF2(){
+template<typename ScalarType>
+FilterVUKF2T<ScalarType>::~FilterVUKF2T(){
+	if(mbPoolRunning_){
+		{
+			std::unique_lock<std::mutex> lock(poolMutex_);
+			mbPoolRunning_ = false;
+			poolCond_.notify_all();
+		}
+		for(int i=0;i<(int)workers_.size();i++){
+			workers_[i].join();
+		}
+	}
+	delete pSlippageStage_;
 }
 
-void FilterVUKF2::update(const double& t){
+template<typename ScalarType>
+void FilterVUKF2T<ScalarType>::update(const double& t){
 	// Find safe time and filter safe state
 	double tsNew = t;
 	if(!pManager_->imuMeasList_.empty() && !pManager_->encMeasList_.empty()){
@@ -90,8 +132,11 @@ void FilterVUKF2::update(const double& t){
 		tsNew = std::min(tsNew,pManager_->encMeasList_.rbegin()->first+pManager_->tEnc_);
 		if(xs_.t_<tsNew){
 			filterState(xs_,tsNew);
+			storeSnapshot();
 			if(pManager_->isLogging_){
+				LSE_TIC(log)
 				logState();
+				LSE_TOC(perfStats_,LSE_PERF_STAGE_LOG,log)
 			}
 		}
 	}
@@ -101,7 +146,8 @@ void FilterVUKF2::update(const double& t){
 	filterState(xp_,t);
 }
 
-void FilterVUKF2::update(){
+template<typename ScalarType>
+void FilterVUKF2T<ScalarType>::update(){
 	double tmax = 0;
 	bool gotMeas = false;
 	if(!pManager_->imuMeasList_.empty()){
@@ -126,41 +172,91 @@ void FilterVUKF2::update(){
 	}
 }
 
-State FilterVUKF2::getEst(){
+template<typename ScalarType>
+State FilterVUKF2T<ScalarType>::getEst(){
+	// The interface State is double, convert the internal state once
+	const Eigen::Vector4d q = xp_.x_.q_.template cast<double>();
+	const Eigen::Vector3d r = xp_.x_.r_.template cast<double>();
+	const Eigen::Vector3d v = xp_.x_.v_.template cast<double>();
+	const Eigen::Vector3d w = (xp_.w_-xp_.x_.bw_).template cast<double>();
 	Eigen::Matrix3d R_WI,R_IB;
-	R_WI = Rotations::quatToRotMat(xp_.x_.q_);
+	R_WI = Rotations::quatToRotMat(q);
 	R_IB = Rotations::quatToRotMat(pManager_->q_IB_);
 	State x = State();
 	x.t_ = xp_.t_;
-	x.r_ = R_WI*(-xp_.x_.r_-R_IB*pManager_->B_r_BI_);
-	x.v_ = R_WI*(-xp_.x_.v_-Rotations::vecToSqew(xp_.w_-xp_.x_.bw_)*R_IB*pManager_->B_r_BI_);
-	x.q_ = Rotations::quatInverse(Rotations::quatL(xp_.x_.q_)*pManager_->q_IB_);
-	x.w_ = R_IB.transpose()*(xp_.w_-xp_.x_.bw_);
+	x.r_ = R_WI*(-r-R_IB*pManager_->B_r_BI_);
+	x.v_ = R_WI*(-v-Rotations::vecToSqew(w)*R_IB*pManager_->B_r_BI_);
+	x.q_ = Rotations::quatInverse(Rotations::quatL(q)*pManager_->q_IB_);
+	x.w_ = R_IB.transpose()*w;
 	x.P_.setZero();
-	x.P_.block(0,0,9,9) = xp_.P_.block(0,0,9,9);
-	x.P_.block(9,9,3,3) = xp_.P_.block(12,12,3,3)+pManager_->Rw_;
+	x.P_.block(0,0,9,9) = xp_.P_.block(0,0,9,9).template cast<double>();
+	x.P_.block(9,9,3,3) = xp_.P_.block(12,12,3,3).template cast<double>()+pManager_->Rw_;
 	return x;
 }
 
-SlippageDetection FilterVUKF2::getSlippage(){
-	return xp_.slippageDetection_;
+template<typename ScalarType>
+SlippageDetection FilterVUKF2T<ScalarType>::getSlippage(){
+	SlippageDetection s = xp_.slippageDetection_;
+	if(pSlippageStage_->isEnabled()) pSlippageStage_->fill(s);
+	return s;
 }
 
-void FilterVUKF2::resetEstimate(const double& t){
+template<typename ScalarType>
+void FilterVUKF2T<ScalarType>::resetEstimate(const double& t){
 	xs_ = xInit_;
 	xs_.t_ = t;
 	xp_ = xs_;
+	snapshotInd_ = 0;
+	snapshotCnt_ = 0;
+	pSlippageStage_->reset();
 }
 
-void FilterVUKF2::filterState(InternState& x,const double& tEnd){
-	std::map<double,ImuMeas>::iterator itImu;
-	std::map<double,EncMeas>::iterator itEnc;
+template<typename ScalarType>
+void FilterVUKF2T<ScalarType>::storeSnapshot(){
+	xSnapshot_[snapshotInd_] = xs_;
+	snapshotInd_ = (snapshotInd_+1)%LSE_SNAPSHOT_N;
+	if(snapshotCnt_<LSE_SNAPSHOT_N) snapshotCnt_++;
+}
+
+template<typename ScalarType>
+void FilterVUKF2T<ScalarType>::rollback(const double& t){
+	if(snapshotCnt_==0 || t>=xs_.t_) return;
+	// Search backwards for the newest snapshot strictly older than t (the
+	// re-filtering only applies measurements newer than the restored state)
+	int ind = snapshotInd_;
+	int steps = 0;
+	int found = -1;
+	while(steps<snapshotCnt_){
+		ind = (ind+LSE_SNAPSHOT_N-1)%LSE_SNAPSHOT_N;
+		steps++;
+		if(xSnapshot_[ind].t_<t){
+			found = ind;
+			break;
+		}
+	}
+	if(found<0){
+		// Older than the whole ring, best effort: restore the oldest snapshot
+		found = ind;
+	}
+	xs_ = xSnapshot_[found];
+	// Drop snapshots newer than the restored state, the next update recreates
+	// them while re-filtering over the buffered measurements
+	snapshotCnt_ -= steps-1;
+	snapshotInd_ = (found+1)%LSE_SNAPSHOT_N;
+}
+
+template<typename ScalarType>
+void FilterVUKF2T<ScalarType>::filterState(InternState& x,const double& tEnd){
+	MeasStorage<ImuMeas,LSE_MEAS_N>::iterator itImu;
+	MeasStorage<EncMeas,LSE_MEAS_N>::iterator itEnc;
 	ImuMeas imuMeas;
 	double tNext;
 
 	// Get current measurements
-	itImu = pManager_->imuMeasList_.upper_bound(x.t_-pManager_->tImu_);
-	itEnc = pManager_->encMeasList_.upper_bound(x.t_-pManager_->tEnc_);
+	curImu_.attach(&pManager_->imuMeasList_);
+	curEnc_.attach(&pManager_->encMeasList_);
+	itImu = curImu_.upper_bound(x.t_-pManager_->tImu_);
+	itEnc = curEnc_.upper_bound(x.t_-pManager_->tEnc_);
 
 	// Get current IMU measurement
 	if(itImu != pManager_->imuMeasList_.end()){
@@ -181,12 +277,16 @@ void FilterVUKF2::filterState(InternState& x,const double& tEnd){
 		if(itEnc != pManager_->encMeasList_.end()) tNext = std::min(tNext,itEnc->first+pManager_->tEnc_);
 
 		// Predict state
+		LSE_TIC(pre)
 		predictState(x,tNext,imuMeas);
+		LSE_TOC(perfStats_,LSE_PERF_STAGE_PRE,pre)
 
 		// Correct state if necessary
 		if(itEnc != pManager_->encMeasList_.end() && tNext >= itEnc->first+pManager_->tEnc_){
 			if(mbUseKin_){
+				LSE_TIC(enc)
 				encUpdateState(x,itEnc->second);
+				LSE_TOC(perfStats_,LSE_PERF_STAGE_ENC,enc)
 			}
 			itEnc++;
 		}
@@ -202,7 +302,8 @@ void FilterVUKF2::filterState(InternState& x,const double& tEnd){
 }
 
 
-void FilterVUKF2::predictState(InternState& x, const double& tPre, const ImuMeas& m){
+template<typename ScalarType>
+void FilterVUKF2T<ScalarType>::predictState(InternState& x, const double& tPre, const ImuMeas& m){
 	double dt = tPre-x.t_;
 	if(mbFixedTimeStepping_){
 		dt = timeStep_;
@@ -212,64 +313,161 @@ void FilterVUKF2::predictState(InternState& x, const double& tPre, const ImuMeas
 	}
 	if(!mbEstimateAccBias_) x.x_.bf_.setZero();
 	if(!mbEstimateRotBias_) x.x_.bw_.setZero();
-	x.w_ = m.w_;
-	x.f_ = m.f_;
+	x.w_ = m.w_.cast<ScalarType>();
+	x.f_ = m.f_.cast<ScalarType>();
 
 	// Prediction noise covariance matrix
 	samplePredictionNoise(x,dt);
 
 	// Sample Sigma Points
-	// Cholesky decomposition of covariance matrix
-	Eigen::LLT<MatrixP> lltOfP(x.P_);
-	if(lltOfP.info()==Eigen::NumericalIssue) std::cout << "Numerical issues while computing Cholesky of P" << std::endl;
-	SP_ = lltOfP.matrixL();
-	SP_ = SP_*UKFGamma_;
+	if(mbUseSquareRoot_){
+		// Cholesky factor is carried across updates, no refactorization needed
+		SP_ = x.S_*UKFGamma_;
+	} else {
+		// Cholesky decomposition of covariance matrix
+		Eigen::LLT<MatrixP> lltOfP(x.P_);
+		if(lltOfP.info()==Eigen::NumericalIssue) std::cout << "Numerical issues while computing Cholesky of P" << std::endl;
+		SP_ = lltOfP.matrixL();
+		SP_ = SP_*UKFGamma_;
+	}
 	x.X_[0] = x.x_;
+	// Vector part of the sigma points
 	for(int i=1;i<=VUKFF_state_dim;i++){
-		x.X_[i] = x.x_+SP_.col(i-1);
-		x.X_[i+VUKFF_state_dim] = x.x_+(-1*SP_.col(i-1));
+		x.X_[i].r_ = x.x_.r_+SP_.template block<3,1>(0,i-1);
+		x.X_[i].v_ = x.x_.v_+SP_.template block<3,1>(3,i-1);
+		x.X_[i].bf_ = x.x_.bf_+SP_.template block<3,1>(9,i-1);
+		x.X_[i].bw_ = x.x_.bw_+SP_.template block<3,1>(12,i-1);
+		x.X_[i+VUKFF_state_dim].r_ = x.x_.r_-SP_.template block<3,1>(0,i-1);
+		x.X_[i+VUKFF_state_dim].v_ = x.x_.v_-SP_.template block<3,1>(3,i-1);
+		x.X_[i+VUKFF_state_dim].bf_ = x.x_.bf_-SP_.template block<3,1>(9,i-1);
+		x.X_[i+VUKFF_state_dim].bw_ = x.x_.bw_-SP_.template block<3,1>(12,i-1);
 	}
-
-	// Propagate Sigma Points
-	// State Part
-	for(int i=0;i<=2*VUKFF_state_dim;i++){
-		predict(x.X_[i],dt,m);
+	// Attitude part, batched retraction (trigonometry and normalization
+	// vectorize across the sigma points)
+	for(int i=1;i<=VUKFF_state_dim;i++){
+		ws_.dv_.set(i-1,SP_.template block<3,1>(6,i-1));
+		ws_.dv_.set(VUKFF_state_dim+i-1,-SP_.template block<3,1>(6,i-1));
+	}
+	Rotations::rotVecToQuatBatch(ws_.dv_,ws_.dq_);
+	Rotations::quatMultBatch(ws_.dq_,x.x_.q_,ws_.dq_);
+	for(int i=1;i<=2*VUKFF_state_dim;i++){
+		x.X_[i].q_ = ws_.dq_.get(i-1);
 	}
-	Eigen::Matrix<double,VUKFF_preNoise_dim,1> n;
-	// Prediction noise Part
-	for(int i=1;i<=2*VUKFF_preNoise_dim;i++){
-		n = x.PN_.col(i-1);
-		// Handle case where Bias estimation disabled
-		if(!mbEstimateAccBias_) n.block<3,1>(9,0).setZero();
-		if(!mbEstimateRotBias_) n.block<3,1>(12,0).setZero();
 
-		x.X_[2*VUKFF_state_dim+i] = x.x_;
-		predict(x.X_[2*VUKFF_state_dim+i],dt,m,n);
+	// Propagate Sigma Points (state part followed by the prediction noise
+	// part, every point is independent and can be sharded across workers)
+	if(mbPoolRunning_){
+		runSigmaJob(x,dt,m);
+	} else {
+		for(int i=0;i<=2*(VUKFF_state_dim+VUKFF_preNoise_dim);i++){
+			propagateSigmaPoint(x,i,dt,m);
+		}
 	}
 
 	// Compute predicted state and covariance
-	Eigen::Matrix<double,VUKFF_state_dim,1> vec;
-	vec.setZero();
+	ws_.vec_.setZero();
 	for(int i=1;i<=2*(VUKFF_state_dim+VUKFF_preNoise_dim);i++){
-		vec = vec + (UKFWi_*(x.X_[i]-x.X_[0]));
-	}
-	x.x_ = x.X_[0]+vec;
-	vec = x.X_[0]-x.x_;
-	x.P_ = (UKFWc_+2*VUKFF_upNoise_dim*UKFWi_)*vec*vec.transpose();
-	for(int i=1;i<=2*(VUKFF_state_dim+VUKFF_preNoise_dim);i++){
-		vec = x.X_[i]-x.x_;
-		x.P_ += UKFWi_*vec*vec.transpose();
+		ws_.vec_ = ws_.vec_ + (UKFWi_*(x.X_[i]-x.X_[0]));
 	}
+	x.x_ = x.X_[0]+ws_.vec_;
+	if(mbUseSquareRoot_){
+		// QR-based recombination of the Cholesky factor, followed by a rank-1
+		// update with the central sigma point
+		for(int i=1;i<=2*(VUKFF_state_dim+VUKFF_preNoise_dim);i++){
+			ws_.A_.row(i-1) = sqrt(UKFWi_)*(x.X_[i]-x.x_).transpose();
+		}
+		Eigen::HouseholderQR<Eigen::Matrix<ScalarType,2*(VUKFF_state_dim+VUKFF_preNoise_dim),VUKFF_state_dim> > qrOfA(ws_.A_);
+		MatrixP R = qrOfA.matrixQR().template block<VUKFF_state_dim,VUKFF_state_dim>(0,0).template triangularView<Eigen::Upper>();
+		x.S_ = R.transpose();
+		// Enforce positive diagonal of the factor
+		for(int i=0;i<VUKFF_state_dim;i++){
+			if(x.S_(i,i)<0) x.S_.col(i) = -x.S_.col(i);
+		}
+		ws_.vec_ = x.X_[0]-x.x_;
+		cholUpdate(x.S_,ws_.vec_,UKFWc_+2*VUKFF_upNoise_dim*UKFWi_);
+
+		// Avoid singular S
+		if(!mbEstimateAccBias_){
+			x.S_.template block<3,VUKFF_state_dim>(9,0).setZero();
+			for(int i=9;i<12;i++) x.S_(i,i) = sqrt(xInit_.P_(i,i));
+		}
+		if(!mbEstimateRotBias_){
+			x.S_.template block<3,VUKFF_state_dim>(12,0).setZero();
+			for(int i=12;i<15;i++) x.S_(i,i) = sqrt(xInit_.P_(i,i));
+		}
+		x.P_ = x.S_*x.S_.transpose();
+	} else {
+		ws_.vec_ = x.X_[0]-x.x_;
+		x.P_ = (UKFWc_+2*VUKFF_upNoise_dim*UKFWi_)*ws_.vec_*ws_.vec_.transpose();
+		for(int i=1;i<=2*(VUKFF_state_dim+VUKFF_preNoise_dim);i++){
+			ws_.vec_ = x.X_[i]-x.x_;
+			x.P_ += UKFWi_*ws_.vec_*ws_.vec_.transpose();
+		}
 
-	// Avoid singular P
-	if(!mbEstimateAccBias_) x.P_.block<3,3>(9,9) = xInit_.P_.block<3,3>(9,9);
-	if(!mbEstimateRotBias_) x.P_.block<3,3>(12,12) = xInit_.P_.block<3,3>(12,12);
+		// Avoid singular P
+		if(!mbEstimateAccBias_) x.P_.template block<3,3>(9,9) = xInit_.P_.template block<3,3>(9,9);
+		if(!mbEstimateRotBias_) x.P_.template block<3,3>(12,12) = xInit_.P_.template block<3,3>(12,12);
+	}
 
 	x.t_ = tPre;
 	x.mbSigmaSampled_ = true;
 }
 
-void FilterVUKF2::encUpdateState(InternState& x, const EncMeas& m){
+template<typename ScalarType>
+void FilterVUKF2T<ScalarType>::propagateSigmaPoint(InternState& x,const int& i,const double& dt,const ImuMeas& m){
+	if(i<=2*VUKFF_state_dim){
+		predict(x.X_[i],dt,m);
+	} else {
+		Eigen::Matrix<ScalarType,VUKFF_preNoise_dim,1> n = x.PN_.col(i-2*VUKFF_state_dim-1);
+		// Handle case where Bias estimation disabled
+		if(!mbEstimateAccBias_) n.template block<3,1>(9,0).setZero();
+		if(!mbEstimateRotBias_) n.template block<3,1>(12,0).setZero();
+
+		x.X_[i] = x.x_;
+		predict(x.X_[i],dt,m,n);
+	}
+}
+
+template<typename ScalarType>
+void FilterVUKF2T<ScalarType>::runSigmaJob(InternState& x,const double& dt,const ImuMeas& m){
+	std::unique_lock<std::mutex> lock(poolMutex_);
+	jobX_ = &x;
+	jobDt_ = dt;
+	jobMeas_ = m;
+	pendingTasks_ = nSigmaThreads_;
+	jobId_++;
+	poolCond_.notify_all();
+	while(pendingTasks_>0){
+		poolDone_.wait(lock);
+	}
+}
+
+template<typename ScalarType>
+void FilterVUKF2T<ScalarType>::sigmaWorker(const int& i,const unsigned long& startJob){
+	unsigned long lastJob = startJob;
+	std::unique_lock<std::mutex> lock(poolMutex_);
+	while(true){
+		while(mbPoolRunning_ && jobId_ == lastJob){
+			poolCond_.wait(lock);
+		}
+		if(!mbPoolRunning_) return;
+		lastJob = jobId_;
+		InternState* pX = jobX_;
+		const double dt = jobDt_;
+		const ImuMeas m = jobMeas_;
+		lock.unlock();
+		// Strided shard, no two workers touch the same sigma point
+		for(int j=i;j<=2*(VUKFF_state_dim+VUKFF_preNoise_dim);j+=nSigmaThreads_){
+			propagateSigmaPoint(*pX,j,dt,m);
+		}
+		lock.lock();
+		pendingTasks_--;
+		if(pendingTasks_==0) poolDone_.notify_all();
+	}
+}
+
+template<typename ScalarType>
+void FilterVUKF2T<ScalarType>::encUpdateState(InternState& x, const EncMeas& m){
 	if(x.mbSigmaSampled_){
 		// Update Contact count
 		for(int i=0;i<LSE_N_LEG;i++){
@@ -289,89 +487,110 @@ void FilterVUKF2::encUpdateState(InternState& x, const EncMeas& m){
 			}
 		}
 
-		// Compute forward kinematics and Jacobians
-		Eigen::Matrix<double,3*LSE_N_LEG,1> s;
-		Eigen::Matrix<double,3*LSE_N_LEG,LSE_DOF_LEG> J;
+		// Compute forward kinematics and Jacobians (all legs in one call),
+		// conversion to the filter scalar happens once per update
+		Eigen::Matrix<double,3,LSE_N_LEG> sKin;
+		Eigen::Matrix<double,3*LSE_N_LEG,LSE_DOF_LEG> JKin;
+		pManager_->legKinAll(sKin,m.e_);
+		pManager_->legKinJacAll(JKin,m.e_);
+		const Eigen::Matrix<ScalarType,LSE_DOF_LEG,LSE_N_LEG> ev = m.v_.cast<ScalarType>();
 		for(int i=0;i<LSE_N_LEG;i++){
 			// I_r_IF = C(q_IB)*(-B_r_BI + B_r_BK + C'(q_KB)*K_r_KF
-			s.block(3*i,0,3,1) = Rotations::quatToRotMat(pManager_->q_IB_)*(-pManager_->B_r_BI_+pManager_->B_r_BK_+Rotations::quatToRotMat(pManager_->q_KB_).transpose()*(*pManager_->legKin)(m.e_.col(i),i));
-			J.block(3*i,0,3,LSE_DOF_LEG) = Rotations::quatToRotMat(pManager_->q_IB_)*Rotations::quatToRotMat(pManager_->q_KB_).transpose()*(*pManager_->legKinJac)(m.e_.col(i),i);
+			ws_.s_.block(3*i,0,3,1) = (Rotations::quatToRotMat(pManager_->q_IB_)*(-pManager_->B_r_BI_+pManager_->B_r_BK_+Rotations::quatToRotMat(pManager_->q_KB_).transpose()*sKin.col(i))).cast<ScalarType>();
+			ws_.J_.block(3*i,0,3,LSE_DOF_LEG) = (Rotations::quatToRotMat(pManager_->q_IB_)*Rotations::quatToRotMat(pManager_->q_KB_).transpose()*JKin.block(3*i,0,3,LSE_DOF_LEG)).cast<ScalarType>();
 		}
 
 		// Update noise covariance matrix
 		sampleUpdateNoise(x);
 
 		// Project through measurement function
-		VUKFFilterState filterState;
-		Eigen::Matrix<double,VUKFF_upNoise_dim,1> upNoi;
-		Eigen::Vector3d wNoise;
-		Eigen::Matrix<double,VUKFF_upNoise_dim,1+2*(VUKFF_state_dim+VUKFF_preNoise_dim+VUKFF_upNoise_dim)> Y;
 		for(int i=0;i<=2*(VUKFF_state_dim+VUKFF_preNoise_dim+VUKFF_upNoise_dim);i++){
 			if(i<=2*(VUKFF_state_dim)){
-				filterState = x.X_[i];
-				wNoise.setZero();
-				upNoi.setZero();
+				ws_.filterState_ = x.X_[i];
+				ws_.wNoise_.setZero();
+				ws_.upNoi_.setZero();
 			} else if (i<=2*(VUKFF_state_dim+VUKFF_preNoise_dim)) {
-				filterState = x.X_[0];
-				wNoise = x.PN_.block<3,1>(18,(i-2*(VUKFF_state_dim)-1));
-				upNoi.setZero();
+				ws_.filterState_ = x.X_[0];
+				ws_.wNoise_ = x.PN_.template block<3,1>(18,(i-2*(VUKFF_state_dim)-1));
+				ws_.upNoi_.setZero();
 			}  else {
-				filterState = x.X_[0];
-				wNoise.setZero();
-				upNoi = x.UN_.col((i-2*(VUKFF_state_dim+VUKFF_preNoise_dim)-1));
+				ws_.filterState_ = x.X_[0];
+				ws_.wNoise_.setZero();
+				ws_.upNoi_ = x.UN_.col((i-2*(VUKFF_state_dim+VUKFF_preNoise_dim)-1));
 			}
 			for(int j=0;j<LSE_N_LEG;j++){
-				Y.block(j*3,i,3,1) = -filterState.v_ + Rotations::vecToSqew(x.w_-filterState.bw_-wNoise)*s.block(3*j,0,3,1) + J.block(3*j,0,3,LSE_DOF_LEG)*m.v_.col(j)-upNoi.block<3,1>(j*3,0);
+				ws_.Y_.block(j*3,i,3,1) = -ws_.filterState_.v_ + Rotations::vecToSqew(x.w_-ws_.filterState_.bw_-ws_.wNoise_)*ws_.s_.block(3*j,0,3,1) + ws_.J_.block(3*j,0,3,LSE_DOF_LEG)*ev.col(j)-ws_.upNoi_.template block<3,1>(j*3,0);
 			}
 		}
 
 		// Compute innovation and corresponding covariance
-		x.y_ = UKFWs_*Y.col(0);
+		x.y_ = UKFWs_*ws_.Y_.col(0);
 		for(int i=1;i<=2*(VUKFF_state_dim+VUKFF_preNoise_dim+VUKFF_upNoise_dim);i++){
-			x.y_ += UKFWi_*Y.col(i);
+			x.y_ += UKFWi_*ws_.Y_.col(i);
 		}
-		Eigen::Matrix<double,VUKFF_upNoise_dim,VUKFF_upNoise_dim> Py;
-		Py = UKFWc_*(Y.col(0)-x.y_)*(Y.col(0)-x.y_).transpose();
+		ws_.Py_ = UKFWc_*(ws_.Y_.col(0)-x.y_)*(ws_.Y_.col(0)-x.y_).transpose();
 		for(int i=1;i<=2*(VUKFF_state_dim+VUKFF_preNoise_dim+VUKFF_upNoise_dim);i++){
-			Py += UKFWi_*(Y.col(i)-x.y_)*(Y.col(i)-x.y_).transpose();
+			ws_.Py_ += UKFWi_*(ws_.Y_.col(i)-x.y_)*(ws_.Y_.col(i)-x.y_).transpose();
 		}
 
 		// Compute cross-correlation
-		Eigen::Matrix<double,VUKFF_state_dim,1> vec;
-		vec = x.X_[0]-x.x_;
-		Eigen::Matrix<double,VUKFF_state_dim,VUKFF_upNoise_dim> Pxy;
-		Pxy = UKFWc_*vec*(Y.col(0)-x.y_).transpose();
+		ws_.vec_ = x.X_[0]-x.x_;
+		ws_.Pxy_ = UKFWc_*ws_.vec_*(ws_.Y_.col(0)-x.y_).transpose();
 		for(int i=1;i<=2*(VUKFF_state_dim+VUKFF_preNoise_dim+VUKFF_upNoise_dim);i++){
 			if(i<=2*(VUKFF_state_dim+VUKFF_preNoise_dim)){
-				filterState = x.X_[i];
+				ws_.filterState_ = x.X_[i];
 			} else {
-				filterState = x.X_[0];
+				ws_.filterState_ = x.X_[0];
 			}
-			vec = filterState-x.x_;
-			Pxy += UKFWi_*vec*(Y.col(i)-x.y_).transpose();
+			ws_.vec_ = ws_.filterState_-x.x_;
+			ws_.Pxy_ += UKFWi_*ws_.vec_*(ws_.Y_.col(i)-x.y_).transpose();
 		}
 
 		// Compute inverse of innovation covariance
-		Eigen::Matrix<double,VUKFF_upNoise_dim,VUKFF_upNoise_dim> Pyinv = Py.inverse();
-		outlierDetection(x,Pyinv);
+		if(mbUseSquareRoot_){
+			Eigen::LLT<MatrixUpCov> lltOfPy(ws_.Py_);
+			if(lltOfPy.info()==Eigen::NumericalIssue) std::cout << "Numerical issues while computing Cholesky of Py" << std::endl;
+			ws_.Sy_ = lltOfPy.matrixL();
+			ws_.Pyinv_ = lltOfPy.solve(MatrixUpCov::Identity());
+		} else {
+			ws_.Pyinv_ = ws_.Py_.inverse();
+		}
+		LSE_TIC(slip)
+		outlierDetection(x,ws_.Pyinv_);
+		// The slippage stage only accumulates statistics here, derived
+		// quantities get refreshed at its own rate (skip the predicted state,
+		// its updates would be accumulated again from the safe state)
+		if(pSlippageStage_->isEnabled() && &x==&xs_) pSlippageStage_->accumulate(x.t_,x.CFC_,x.slippageDetection_);
+		LSE_TOC(perfStats_,LSE_PERF_STAGE_SLIP,slip)
 		for(int i=0;i<LSE_N_LEG;i++){
 			if(x.slippageDetection_.flag_[i]==0){
-				Pyinv.block<3,VUKFF_upNoise_dim>(3*i,0).setZero();
-				Pyinv.block<VUKFF_upNoise_dim,3>(0,3*i).setZero();
+				ws_.Pyinv_.template block<3,VUKFF_upNoise_dim>(3*i,0).setZero();
+				ws_.Pyinv_.template block<VUKFF_upNoise_dim,3>(0,3*i).setZero();
 			}
 		}
 
 		// Compute Kalman Gain
-		Eigen::Matrix<double,VUKFF_state_dim,VUKFF_upNoise_dim> K = Pxy*Pyinv;
+		ws_.K_ = ws_.Pxy_*ws_.Pyinv_;
 
 		// Update state and covariance matrix
-		vec = -K*x.y_;
-		x.x_ = x.x_+vec;
-		x.P_ = x.P_ - K*Py*K.transpose();
+		ws_.vec_ = -ws_.K_*x.y_;
+		x.x_ = x.x_+ws_.vec_;
+		if(mbUseSquareRoot_){
+			// Downdate the Cholesky factor column-wise, equivalent to
+			// P - (K*Sy)*(K*Sy)' = P - K*Py*K'
+			ws_.U_ = ws_.K_*ws_.Sy_;
+			for(int i=0;i<VUKFF_upNoise_dim;i++){
+				cholUpdate(x.S_,ws_.U_.col(i),-1.0);
+			}
+			x.P_ = x.S_*x.S_.transpose();
+		} else {
+			x.P_ = x.P_ - ws_.K_*ws_.Py_*ws_.K_.transpose();
+		}
 	}
 }
 
-void FilterVUKF2::outlierDetection(InternState& x,const Eigen::Matrix<double,12,12>& Pyinv){
+template<typename ScalarType>
+void FilterVUKF2T<ScalarType>::outlierDetection(InternState& x,const Eigen::Matrix<ScalarType,3*LSE_N_LEG,3*LSE_N_LEG>& Pyinv){
 	bool outliers[LSE_N_LEG];
 	double ratio[LSE_N_LEG];
 
@@ -422,18 +641,42 @@ void FilterVUKF2::outlierDetection(InternState& x,const Eigen::Matrix<double,12,
 	for(int i=0;i<LSE_N_LEG;i++){
 		if(outliers[i]){
 			x.slippageDetection_.flag_[i]=0;
-			x.slippageDetection_.slip_.col(i)=x.y_.block<3,1>(3*i,0);
+			x.slippageDetection_.slip_.col(i)=x.y_.template block<3,1>(3*i,0).template cast<double>();
 		}
 	}
 }
 
-void FilterVUKF2::loadParam(const char* pFilename){
+template<typename ScalarType>
+void FilterVUKF2T<ScalarType>::cholUpdate(MatrixP& S,const Eigen::Matrix<ScalarType,VUKFF_state_dim,1>& v,const double& beta){
+	// Rank-1 update of the lower triangular Cholesky factor: S*S' + beta*v*v'
+	Eigen::Matrix<ScalarType,VUKFF_state_dim,1> w = sqrt(fabs(beta))*v;
+	double sign = 1;
+	if(beta<0) sign = -1;
+	for(int k=0;k<VUKFF_state_dim;k++){
+		double r2 = S(k,k)*S(k,k)+sign*w(k)*w(k);
+		if(r2<=0){
+			std::cout << "Numerical issues during rank-1 Cholesky downdate of P" << std::endl;
+			r2 = 1e-12;
+		}
+		double r = sqrt(r2);
+		double c = r/S(k,k);
+		double s = w(k)/S(k,k);
+		S(k,k) = r;
+		for(int i=k+1;i<VUKFF_state_dim;i++){
+			S(i,k) = (S(i,k)+sign*s*w(i))/c;
+			w(i) = c*w(i)-s*S(i,k);
+		}
+	}
+}
+
+template<typename ScalarType>
+void FilterVUKF2T<ScalarType>::loadParam(const char* pFilename){
 	// Open parameter file
-	TiXmlDocument doc(pFilename);
-	if (!doc.LoadFile()) return;
+	TiXmlDocument* doc = ParamCache::get(pFilename);
+	if (doc==NULL) return;
 
 	// Define handles and elements
-	TiXmlHandle hDoc(&doc);
+	TiXmlHandle hDoc(doc);
 	TiXmlElement* pElem;
 	TiXmlHandle hRoot(0);
 
@@ -447,98 +690,98 @@ void FilterVUKF2::loadParam(const char* pFilename){
 		// MeasurementsSettings
 		pElem=hRoot.FirstChild("VUKFSettings").FirstChild("Position").FirstChild("Init").Element();
 		if (pElem){
-			pElem->QueryDoubleAttribute("x", &xInit_.x_.r_(0));
-			pElem->QueryDoubleAttribute("y", &xInit_.x_.r_(1));
-			pElem->QueryDoubleAttribute("z", &xInit_.x_.r_(2));
+			queryScalar(pElem,"x",xInit_.x_.r_(0));
+			queryScalar(pElem,"y",xInit_.x_.r_(1));
+			queryScalar(pElem,"z",xInit_.x_.r_(2));
 		}
 		pElem=hRoot.FirstChild("VUKFSettings").FirstChild("Position").FirstChild("InitStd").Element();
 		if (pElem){
-			pElem->QueryDoubleAttribute("x", &xInit_.P_(0,0));
-			pElem->QueryDoubleAttribute("y", &xInit_.P_(1,1));
-			pElem->QueryDoubleAttribute("z", &xInit_.P_(2,2));
+			queryScalar(pElem,"x",xInit_.P_(0,0));
+			queryScalar(pElem,"y",xInit_.P_(1,1));
+			queryScalar(pElem,"z",xInit_.P_(2,2));
 		}
 
 		pElem=hRoot.FirstChild("VUKFSettings").FirstChild("Velocity").FirstChild("Init").Element();
 		if (pElem){
-			pElem->QueryDoubleAttribute("x", &xInit_.x_.v_(0));
-			pElem->QueryDoubleAttribute("y", &xInit_.x_.v_(1));
-			pElem->QueryDoubleAttribute("z", &xInit_.x_.v_(2));
+			queryScalar(pElem,"x",xInit_.x_.v_(0));
+			queryScalar(pElem,"y",xInit_.x_.v_(1));
+			queryScalar(pElem,"z",xInit_.x_.v_(2));
 		}
 		pElem=hRoot.FirstChild("VUKFSettings").FirstChild("Velocity").FirstChild("InitStd").Element();
 		if (pElem){
-			pElem->QueryDoubleAttribute("x", &xInit_.P_(3,3));
-			pElem->QueryDoubleAttribute("y", &xInit_.P_(4,4));
-			pElem->QueryDoubleAttribute("z", &xInit_.P_(5,5));
+			queryScalar(pElem,"x",xInit_.P_(3,3));
+			queryScalar(pElem,"y",xInit_.P_(4,4));
+			queryScalar(pElem,"z",xInit_.P_(5,5));
 		}
 
 		pElem=hRoot.FirstChild("VUKFSettings").FirstChild("Attitude").FirstChild("Init").Element();
 		if (pElem){
-			pElem->QueryDoubleAttribute("x", &xInit_.x_.q_(0));
-			pElem->QueryDoubleAttribute("y", &xInit_.x_.q_(1));
-			pElem->QueryDoubleAttribute("z", &xInit_.x_.q_(2));
-			pElem->QueryDoubleAttribute("w", &xInit_.x_.q_(3));
+			queryScalar(pElem,"x",xInit_.x_.q_(0));
+			queryScalar(pElem,"y",xInit_.x_.q_(1));
+			queryScalar(pElem,"z",xInit_.x_.q_(2));
+			queryScalar(pElem,"w",xInit_.x_.q_(3));
 		}
 		pElem=hRoot.FirstChild("VUKFSettings").FirstChild("Attitude").FirstChild("InitStd").Element();
 		if (pElem){
-			pElem->QueryDoubleAttribute("x", &xInit_.P_(6,6));
-			pElem->QueryDoubleAttribute("y", &xInit_.P_(7,7));
-			pElem->QueryDoubleAttribute("z", &xInit_.P_(8,8));
+			queryScalar(pElem,"x",xInit_.P_(6,6));
+			queryScalar(pElem,"y",xInit_.P_(7,7));
+			queryScalar(pElem,"z",xInit_.P_(8,8));
 		}
 
 		pElem=hRoot.FirstChild("VUKFSettings").FirstChild("AccelerometerBias").FirstChild("Init").Element();
 		if (pElem){
-			pElem->QueryDoubleAttribute("x", &xInit_.x_.bf_(0));
-			pElem->QueryDoubleAttribute("y", &xInit_.x_.bf_(1));
-			pElem->QueryDoubleAttribute("z", &xInit_.x_.bf_(2));
+			queryScalar(pElem,"x",xInit_.x_.bf_(0));
+			queryScalar(pElem,"y",xInit_.x_.bf_(1));
+			queryScalar(pElem,"z",xInit_.x_.bf_(2));
 		}
 		pElem=hRoot.FirstChild("VUKFSettings").FirstChild("AccelerometerBias").FirstChild("InitStd").Element();
 		if (pElem){
-			pElem->QueryDoubleAttribute("x", &xInit_.P_(9,9));
-			pElem->QueryDoubleAttribute("y", &xInit_.P_(10,10));
-			pElem->QueryDoubleAttribute("z", &xInit_.P_(11,11));
+			queryScalar(pElem,"x",xInit_.P_(9,9));
+			queryScalar(pElem,"y",xInit_.P_(10,10));
+			queryScalar(pElem,"z",xInit_.P_(11,11));
 		}
 
 		pElem=hRoot.FirstChild("VUKFSettings").FirstChild("GyroscopeBias").FirstChild("Init").Element();
 		if (pElem){
-			pElem->QueryDoubleAttribute("x", &xInit_.x_.bw_(0));
-			pElem->QueryDoubleAttribute("y", &xInit_.x_.bw_(1));
-			pElem->QueryDoubleAttribute("z", &xInit_.x_.bw_(2));
+			queryScalar(pElem,"x",xInit_.x_.bw_(0));
+			queryScalar(pElem,"y",xInit_.x_.bw_(1));
+			queryScalar(pElem,"z",xInit_.x_.bw_(2));
 		}
 		pElem=hRoot.FirstChild("VUKFSettings").FirstChild("GyroscopeBias").FirstChild("InitStd").Element();
 		if (pElem){
-			pElem->QueryDoubleAttribute("x", &xInit_.P_(12,12));
-			pElem->QueryDoubleAttribute("y", &xInit_.P_(13,13));
-			pElem->QueryDoubleAttribute("z", &xInit_.P_(14,14));
+			queryScalar(pElem,"x",xInit_.P_(12,12));
+			queryScalar(pElem,"y",xInit_.P_(13,13));
+			queryScalar(pElem,"z",xInit_.P_(14,14));
 		}
 		pElem=hRoot.FirstChild("VUKFSettings").FirstChild("Position").FirstChild("PreNoiStd").Element();
 		if (pElem){
-			pElem->QueryDoubleAttribute("x", &Wr_(0,0));
-			pElem->QueryDoubleAttribute("y", &Wr_(1,1));
-			pElem->QueryDoubleAttribute("z", &Wr_(2,2));
+			queryScalar(pElem,"x",Wr_(0,0));
+			queryScalar(pElem,"y",Wr_(1,1));
+			queryScalar(pElem,"z",Wr_(2,2));
 		}
 		pElem=hRoot.FirstChild("VUKFSettings").FirstChild("Velocity").FirstChild("PreNoiStd").Element();
 		if (pElem){
-			pElem->QueryDoubleAttribute("x", &Wv_(0,0));
-			pElem->QueryDoubleAttribute("y", &Wv_(1,1));
-			pElem->QueryDoubleAttribute("z", &Wv_(2,2));
+			queryScalar(pElem,"x",Wv_(0,0));
+			queryScalar(pElem,"y",Wv_(1,1));
+			queryScalar(pElem,"z",Wv_(2,2));
 		}
 		pElem=hRoot.FirstChild("VUKFSettings").FirstChild("Attitude").FirstChild("PreNoiStd").Element();
 		if (pElem){
-			pElem->QueryDoubleAttribute("x", &Wq_(0,0));
-			pElem->QueryDoubleAttribute("y", &Wq_(1,1));
-			pElem->QueryDoubleAttribute("z", &Wq_(2,2));
+			queryScalar(pElem,"x",Wq_(0,0));
+			queryScalar(pElem,"y",Wq_(1,1));
+			queryScalar(pElem,"z",Wq_(2,2));
 		}
 		pElem=hRoot.FirstChild("VUKFSettings").FirstChild("AccelerometerBias").FirstChild("PreNoiStd").Element();
 		if (pElem){
-			pElem->QueryDoubleAttribute("x", &Wbf_(0,0));
-			pElem->QueryDoubleAttribute("y", &Wbf_(1,1));
-			pElem->QueryDoubleAttribute("z", &Wbf_(2,2));
+			queryScalar(pElem,"x",Wbf_(0,0));
+			queryScalar(pElem,"y",Wbf_(1,1));
+			queryScalar(pElem,"z",Wbf_(2,2));
 		}
 		pElem=hRoot.FirstChild("VUKFSettings").FirstChild("GyroscopeBias").FirstChild("PreNoiStd").Element();
 		if (pElem){
-			pElem->QueryDoubleAttribute("x", &Wbw_(0,0));
-			pElem->QueryDoubleAttribute("y", &Wbw_(1,1));
-			pElem->QueryDoubleAttribute("z", &Wbw_(2,2));
+			queryScalar(pElem,"x",Wbw_(0,0));
+			queryScalar(pElem,"y",Wbw_(1,1));
+			queryScalar(pElem,"z",Wbw_(2,2));
 		}
 		pElem=hRoot.FirstChild("VUKFSettings").Element();
 		if (pElem){
@@ -548,6 +791,10 @@ void FilterVUKF2::loadParam(const char* pFilename){
 			pElem->QueryDoubleAttribute("timeStepping", &timeStep_);
 			pElem->QueryIntAttribute("useKin", &mInt);
 			mbUseKin_ = mInt;
+			if(pElem->QueryIntAttribute("useSquareRoot", &mInt)==TIXML_SUCCESS){
+				mbUseSquareRoot_ = mInt;
+			}
+			pElem->QueryIntAttribute("threads", &nSigmaThreads_);
 		}
 		pElem=hRoot.FirstChild("VUKFSettings").FirstChild("AccelerometerBias").Element();
 		if (pElem){
@@ -582,16 +829,29 @@ void FilterVUKF2::loadParam(const char* pFilename){
 	if(restorationFactor_<1){
 		restorationFactor_ = 1;
 	}
+
+	if(nSigmaThreads_<0){
+		nSigmaThreads_ = 0;
+	}
 }
 
-void FilterVUKF2::logState(){
+template<typename ScalarType>
+void FilterVUKF2T<ScalarType>::queryScalar(TiXmlElement* pElem,const char* pName,ScalarType& value){
+	double val;
+	if(pElem->QueryDoubleAttribute(pName,&val)==TIXML_SUCCESS){
+		value = (ScalarType)val;
+	}
+}
+
+template<typename ScalarType>
+void FilterVUKF2T<ScalarType>::logState(){
 	  pManager_->ofsLog_ << xs_.t_ << "\t";
 	  pManager_->ofsLog_ << xs_.x_.r_(0) << "\t" << xs_.x_.r_(1) << "\t" << xs_.x_.r_(2) << "\t";
 	  pManager_->ofsLog_ << xs_.x_.v_(0) << "\t" << xs_.x_.v_(1) << "\t" << xs_.x_.v_(2) << "\t";
 	  pManager_->ofsLog_ << xs_.x_.q_(0) << "\t" << xs_.x_.q_(1) << "\t" << xs_.x_.q_(2) << "\t" << xs_.x_.q_(3) << "\t";
 	  pManager_->ofsLog_ << xs_.x_.bf_(0) << "\t" << xs_.x_.bf_(1) << "\t" << xs_.x_.bf_(2) << "\t";
 	  pManager_->ofsLog_ << xs_.x_.bw_(0) << "\t" << xs_.x_.bw_(1) << "\t" << xs_.x_.bw_(2) << "\t";
-	  pManager_->ofsLog_ << xs_.slippageDetection_.flag_[0] << "\t" << xs_.slippageDetection_.flag_[1] << "\t" << xs_.slippageDetection_.flag_[2] << "\t" << xs_.slippageDetection_.flag_[3] << "\t";
+	  for(int i=0;i<LSE_N_LEG;i++) pManager_->ofsLog_ << xs_.slippageDetection_.flag_[i] << "\t";
 	  for(int i=0;i<LSE_VUKF_N;i++){
 		  pManager_->ofsLog_ << xs_.P_(i,i) << "\t";
 	  }
@@ -601,95 +861,131 @@ void FilterVUKF2::logState(){
 	  pManager_->ofsLog_ << endl;
 }
 
-std::string FilterVUKF2::getKeyString(){
+template<typename ScalarType>
+std::string FilterVUKF2T<ScalarType>::getKeyString(){
 	std::ostringstream oss (std::ostringstream::out);
 	oss << pManager_->Rda_(0,0) << "_" << kinOutTh_ << "_" << restorationFactor_;
 	return oss.str();
 }
 
-VUKFFilterState VUKFFilterState::operator +(const Eigen::Matrix<double,VUKFF_state_dim,1> &y) const{
-	VUKFFilterState x;
-	x.r_ = r_+y.block<3,1>(0,0);
-	x.v_ = v_+y.block<3,1>(3,0);
-	x.q_ = Rotations::quatL(Rotations::rotVecToQuat(y.block<3,1>(6,0)))*q_;
-	x.bf_ = bf_+y.block<3,1>(9,0);
-	x.bw_ = bw_+y.block<3,1>(12,0);
+template<typename ScalarType>
+VUKFFilterStateT<ScalarType> VUKFFilterStateT<ScalarType>::operator +(const Eigen::Matrix<ScalarType,VUKFF_state_dim,1> &y) const{
+	VUKFFilterStateT<ScalarType> x;
+	x.r_ = r_+y.template block<3,1>(0,0);
+	x.v_ = v_+y.template block<3,1>(3,0);
+	x.q_ = Rotations::quatL(Rotations::rotVecToQuat(y.template block<3,1>(6,0)))*q_;
+	x.bf_ = bf_+y.template block<3,1>(9,0);
+	x.bw_ = bw_+y.template block<3,1>(12,0);
 	return x;
 }
 
-Eigen::Matrix<double,VUKFF_state_dim,1> VUKFFilterState::operator -(const VUKFFilterState &y) const{
-	Eigen::Matrix<double,VUKFF_state_dim,1> x;
-	x.block<3,1>(0,0) = r_-y.r_;
-	x.block<3,1>(3,0) = v_-y.v_;
-	x.block<3,1>(6,0) = Rotations::quatToRotVec(Rotations::quatL(q_)*Rotations::quatInverse(y.q_));
-	x.block<3,1>(9,0) = bf_-y.bf_;
-	x.block<3,1>(12,0) = bw_-y.bw_;
+template<typename ScalarType>
+Eigen::Matrix<ScalarType,VUKFF_state_dim,1> VUKFFilterStateT<ScalarType>::operator -(const VUKFFilterStateT<ScalarType> &y) const{
+	Eigen::Matrix<ScalarType,VUKFF_state_dim,1> x;
+	x.template block<3,1>(0,0) = r_-y.r_;
+	x.template block<3,1>(3,0) = v_-y.v_;
+	x.template block<3,1>(6,0) = Rotations::quatToRotVec(Rotations::quatL(q_)*Rotations::quatInverse(y.q_));
+	x.template block<3,1>(9,0) = bf_-y.bf_;
+	x.template block<3,1>(12,0) = bw_-y.bw_;
 	return x;
 }
 
-void FilterVUKF2::predict(VUKFFilterState& x,double dt,ImuMeas imuMeas){
-	Eigen::Matrix3d G0T = pManager_->gamma(0,-dt*(imuMeas.w_-x.bw_));
-	Eigen::Matrix3d G1T = pManager_->gamma(1,-dt*(imuMeas.w_-x.bw_));
-	Eigen::Matrix3d G2T = pManager_->gamma(2,-dt*(imuMeas.w_-x.bw_));
-	Eigen::Matrix3d R_IW, R_WI;
+template<typename ScalarType>
+void FilterVUKF2T<ScalarType>::predict(VUKFFilterStateT<ScalarType>& x,double dt,ImuMeas imuMeas){
+	// Measurements and gravity enter the scalar domain once, the gamma
+	// matrices are evaluated in double (shared with the other filters)
+	const Vec3 f = imuMeas.f_.cast<ScalarType>();
+	const Vec3 w = imuMeas.w_.cast<ScalarType>();
+	const Vec3 g = pManager_->g_.cast<ScalarType>();
+	const Eigen::Vector3d dw = -dt*(imuMeas.w_-x.bw_.template cast<double>());
+	Mat3 G0T = pManager_->gamma(0,dw).cast<ScalarType>();
+	Mat3 G1T = pManager_->gamma(1,dw).cast<ScalarType>();
+	Mat3 G2T = pManager_->gamma(2,dw).cast<ScalarType>();
+	Mat3 R_IW, R_WI;
 
 	R_WI = Rotations::quatToRotMat(x.q_);
 	R_IW = R_WI.transpose();
 
-	x.r_ = G0T*(x.r_+dt*x.v_-dt*dt/2*(2*G2T*(imuMeas.f_-x.bf_)+R_IW*pManager_->g_));
-	x.v_ = G0T*(x.v_-dt*(G1T*(imuMeas.f_-x.bf_)+R_IW*pManager_->g_));
-	x.q_ = Rotations::quatL(x.q_)*Rotations::rotVecToQuat(dt*(imuMeas.w_-x.bw_));
+	x.r_ = G0T*(x.r_+dt*x.v_-dt*dt/2*(2*G2T*(f-x.bf_)+R_IW*g));
+	x.v_ = G0T*(x.v_-dt*(G1T*(f-x.bf_)+R_IW*g));
+	x.q_ = Rotations::quatL(x.q_)*Rotations::rotVecToQuat(dt*(w-x.bw_));
 }
 
 
-void FilterVUKF2::predict(VUKFFilterState& x,double dt,ImuMeas imuMeas,Eigen::Matrix<double,VUKFF_preNoise_dim,1> n){
-	Eigen::Matrix3d G0T = pManager_->gamma(0,-dt*(imuMeas.w_-x.bw_-n.block<3,1>(18,0)));
-	Eigen::Matrix3d G1T = pManager_->gamma(1,-dt*(imuMeas.w_-x.bw_-n.block<3,1>(18,0)));
-	Eigen::Matrix3d G2T = pManager_->gamma(2,-dt*(imuMeas.w_-x.bw_-n.block<3,1>(18,0)));
-	Eigen::Matrix3d R_IW, R_WI;
+template<typename ScalarType>
+void FilterVUKF2T<ScalarType>::predict(VUKFFilterStateT<ScalarType>& x,double dt,ImuMeas imuMeas,Eigen::Matrix<ScalarType,VUKFF_preNoise_dim,1> n){
+	const Vec3 f = imuMeas.f_.cast<ScalarType>();
+	const Vec3 w = imuMeas.w_.cast<ScalarType>();
+	const Vec3 g = pManager_->g_.cast<ScalarType>();
+	const Eigen::Vector3d dw = -dt*(imuMeas.w_-(x.bw_+n.template block<3,1>(18,0)).template cast<double>());
+	Mat3 G0T = pManager_->gamma(0,dw).cast<ScalarType>();
+	Mat3 G1T = pManager_->gamma(1,dw).cast<ScalarType>();
+	Mat3 G2T = pManager_->gamma(2,dw).cast<ScalarType>();
+	Mat3 R_IW, R_WI;
 
 	R_WI = Rotations::quatToRotMat(x.q_);
 	R_IW = R_WI.transpose();
 
-	x.r_ = G0T*(x.r_+dt*x.v_-dt*dt/2*(2*G2T*(imuMeas.f_-x.bf_-n.block<3,1>(15,0))+R_IW*pManager_->g_))+dt*n.block<3,1>(0,0);
-	x.v_ = G0T*(x.v_-dt*(G1T*(imuMeas.f_-x.bf_-n.block<3,1>(15,0))+R_IW*pManager_->g_))+dt*n.block<3,1>(3,0);
-	x.q_ = Rotations::quatL(x.q_)*Rotations::quatL(Rotations::rotVecToQuat(dt*(imuMeas.w_-x.bw_-n.block<3,1>(18,0))))*Rotations::rotVecToQuat(dt*n.block<3,1>(6,0));
-	x.bf_ = x.bf_+dt*n.block<3,1>(9,0);
-	x.bw_ = x.bw_+dt*n.block<3,1>(12,0);
+	x.r_ = G0T*(x.r_+dt*x.v_-dt*dt/2*(2*G2T*(f-x.bf_-n.template block<3,1>(15,0))+R_IW*g))+dt*n.template block<3,1>(0,0);
+	x.v_ = G0T*(x.v_-dt*(G1T*(f-x.bf_-n.template block<3,1>(15,0))+R_IW*g))+dt*n.template block<3,1>(3,0);
+	x.q_ = Rotations::quatL(x.q_)*Rotations::quatL(Rotations::rotVecToQuat(dt*(w-x.bw_-n.template block<3,1>(18,0))))*Rotations::rotVecToQuat(dt*n.template block<3,1>(6,0));
+	x.bf_ = x.bf_+dt*n.template block<3,1>(9,0);
+	x.bw_ = x.bw_+dt*n.template block<3,1>(12,0);
 }
 
-void FilterVUKF2::samplePredictionNoise(InternState& x,double dt){
+template<typename ScalarType>
+void FilterVUKF2T<ScalarType>::samplePredictionNoise(InternState& x,double dt){
 	// Prediction noise covariance matrix
 	Npre_.setZero();
-	Npre_.block<3,3>(0,0) = Wr_/dt;
-	Npre_.block<3,3>(3,3) = Wv_/dt;
-	Npre_.block<3,3>(6,6) = Wq_/dt;
-	Npre_.block<3,3>(9,9) = Wbf_/dt;
-	Npre_.block<3,3>(12,12) = Wbw_/dt;
-	Npre_.block<3,3>(15,15) = pManager_->Rf_/dt;
-	Npre_.block<3,3>(18,18) = pManager_->Rw_/dt;
-	Eigen::LLT<MatrixPreCov> lltOfNpre(Npre_);
-	SNpre_ = lltOfNpre.matrixL();
-	if(lltOfNpre.info()==Eigen::NumericalIssue) std::cout << "Numerical issues while computing Cholesky of Npre_" << std::endl;
+	Npre_.template block<3,3>(0,0) = Wr_/dt;
+	Npre_.template block<3,3>(3,3) = Wv_/dt;
+	Npre_.template block<3,3>(6,6) = Wq_/dt;
+	Npre_.template block<3,3>(9,9) = Wbf_/dt;
+	Npre_.template block<3,3>(12,12) = Wbw_/dt;
+	Npre_.template block<3,3>(15,15) = (pManager_->Rf_/dt).cast<ScalarType>();
+	Npre_.template block<3,3>(18,18) = (pManager_->Rw_/dt).cast<ScalarType>();
+	if(mbUseSquareRoot_){
+		// Npre_ is diagonal by construction, its Cholesky factor is the
+		// element-wise square root
+		SNpre_ = Npre_.diagonal().cwiseSqrt().asDiagonal();
+	} else {
+		Eigen::LLT<MatrixPreCov> lltOfNpre(Npre_);
+		SNpre_ = lltOfNpre.matrixL();
+		if(lltOfNpre.info()==Eigen::NumericalIssue) std::cout << "Numerical issues while computing Cholesky of Npre_" << std::endl;
+	}
 	SNpre_ = SNpre_*UKFGamma_;
-	x.PN_.block<VUKFF_preNoise_dim,VUKFF_preNoise_dim>(0,0) = SNpre_;
-	x.PN_.block<VUKFF_preNoise_dim,VUKFF_preNoise_dim>(0,VUKFF_preNoise_dim) = -SNpre_;
+	x.PN_.template block<VUKFF_preNoise_dim,VUKFF_preNoise_dim>(0,0) = SNpre_;
+	x.PN_.template block<VUKFF_preNoise_dim,VUKFF_preNoise_dim>(0,VUKFF_preNoise_dim) = -SNpre_;
 }
 
-void FilterVUKF2::sampleUpdateNoise(InternState& x){
+template<typename ScalarType>
+void FilterVUKF2T<ScalarType>::sampleUpdateNoise(InternState& x){
 	// Update noise covariance matrix
 	Nup_.setZero();
 	for(int i=0;i<LSE_N_LEG;i++){
-		Nup_.block<3,3>(3*i,3*i) = pManager_->Rda_;
+		Nup_.template block<3,3>(3*i,3*i) = pManager_->Rda_.cast<ScalarType>();
+	}
+	if(mbUseSquareRoot_){
+		// Nup_ is diagonal by construction, its Cholesky factor is the
+		// element-wise square root
+		SNup_ = Nup_.diagonal().cwiseSqrt().asDiagonal();
+	} else {
+		Eigen::LLT<MatrixUpCov> lltOfNup(Nup_);
+		SNup_ = lltOfNup.matrixL();
+		if(lltOfNup.info()==Eigen::NumericalIssue) std::cout << "Numerical issues while computing Cholesky of Nup_" << std::endl;
 	}
-	Eigen::LLT<MatrixUpCov> lltOfNup(Nup_);
-	SNup_ = lltOfNup.matrixL();
-	if(lltOfNup.info()==Eigen::NumericalIssue) std::cout << "Numerical issues while computing Cholesky of Nup_" << std::endl;
 	SNup_ = SNup_*UKFGamma_;
-	x.UN_.block<VUKFF_upNoise_dim,VUKFF_upNoise_dim>(0,0) = SNup_;
-	x.UN_.block<VUKFF_upNoise_dim,VUKFF_upNoise_dim>(0,VUKFF_upNoise_dim) = -SNup_;
+	x.UN_.template block<VUKFF_upNoise_dim,VUKFF_upNoise_dim>(0,0) = SNup_;
+	x.UN_.template block<VUKFF_upNoise_dim,VUKFF_upNoise_dim>(0,VUKFF_upNoise_dim) = -SNup_;
 }
 
+/* Explicit instantiations: the default double filter and the
+ * single-precision variant */
+template class VUKFFilterStateT<double>;
+template class VUKFFilterStateT<float>;
+template class FilterVUKF2T<double>;
+template class FilterVUKF2T<float>;
+
 }
 
 
@@ -5,6 +5,7 @@
  */
 
 #include "Manager.hpp"
+#include "ParamCache.hpp"
 #include "FilterOCEKF.hpp"
 #include "FilterVUKF.hpp"
 #include "FilterVUKF2.hpp"
@@ -15,31 +16,30 @@
 #include "tinyxml.h"
 #include <iostream>
 #include <vector>
+#include <cstring>
 #include <Eigen/Dense>
 
 namespace LSE {
 
 Manager::Manager(const char* pFilename,Eigen::Vector3d (*f)(Eigen::Matrix<double,LSE_DOF_LEG,1>,int),Eigen::Matrix<double,3,LSE_DOF_LEG> (*J)(Eigen::Matrix<double,LSE_DOF_LEG,1>,int)):
-legKin(f),legKinJac(J),g_(0.0,0.0,-9.81){
+legKin(f),legKinJac(J),legKinBatch(NULL),legKinJacBatch(NULL),g_(0.0,0.0,-9.81),
+pParams_(ManagerParams::get(pFilename)),B_r_BI_(pParams_->B_r_BI_),q_IB_(pParams_->q_IB_),B_r_BK_(pParams_->B_r_BK_),q_KB_(pParams_->q_KB_),Rf_(pParams_->Rf_),Rw_(pParams_->Rw_),Rs_(pParams_->Rs_),Rposr_(pParams_->Rposr_),Rposq_(pParams_->Rposq_),Ra_(pParams_->Ra_),Rda_(pParams_->Rda_){
+	init(pFilename);
+}
+
+Manager::Manager(const char* pFilename,void (*fBatch)(const Eigen::Matrix<double,LSE_DOF_LEG,LSE_N_LEG>&,Eigen::Matrix<double,3,LSE_N_LEG>&),void (*JBatch)(const Eigen::Matrix<double,LSE_DOF_LEG,LSE_N_LEG>&,Eigen::Matrix<double,3*LSE_N_LEG,LSE_DOF_LEG>&)):
+legKin(NULL),legKinJac(NULL),legKinBatch(fBatch),legKinJacBatch(JBatch),g_(0.0,0.0,-9.81),
+pParams_(ManagerParams::get(pFilename)),B_r_BI_(pParams_->B_r_BI_),q_IB_(pParams_->q_IB_),B_r_BK_(pParams_->B_r_BK_),q_KB_(pParams_->q_KB_),Rf_(pParams_->Rf_),Rw_(pParams_->Rw_),Rs_(pParams_->Rs_),Rposr_(pParams_->Rposr_),Rposq_(pParams_->Rposq_),Ra_(pParams_->Ra_),Rda_(pParams_->Rda_){
+	init(pFilename);
+}
+
+void Manager::init(const char* pFilename){
 	tImu_ = 0;
 	tEnc_ = 0;
 	tPos_ = 0;
 
-	// Init all parameters
-	B_r_BI_.setZero();
-	q_IB_ = Rotations::quatIdentity();
-	B_r_BK_.setZero();
-	q_KB_ = Rotations::quatIdentity();
-	Rf_ = 0.002*Eigen::Matrix3d::Identity();
-	Rw_ = 0.000873*Eigen::Matrix3d::Identity();
-	Rs_ = 0.01*Eigen::Matrix3d::Identity();
-	Ra_ = 0.001*Eigen::Matrix<double,LSE_DOF_LEG,LSE_DOF_LEG>::Identity();
-	Rda_ = 0.01*Eigen::Matrix<double,LSE_DOF_LEG,LSE_DOF_LEG>::Identity();
-	Rposr_ = 0.01*Eigen::Matrix<double,3,3>::Identity();
-	Rposq_ = 0.01*Eigen::Matrix<double,3,3>::Identity();
-
-	activeFilter_ = 0;
-	loadParam(pFilename);
+	// All measurement parameters live in the shared block
+	activeFilter_ = pParams_->activeFilter_;
 
 	// Initialize filter
 	pFilterList_[0] = new FilterVUKF(this,pFilename);
@@ -54,6 +54,14 @@ legKin(f),legKinJac(J),g_(0.0,0.0,-9.81){
 	// Logging Stuff
 	isLogging_ = false;
 
+	// Comparison mode
+	mbComparisonMode_ = false;
+	mbPoolRunning_ = false;
+	jobId_ = 0;
+	pendingJobs_ = 0;
+	mbJobHasTime_ = false;
+	jobTime_ = 0;
+
 	p_.setZero();
 	qLast_[0] = 0;
 	qLast_[1] = 0;
@@ -122,9 +130,7 @@ legKin(f),legKinJac(J),g_(0.0,0.0,-9.81){
 }
 
 void Manager::setReferenceKinematicRates(){
-        for(int i=0;i<LSE_N_LEG;i++){
-                p_.col(i) = (*legKin)(encMeasList_.rbegin()->second.e_.col(i),i);
-        }
+        legKinAll(p_,encMeasList_.rbegin()->second.e_);
         tLast_ = encMeasList_.rbegin()->first;
 }
 
@@ -137,12 +143,14 @@ void Manager::computeKinematicPose(){
         Rotations::Quat b;
         Eigen::Matrix4d A;
         Eigen::Matrix4d B;
+        Eigen::Matrix<double,3,LSE_N_LEG> sKin;
+        legKinAll(sKin,m.e_);
         A.setZero();
         for(int i=0;i<LSE_N_LEG;i++){
                         for(int j=i+1;j<LSE_N_LEG;j++){
                                         a.block(0,0,3,1) = p_.col(i)-p_.col(j);
                                         a(3) = 0;
-                                        b.block(0,0,3,1) = (*legKin)(m.e_.col(i),i)-(*legKin)(m.e_.col(j),j);
+                                        b.block(0,0,3,1) = sKin.col(i)-sKin.col(j);
                                         b(3) = 0;
                                         B = Rotations::quatR(a)-Rotations::quatL(b);
                                         A = A + B.transpose()*B;
@@ -166,7 +174,32 @@ Eigen::Vector3d Manager::getKinematicRate(){
         return wKin_;
 }
 
+void Manager::legKinAll(Eigen::Matrix<double,3,LSE_N_LEG>& s,const Eigen::Matrix<double,LSE_DOF_LEG,LSE_N_LEG>& e){
+	if(legKinBatch!=NULL){
+		(*legKinBatch)(e,s);
+	} else {
+		for(int i=0;i<LSE_N_LEG;i++){
+			s.col(i) = (*legKin)(e.col(i),i);
+		}
+	}
+}
+
+void Manager::legKinJacAll(Eigen::Matrix<double,3*LSE_N_LEG,LSE_DOF_LEG>& J,const Eigen::Matrix<double,LSE_DOF_LEG,LSE_N_LEG>& e){
+	if(legKinJacBatch!=NULL){
+		(*legKinJacBatch)(e,J);
+	} else {
+		for(int i=0;i<LSE_N_LEG;i++){
+			J.block(3*i,0,3,LSE_DOF_LEG) = (*legKinJac)(e.col(i),i);
+		}
+	}
+}
+
+bool Manager::hasLegKinJac(){
+	return legKinJac!=NULL || legKinJacBatch!=NULL;
+}
+
 Manager::~Manager(){
+	setComparisonMode(false);
 	for(int i=0;i<NUM_FILTERS;i++){
 		delete pFilterList_[i];
 	}
@@ -178,28 +211,114 @@ Manager::~Manager(){
 
 void Manager::addImuMeas(const double& t,const ImuMeas& m){
 	imuMeasList_.insert(std::pair<double,ImuMeas>(t,m));
-	if(imuMeasList_.size() > LSE_MEAS_N){
-		imuMeasList_.erase(imuMeasList_.begin());
-	}
+	if(binLog_.isOpen()) binLog_.logImuMeas(t,m);
+	if(pDelayCalibration_->isStreaming()) pDelayCalibration_->addImuSample(t,m);
+	rollbackFilters(t+tImu_);
 }
 
 void Manager::addEncMeas(const double& t,const EncMeas& m){
 	encMeasList_.insert(std::pair<double,EncMeas>(t,m));
-	if(encMeasList_.size() > LSE_MEAS_N){
-		encMeasList_.erase(encMeasList_.begin());
-	}
+	if(binLog_.isOpen()) binLog_.logEncMeas(t,m);
+	if(pDelayCalibration_->isStreaming()) pDelayCalibration_->addEncSample(t,m);
+	rollbackFilters(t+tEnc_);
 }
 
 void Manager::addPosMeas(const double& t,const PosMeas& m){
 	posMeasList_.insert(std::pair<double,PosMeas>(t,m));
-	if(posMeasList_.size() > LSE_MEAS_N){
-		posMeasList_.erase(posMeasList_.begin());
+	if(binLog_.isOpen()) binLog_.logPosMeas(t,m);
+	if(pDelayCalibration_->isStreaming()) pDelayCalibration_->addPosSample(t,m);
+	rollbackFilters(t+tPos_);
+}
+
+int Manager::replay(const char* pFilename,const double& t0,const double& t1){
+	BinaryLogMapping map;
+	if(!map.open(pFilename)) return 0;
+
+	// The safe state is measurement driven and advances identically no matter
+	// how often update() gets called, so the filter is only stepped when a
+	// correction becomes available (plus a safety stride that keeps the
+	// measurement rings from overflowing between corrections). This skips the
+	// tentative re-prediction the per-sample online cadence would pay.
+	int N = 0;
+	int sinceUpdate = 0;
+	double tNewest = t0;
+	int type;
+	ImuMeas imuMeas;
+	EncMeas encMeas;
+	PosMeas posMeas;
+	while((type = map.next()) != 0){
+		switch(type){
+		case LSE_RECORD_IMU:{
+			const ImuRecord* pRec = (const ImuRecord*)map.payload_;
+			if(pRec->t_<t0 || pRec->t_>t1) break;
+			for(int i=0;i<3;i++){
+				imuMeas.f_(i) = pRec->f_[i];
+				imuMeas.w_(i) = pRec->w_[i];
+			}
+			addImuMeas(pRec->t_,imuMeas);
+			tNewest = pRec->t_;
+			N++;
+			sinceUpdate++;
+			if(sinceUpdate>=LSE_MEAS_N/2){
+				update(tNewest);
+				sinceUpdate = 0;
+			}
+			break;}
+		case LSE_RECORD_ENC:{
+			const EncRecord* pRec = (const EncRecord*)map.payload_;
+			if(pRec->t_<t0 || pRec->t_>t1) break;
+			memcpy(encMeas.e_.data(),pRec->e_,sizeof(pRec->e_));
+			memcpy(encMeas.v_.data(),pRec->v_,sizeof(pRec->v_));
+			for(int i=0;i<LSE_N_LEG;i++){
+				encMeas.CF_[i] = pRec->CF_[i];
+			}
+			addEncMeas(pRec->t_,encMeas);
+			tNewest = pRec->t_;
+			update(tNewest);
+			N++;
+			sinceUpdate = 0;
+			break;}
+		case LSE_RECORD_POS:{
+			const PosRecord* pRec = (const PosRecord*)map.payload_;
+			if(pRec->t_<t0 || pRec->t_>t1) break;
+			for(int i=0;i<3;i++){
+				posMeas.r_(i) = pRec->r_[i];
+			}
+			for(int i=0;i<4;i++){
+				posMeas.q_(i) = pRec->q_[i];
+			}
+			addPosMeas(pRec->t_,posMeas);
+			tNewest = pRec->t_;
+			update(tNewest);
+			N++;
+			sinceUpdate = 0;
+			break;}
+		default:
+			// State/slippage records of the original run are skipped
+			break;
+		}
+	}
+	if(N>0){
+		update(tNewest);
+	}
+	map.close();
+	return N;
+}
+
+void Manager::rollbackFilters(const double& t){
+	if(mbComparisonMode_){
+		for(int i=0;i<NUM_FILTERS;i++){
+			pFilterList_[i]->rollback(t);
+		}
+	} else {
+		pFilterList_[activeFilter_]->rollback(t);
 	}
 }
 
 const ImuMeas* Manager::getImuMeas(double& t){
-	std::map<double,ImuMeas>::iterator it;
-	it = imuMeasList_.upper_bound(t);
+	MeasStorage<ImuMeas,LSE_MEAS_N>::iterator it;
+	curImu_.attach(&imuMeasList_);
+	it = curImu_.upper_bound(t);
 	if(it == imuMeasList_.end()){
 		return NULL;
 	} else {
@@ -209,8 +328,9 @@ const ImuMeas* Manager::getImuMeas(double& t){
 }
 
 const EncMeas* Manager::getEncMeas(double& t){
-	std::map<double,EncMeas>::iterator it;
-	it = encMeasList_.upper_bound(t);
+	MeasStorage<EncMeas,LSE_MEAS_N>::iterator it;
+	curEnc_.attach(&encMeasList_);
+	it = curEnc_.upper_bound(t);
 	if(it == encMeasList_.end()){
 		return NULL;
 	} else {
@@ -220,8 +340,9 @@ const EncMeas* Manager::getEncMeas(double& t){
 }
 
 const PosMeas* Manager::getPosMeas(double& t){
-	std::map<double,PosMeas>::iterator it;
-	it = posMeasList_.upper_bound(t);
+	MeasStorage<PosMeas,LSE_MEAS_N>::iterator it;
+	curPos_.attach(&posMeasList_);
+	it = curPos_.upper_bound(t);
 	if(it == posMeasList_.end()){
 		return NULL;
 	} else {
@@ -255,22 +376,146 @@ double Manager::getPosTD(){
 	return tPos_;
 }
 
+bool Manager::queueImuMeas(const double& t,const ImuMeas& m){
+	return imuMeasQueue_.push(t,m);
+}
+
+bool Manager::queueEncMeas(const double& t,const EncMeas& m){
+	return encMeasQueue_.push(t,m);
+}
+
+bool Manager::queuePosMeas(const double& t,const PosMeas& m){
+	return posMeasQueue_.push(t,m);
+}
+
+void Manager::drainMeasQueues(){
+	double t;
+	ImuMeas imuMeas;
+	EncMeas encMeas;
+	PosMeas posMeas;
+	while(imuMeasQueue_.pop(t,imuMeas)){
+		addImuMeas(t,imuMeas);
+	}
+	while(encMeasQueue_.pop(t,encMeas)){
+		addEncMeas(t,encMeas);
+	}
+	while(posMeasQueue_.pop(t,posMeas)){
+		addPosMeas(t,posMeas);
+	}
+}
+
 void Manager::update(const double& t){
-	pFilterList_[activeFilter_]->update(t);
+	drainMeasQueues();
+	if(mbComparisonMode_){
+		runComparisonUpdate(true,t);
+	} else {
+		pFilterList_[activeFilter_]->update(t);
+	}
+	if(binLog_.isOpen()){
+		State x = getEst();
+		binLog_.logState(x);
+		binLog_.logSlippage(x.t_,getSlippage());
+	}
 }
 
 void Manager::update(){
-	pFilterList_[activeFilter_]->update();
+	drainMeasQueues();
+	if(mbComparisonMode_){
+		runComparisonUpdate(false,0);
+	} else {
+		pFilterList_[activeFilter_]->update();
+	}
+	if(binLog_.isOpen()){
+		State x = getEst();
+		binLog_.logState(x);
+		binLog_.logSlippage(x.t_,getSlippage());
+	}
 }
 
 State Manager::getEst(){
 	return pFilterList_[activeFilter_]->getEst();
 }
 
+State Manager::getEst(const int& filter){
+	return pFilterList_[filter]->getEst();
+}
+
 SlippageDetection Manager::getSlippage(){
 	return pFilterList_[activeFilter_]->getSlippage();
 }
 
+SlippageDetection Manager::getSlippage(const int& filter){
+	return pFilterList_[filter]->getSlippage();
+}
+
+PerfStats Manager::getPerfStats(){
+	return pFilterList_[activeFilter_]->getPerfStats();
+}
+
+void Manager::resetPerfStats(){
+	for(int i=0;i<NUM_FILTERS;i++){
+		pFilterList_[i]->resetPerfStats();
+	}
+}
+
+void Manager::setComparisonMode(const bool& enable){
+	if(enable && !mbPoolRunning_){
+		mbPoolRunning_ = true;
+		pendingJobs_ = 0;
+		for(int i=0;i<NUM_FILTERS;i++){
+			// Hand the workers the current job count, they may start after
+			// the first job got dispatched
+			workers_[i] = std::thread(&Manager::filterWorker,this,i,jobId_);
+		}
+		mbComparisonMode_ = true;
+	} else if(!enable && mbPoolRunning_){
+		{
+			std::unique_lock<std::mutex> lock(poolMutex_);
+			mbComparisonMode_ = false;
+			mbPoolRunning_ = false;
+			poolCond_.notify_all();
+		}
+		for(int i=0;i<NUM_FILTERS;i++){
+			workers_[i].join();
+		}
+	}
+}
+
+void Manager::filterWorker(const int& i,const unsigned long& startJob){
+	unsigned long lastJob = startJob;
+	std::unique_lock<std::mutex> lock(poolMutex_);
+	while(true){
+		while(mbPoolRunning_ && jobId_ == lastJob){
+			poolCond_.wait(lock);
+		}
+		if(!mbPoolRunning_) return;
+		lastJob = jobId_;
+		const bool hasTime = mbJobHasTime_;
+		const double t = jobTime_;
+		lock.unlock();
+		if(hasTime){
+			pFilterList_[i]->update(t);
+		} else {
+			pFilterList_[i]->update();
+		}
+		lock.lock();
+		pendingJobs_--;
+		if(pendingJobs_==0) poolDone_.notify_all();
+	}
+}
+
+void Manager::runComparisonUpdate(const bool& hasTime,const double& t){
+	std::unique_lock<std::mutex> lock(poolMutex_);
+	mbJobHasTime_ = hasTime;
+	jobTime_ = t;
+	pendingJobs_ = NUM_FILTERS;
+	jobId_++;
+	poolCond_.notify_all();
+	while(pendingJobs_>0){
+		poolDone_.wait(lock);
+	}
+}
+
 void Manager::resetEstimate(const double& t){
 	pFilterList_[activeFilter_]->resetEstimate(t);
 }
@@ -286,7 +531,83 @@ int Manager::robotCalibration(const double& t,const double& T){
 }
 #endif
 
+/*! Per-thread cache of gammaAll (filters may run concurrently in comparison mode) */
+struct GammaCache{
+	GammaCache(){
+		valid_ = false;
+		dt_ = 0;
+	}
+	bool valid_;
+	Eigen::Vector3d w_;
+	double dt_;
+	Eigen::Matrix3d G_[4];
+};
+
+void Manager::gammaAll(Eigen::Matrix3d* G,const Eigen::Vector3d& w,const double& dt){
+	static thread_local GammaCache cache;
+	if(cache.valid_ && cache.dt_ == dt && cache.w_ == w){
+		for(int k=0;k<4;k++){
+			G[k] = cache.G_[k];
+		}
+		return;
+	}
+
+	// Shared intermediates of all orders
+	const double wNorm = w.norm();
+	const Eigen::Matrix3d wk = Rotations::vecToSqew(w);
+	const Eigen::Matrix3d wk2 = wk*wk;
+	const double cwt = cos(wNorm*dt);
+	const double swt = sin(wNorm*dt);
+
+	for(int k=0;k<4;k++){
+		int b = k%2;
+		int m = (k-b)/2;
+		double factor1 = 0;
+		double factor2 = 0;
+
+		// Compute first factor
+		if(wNorm*dt >= 1e-5*sqrt((2*m+3)*(2*m+4))){
+			factor1 = cwt;
+			for(int i=0;i <= m;i++){
+				factor1 += -pow(-1,i)*pow(wNorm*dt,2*i)/factorial(2*i);
+			}
+			factor1 *= pow(-1,m+1)/pow(wNorm,2+2*m);
+		} else {
+			factor1 = pow(dt,2*m+2)/factorial(2*m+2);
+		}
+
+		// Compute second factor
+		if(wNorm*dt >= 1e-5*sqrt((2*m+2*b+2)*(2*m+2*b+3))){
+			factor2 = swt;
+			for(int i=0;i <= m+b-1;i++){
+				factor2 += -pow(-1,i)*pow(wNorm*dt,2*i+1)/factorial(2*i+1);
+			}
+			factor2 *= pow(-1,m+b)/pow(wNorm,1+2*m+2*b);
+		} else {
+			factor2 = pow(dt,1+2*m+2*b)/factorial(1+2*m+2*b);
+		}
+
+		if(b==0){
+			cache.G_[k] = pow(dt,k)/factorial(k)*Eigen::Matrix3d::Identity()+factor1*wk2+factor2*wk;
+		} else {
+			cache.G_[k] = pow(dt,k)/factorial(k)*Eigen::Matrix3d::Identity()+factor1*wk+factor2*wk2;
+		}
+	}
+	cache.w_ = w;
+	cache.dt_ = dt;
+	cache.valid_ = true;
+	for(int k=0;k<4;k++){
+		G[k] = cache.G_[k];
+	}
+}
+
 Eigen::Matrix3d Manager::gamma(const int& k,const Eigen::Vector3d& w,const double& dt){
+	// Orders 0 to 3 are computed jointly and cached
+	if(k>=0 && k<=3){
+		Eigen::Matrix3d G[4];
+		gammaAll(G,w,dt);
+		return G[k];
+	}
 	int b = k%2;
 	int m = (k-b)/2;
 	double wNorm = w.norm();
@@ -331,47 +652,8 @@ Eigen::Matrix3d Manager::gamma(const int& k,const Eigen::Vector3d& w,const doubl
 }
 
 Eigen::Matrix3d Manager::gamma(const int& k,const Eigen::Vector3d& v){
-	int b = k%2;
-	int m = (k-b)/2;
-	double vNorm = v.norm();
-	double factor1 = 0;
-	double factor2 = 0;
-	Eigen::Matrix3d vk;
-	Eigen::Matrix3d vk2;
-	Eigen::Matrix3d G_k;
-
-	// Get sqew matrices
-	vk = Rotations::vecToSqew(v);
-	vk2 = vk*vk;
-
-	// Compute first factor
-	if(vNorm >= 1e-5*sqrt((2*m+3)*(2*m+4))){
-		factor1 = cos(vNorm);
-		for(int i=0;i <= m;i++){
-			factor1 += -pow(-1,i)*pow(vNorm,2*i)/factorial(2*i);
-		}
-		factor1 *= pow(-1,m+1)/pow(vNorm,2+2*m);
-	} else {
-		factor1 = 1/factorial(2*m+2);
-	}
-
-	// Compute second factor
-	if(vNorm >= 1e-5*sqrt((2*m+2*b+2)*(2*m+2*b+3))){
-		factor2 = sin(vNorm);
-		for(int i=0;i <= m+b-1;i++){
-			factor2 += -pow(-1,i)*pow(vNorm,2*i+1)/factorial(2*i+1);
-		}
-		factor2 *= pow(-1,m+b)/pow(vNorm,1+2*m+2*b);
-	} else {
-		factor2 = 1/factorial(1+2*m+2*b);
-	}
-
-	if(b==0){
-		G_k = 1/factorial(k)*Eigen::Matrix3d::Identity()+factor1*vk2+factor2*vk;
-	} else {
-		G_k = 1/factorial(k)*Eigen::Matrix3d::Identity()+factor1*vk+factor2*vk2;
-	}
-	return G_k;
+	// Identical to the timed version with dt = 1 (shares its cache)
+	return gamma(k,v,1.0);
 }
 
 int Manager::factorial(const int& k){
@@ -383,98 +665,6 @@ int Manager::factorial(const int& k){
 	return kFac;
 }
 
-void Manager::loadParam(const char* pFilename){
-	// Open parameter file
-	TiXmlDocument doc(pFilename);
-	if (!doc.LoadFile()){
-		std::cout << "No parameter file found at: " << pFilename << std::endl;
-		return;
-	}
-
-	// Define handles and elements
-	TiXmlHandle hDoc(&doc);
-	TiXmlElement* pElem;
-	TiXmlHandle hRoot(0);
-
-	// Get root
-	pElem=hDoc.FirstChildElement("LeggedStateEstimator").Element();
-	if (pElem){
-		pElem->QueryIntAttribute("activeFilter", &activeFilter_);
-		hRoot=TiXmlHandle(pElem);
-
-		pElem=hRoot.FirstChild("MeasurementSettings").FirstChild("Imu").FirstChild("AccelerometerStd").Element();
-		if (pElem){
-			pElem->QueryDoubleAttribute("x", &Rf_(0,0));
-			pElem->QueryDoubleAttribute("y", &Rf_(1,1));
-			pElem->QueryDoubleAttribute("z", &Rf_(2,2));
-		}
-		pElem=hRoot.FirstChild("MeasurementSettings").FirstChild("Imu").FirstChild("GyroscopeStd").Element();
-		if (pElem){
-			pElem->QueryDoubleAttribute("x", &Rw_(0,0));
-			pElem->QueryDoubleAttribute("y", &Rw_(1,1));
-			pElem->QueryDoubleAttribute("z", &Rw_(2,2));
-		}
-		pElem=hRoot.FirstChild("MeasurementSettings").FirstChild("Imu").FirstChild("TransOffset").Element();
-		if (pElem){
-			pElem->QueryDoubleAttribute("x", &B_r_BI_(0));
-			pElem->QueryDoubleAttribute("y", &B_r_BI_(1));
-			pElem->QueryDoubleAttribute("z", &B_r_BI_(2));
-		}
-		pElem=hRoot.FirstChild("MeasurementSettings").FirstChild("Imu").FirstChild("RotOffset").Element();
-		if (pElem){
-			pElem->QueryDoubleAttribute("x", &q_IB_(0));
-			pElem->QueryDoubleAttribute("y", &q_IB_(1));
-			pElem->QueryDoubleAttribute("z", &q_IB_(2));
-			pElem->QueryDoubleAttribute("w", &q_IB_(3));
-		}
-		pElem=hRoot.FirstChild("MeasurementSettings").FirstChild("Kinematic").FirstChild("EncoderStd").Element();
-		for(int i=0;i<LSE_DOF_LEG && pElem;i++){
-			pElem->QueryDoubleAttribute("a", &Ra_(i,i));
-			pElem->QueryDoubleAttribute("da", &Rda_(i,i));
-			pElem = pElem->NextSiblingElement("EncoderStd");
-		}
-		pElem=hRoot.FirstChild("MeasurementSettings").FirstChild("Kinematic").FirstChild("ContactStd").Element();
-		if (pElem){
-			pElem->QueryDoubleAttribute("x", &Rs_(0,0));
-			pElem->QueryDoubleAttribute("y", &Rs_(1,1));
-			pElem->QueryDoubleAttribute("z", &Rs_(2,2));
-		}
-		pElem=hRoot.FirstChild("MeasurementSettings").FirstChild("Kinematic").FirstChild("TransOffset").Element();
-		if (pElem){
-			pElem->QueryDoubleAttribute("x", &B_r_BK_(0));
-			pElem->QueryDoubleAttribute("y", &B_r_BK_(1));
-			pElem->QueryDoubleAttribute("z", &B_r_BK_(2));
-		}
-		pElem=hRoot.FirstChild("MeasurementSettings").FirstChild("Kinematic").FirstChild("RotOffset").Element();
-		if (pElem){
-			pElem->QueryDoubleAttribute("x", &q_KB_(0));
-			pElem->QueryDoubleAttribute("y", &q_KB_(1));
-			pElem->QueryDoubleAttribute("z", &q_KB_(2));
-			pElem->QueryDoubleAttribute("w", &q_KB_(3));
-		}
-		pElem=hRoot.FirstChild("MeasurementSettings").FirstChild("PoseSensor").FirstChild("PositionStd").Element();
-		if (pElem){
-			pElem->QueryDoubleAttribute("x", &Rposr_(0,0));
-			pElem->QueryDoubleAttribute("y", &Rposr_(1,1));
-			pElem->QueryDoubleAttribute("z", &Rposr_(2,2));
-		}
-		pElem=hRoot.FirstChild("MeasurementSettings").FirstChild("PoseSensor").FirstChild("AttituteStd").Element();
-		if (pElem){
-			pElem->QueryDoubleAttribute("x", &Rposq_(0,0));
-			pElem->QueryDoubleAttribute("y", &Rposq_(1,1));
-			pElem->QueryDoubleAttribute("z", &Rposq_(2,2));
-		}
-	}
-
-	Rf_ = Rf_*Rf_;
-	Rw_ = Rw_*Rw_;
-	Rs_ = Rs_*Rs_;
-	Ra_ = Ra_*Ra_;
-	Rda_ = Rda_*Rda_;
-	Rposr_ = Rposr_*Rposr_;
-	Rposq_ = Rposq_*Rposq_;
-}
-
 void Manager::enableLogging(const char* pLogfile){
 	if(isLogging_==false){
 		isLogging_ = true;
@@ -498,6 +688,18 @@ void Manager::disableLogging(){
 	}
 }
 
+void Manager::enableBinaryLogging(const char* pLogfile){
+	if(!binLog_.isOpen()){
+		std::ostringstream oss (std::ostringstream::out);
+		oss << pLogfile << "_F" << activeFilter_ << "_" << pFilterList_[activeFilter_]->getKeyString() << ".lse";
+		binLog_.open(oss.str().c_str());
+	}
+}
+
+void Manager::disableBinaryLogging(){
+	binLog_.close();
+}
+
 #ifdef USE_CERES
 int Manager::getLengthOfBC(){
 	return pRobotCalibration_->getN();
@@ -512,20 +714,18 @@ const RobotCalibration::state* Manager::getBCData(){
 
 void Manager::addOflMeas(const double& t,const OflMeas& m){
 	oflMeasList_.insert(std::pair<double,OflMeas>(t,m));
-	if(oflMeasList_.size() > LSE_MEAS_N){
-		oflMeasList_.erase(oflMeasList_.begin());
-	}
 }
 
 const OflMeas* Manager::getOflMeas(double& t){
-	std::map<double,OflMeas>::iterator it;
-		it = oflMeasList_.upper_bound(t);
-		if(it == oflMeasList_.end()){
-			return NULL;
-		} else {
-			t = (*it).first;
-			return &(*it).second;
-		}
+	MeasStorage<OflMeas,LSE_OFL_MEAS_N>::iterator it;
+	curOfl_.attach(&oflMeasList_);
+	it = curOfl_.upper_bound(t);
+	if(it == oflMeasList_.end()){
+		return NULL;
+	} else {
+		t = (*it).first;
+		return &(*it).second;
+	}
 }
 
 }
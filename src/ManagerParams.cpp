@@ -0,0 +1,144 @@
+/*!
+* @file 	ManagerParams.cpp
+* @author 	Michael Blösch
+* @date		10.10.2012
+* @brief	Shared read-only Manager parameter block
+ */
+
+#include "ManagerParams.hpp"
+#include "ParamCache.hpp"
+#include "tinyxml.h"
+#include <iostream>
+#include <map>
+#include <string>
+
+namespace LSE {
+
+/*! Cached parameter blocks, one per parameter filename */
+static std::map<std::string,ManagerParams*> blocks_;
+
+ManagerParams::ManagerParams(){
+	activeFilter_ = 0;
+	B_r_BI_.setZero();
+	q_IB_ = Rotations::quatIdentity();
+	B_r_BK_.setZero();
+	q_KB_ = Rotations::quatIdentity();
+	Rf_ = 0.002*Eigen::Matrix3d::Identity();
+	Rw_ = 0.000873*Eigen::Matrix3d::Identity();
+	Rs_ = 0.01*Eigen::Matrix3d::Identity();
+	Ra_ = 0.001*Eigen::Matrix<double,LSE_DOF_LEG,LSE_DOF_LEG>::Identity();
+	Rda_ = 0.01*Eigen::Matrix<double,LSE_DOF_LEG,LSE_DOF_LEG>::Identity();
+	Rposr_ = 0.01*Eigen::Matrix<double,3,3>::Identity();
+	Rposq_ = 0.01*Eigen::Matrix<double,3,3>::Identity();
+}
+
+const ManagerParams* ManagerParams::get(const char* pFilename){
+	std::map<std::string,ManagerParams*>::iterator it = blocks_.find(pFilename);
+	if(it!=blocks_.end()) return it->second;
+
+	ManagerParams* pParams = new ManagerParams();
+	pParams->loadParam(pFilename);
+	blocks_[pFilename] = pParams;
+	return pParams;
+}
+
+void ManagerParams::clear(){
+	for(std::map<std::string,ManagerParams*>::iterator it=blocks_.begin();it!=blocks_.end();it++){
+		delete it->second;
+	}
+	blocks_.clear();
+}
+
+void ManagerParams::loadParam(const char* pFilename){
+	// Open parameter file
+	TiXmlDocument* doc = ParamCache::get(pFilename);
+	if (doc==NULL){
+		std::cout << "No parameter file found at: " << pFilename << std::endl;
+		return;
+	}
+
+	// Define handles and elements
+	TiXmlHandle hDoc(doc);
+	TiXmlElement* pElem;
+	TiXmlHandle hRoot(0);
+
+	// Get root
+	pElem=hDoc.FirstChildElement("LeggedStateEstimator").Element();
+	if (pElem){
+		pElem->QueryIntAttribute("activeFilter", &activeFilter_);
+		hRoot=TiXmlHandle(pElem);
+
+		pElem=hRoot.FirstChild("MeasurementSettings").FirstChild("Imu").FirstChild("AccelerometerStd").Element();
+		if (pElem){
+			pElem->QueryDoubleAttribute("x", &Rf_(0,0));
+			pElem->QueryDoubleAttribute("y", &Rf_(1,1));
+			pElem->QueryDoubleAttribute("z", &Rf_(2,2));
+		}
+		pElem=hRoot.FirstChild("MeasurementSettings").FirstChild("Imu").FirstChild("GyroscopeStd").Element();
+		if (pElem){
+			pElem->QueryDoubleAttribute("x", &Rw_(0,0));
+			pElem->QueryDoubleAttribute("y", &Rw_(1,1));
+			pElem->QueryDoubleAttribute("z", &Rw_(2,2));
+		}
+		pElem=hRoot.FirstChild("MeasurementSettings").FirstChild("Imu").FirstChild("TransOffset").Element();
+		if (pElem){
+			pElem->QueryDoubleAttribute("x", &B_r_BI_(0));
+			pElem->QueryDoubleAttribute("y", &B_r_BI_(1));
+			pElem->QueryDoubleAttribute("z", &B_r_BI_(2));
+		}
+		pElem=hRoot.FirstChild("MeasurementSettings").FirstChild("Imu").FirstChild("RotOffset").Element();
+		if (pElem){
+			pElem->QueryDoubleAttribute("x", &q_IB_(0));
+			pElem->QueryDoubleAttribute("y", &q_IB_(1));
+			pElem->QueryDoubleAttribute("z", &q_IB_(2));
+			pElem->QueryDoubleAttribute("w", &q_IB_(3));
+		}
+		pElem=hRoot.FirstChild("MeasurementSettings").FirstChild("Kinematic").FirstChild("EncoderStd").Element();
+		for(int i=0;i<LSE_DOF_LEG && pElem;i++){
+			pElem->QueryDoubleAttribute("a", &Ra_(i,i));
+			pElem->QueryDoubleAttribute("da", &Rda_(i,i));
+			pElem = pElem->NextSiblingElement("EncoderStd");
+		}
+		pElem=hRoot.FirstChild("MeasurementSettings").FirstChild("Kinematic").FirstChild("ContactStd").Element();
+		if (pElem){
+			pElem->QueryDoubleAttribute("x", &Rs_(0,0));
+			pElem->QueryDoubleAttribute("y", &Rs_(1,1));
+			pElem->QueryDoubleAttribute("z", &Rs_(2,2));
+		}
+		pElem=hRoot.FirstChild("MeasurementSettings").FirstChild("Kinematic").FirstChild("TransOffset").Element();
+		if (pElem){
+			pElem->QueryDoubleAttribute("x", &B_r_BK_(0));
+			pElem->QueryDoubleAttribute("y", &B_r_BK_(1));
+			pElem->QueryDoubleAttribute("z", &B_r_BK_(2));
+		}
+		pElem=hRoot.FirstChild("MeasurementSettings").FirstChild("Kinematic").FirstChild("RotOffset").Element();
+		if (pElem){
+			pElem->QueryDoubleAttribute("x", &q_KB_(0));
+			pElem->QueryDoubleAttribute("y", &q_KB_(1));
+			pElem->QueryDoubleAttribute("z", &q_KB_(2));
+			pElem->QueryDoubleAttribute("w", &q_KB_(3));
+		}
+		pElem=hRoot.FirstChild("MeasurementSettings").FirstChild("PoseSensor").FirstChild("PositionStd").Element();
+		if (pElem){
+			pElem->QueryDoubleAttribute("x", &Rposr_(0,0));
+			pElem->QueryDoubleAttribute("y", &Rposr_(1,1));
+			pElem->QueryDoubleAttribute("z", &Rposr_(2,2));
+		}
+		pElem=hRoot.FirstChild("MeasurementSettings").FirstChild("PoseSensor").FirstChild("AttituteStd").Element();
+		if (pElem){
+			pElem->QueryDoubleAttribute("x", &Rposq_(0,0));
+			pElem->QueryDoubleAttribute("y", &Rposq_(1,1));
+			pElem->QueryDoubleAttribute("z", &Rposq_(2,2));
+		}
+	}
+
+	Rf_ = Rf_*Rf_;
+	Rw_ = Rw_*Rw_;
+	Rs_ = Rs_*Rs_;
+	Ra_ = Ra_*Ra_;
+	Rda_ = Rda_*Rda_;
+	Rposr_ = Rposr_*Rposr_;
+	Rposq_ = Rposq_*Rposq_;
+}
+
+}
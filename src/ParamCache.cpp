@@ -0,0 +1,214 @@
+/*!
+* @file 	ParamCache.cpp
+* @author 	Michael Blösch
+* @date		10.10.2012
+* @brief	Binary parameter cache, skips the XML parse on restarts
+ */
+
+#include "ParamCache.hpp"
+#include <map>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace LSE {
+
+/*! Record tags of the serialized element tree */
+enum ParamCacheTag{
+	LSE_PARCACHE_ELEMENT = 1,
+	LSE_PARCACHE_ATTRIBUTE = 2,
+	LSE_PARCACHE_END = 3
+};
+
+/*! Cached documents, one per parameter filename */
+static std::map<std::string,TiXmlDocument*> documents_;
+
+/*! Computes the FNV-1a hash of a memory block
+ * @return	hash value
+ * @param[in]	pData	data to hash
+ * @param[in]	size	size of data [bytes]
+ */
+static unsigned long long hashData(const char* pData,const unsigned long long& size){
+	unsigned long long h = 14695981039346656037ull;
+	for(unsigned long long i=0;i<size;i++){
+		h = (h^(unsigned char)pData[i])*1099511628211ull;
+	}
+	return h;
+}
+
+/*! Appends a length-prefixed string to the snapshot buffer
+ * @param[out]	buf	snapshot buffer
+ * @param[in]	pStr	string to append
+ */
+static void putString(std::vector<char>& buf,const char* pStr){
+	unsigned short len = strlen(pStr);
+	buf.insert(buf.end(),(char*)&len,(char*)&len+sizeof(len));
+	buf.insert(buf.end(),pStr,pStr+len);
+}
+
+/*! Serializes an element (and its subtree) into the snapshot buffer
+ * @param[out]	buf	snapshot buffer
+ * @param[in]	pElem	element to serialize
+ */
+static void putElement(std::vector<char>& buf,const TiXmlElement* pElem){
+	char tag = LSE_PARCACHE_ELEMENT;
+	buf.push_back(tag);
+	putString(buf,pElem->Value());
+	for(const TiXmlAttribute* pAttr=pElem->FirstAttribute();pAttr!=NULL;pAttr=pAttr->Next()){
+		tag = LSE_PARCACHE_ATTRIBUTE;
+		buf.push_back(tag);
+		putString(buf,pAttr->Name());
+		putString(buf,pAttr->Value());
+	}
+	for(const TiXmlElement* pChild=pElem->FirstChildElement();pChild!=NULL;pChild=pChild->NextSiblingElement()){
+		putElement(buf,pChild);
+	}
+	tag = LSE_PARCACHE_END;
+	buf.push_back(tag);
+}
+
+/*! Reads a length-prefixed string from the snapshot
+ * @return	1 if successful, 0 on a truncated snapshot
+ * @param[in]	pData	snapshot data
+ * @param[in]	size	snapshot size [bytes]
+ * @param[in,out]	pos	read position, advanced past the string
+ * @param[out]	str	read string
+ */
+static int getString(const char* pData,const unsigned long long& size,unsigned long long& pos,std::string& str){
+	unsigned short len;
+	if(pos+sizeof(len)>size) return 0;
+	memcpy(&len,pData+pos,sizeof(len));
+	pos += sizeof(len);
+	if(pos+len>size) return 0;
+	str.assign(pData+pos,len);
+	pos += len;
+	return 1;
+}
+
+/*! Rebuilds the element tree from a snapshot
+ * @return	1 if successful, 0 on a corrupt snapshot
+ * @param[in]	pData	snapshot data
+ * @param[in]	size	snapshot size [bytes]
+ * @param[in,out]	pos	read position, advanced past the subtree
+ * @param[in]	pParent	node the rebuilt elements get attached to
+ */
+static int getElements(const char* pData,const unsigned long long& size,unsigned long long& pos,TiXmlNode* pParent){
+	std::string name;
+	std::string value;
+	while(pos<size){
+		char tag = pData[pos];
+		pos++;
+		if(tag==LSE_PARCACHE_END) return 1;
+		if(tag!=LSE_PARCACHE_ELEMENT) return 0;
+		if(!getString(pData,size,pos,name)) return 0;
+		TiXmlElement* pElem = new TiXmlElement(name.c_str());
+		pParent->LinkEndChild(pElem);
+		while(pos<size && pData[pos]==LSE_PARCACHE_ATTRIBUTE){
+			pos++;
+			if(!getString(pData,size,pos,name)) return 0;
+			if(!getString(pData,size,pos,value)) return 0;
+			pElem->SetAttribute(name.c_str(),value.c_str());
+		}
+		if(!getElements(pData,size,pos,pElem)) return 0;
+	}
+	// Only the root level may run off the end without an end tag
+	return pParent->ToDocument()!=NULL;
+}
+
+/*! Attempts to load the document from the binary snapshot
+ * @return	rebuilt document, NULL if the snapshot is missing or stale
+ * @param[in]	pCacheName	filename of snapshot
+ * @param[in]	xmlHash	hash of the current XML file contents
+ * @param[in]	xmlSize	size of the current XML file [bytes]
+ */
+static TiXmlDocument* loadSnapshot(const char* pCacheName,const unsigned long long& xmlHash,const unsigned long long& xmlSize){
+	int fd = open(pCacheName,O_RDONLY);
+	if(fd<0) return NULL;
+	struct stat st;
+	if(fstat(fd,&st)<0 || (unsigned long long)st.st_size<sizeof(ParamCacheFileHeader)){
+		close(fd);
+		return NULL;
+	}
+	char* pData = (char*)mmap(NULL,st.st_size,PROT_READ,MAP_PRIVATE,fd,0);
+	close(fd);
+	if(pData==MAP_FAILED) return NULL;
+
+	TiXmlDocument* pDoc = NULL;
+	ParamCacheFileHeader header;
+	memcpy(&header,pData,sizeof(header));
+	if(header.magic_==LSE_PARCACHE_MAGIC && header.version_==LSE_PARCACHE_VERSION
+			&& header.xmlHash_==xmlHash && header.xmlSize_==xmlSize){
+		pDoc = new TiXmlDocument();
+		unsigned long long pos = sizeof(header);
+		if(!getElements(pData,st.st_size,pos,pDoc)){
+			delete pDoc;
+			pDoc = NULL;
+		}
+	}
+	munmap(pData,st.st_size);
+	return pDoc;
+}
+
+/*! Writes the binary snapshot for a parsed document (best effort)
+ * @param[in]	pCacheName	filename of snapshot
+ * @param[in]	pDoc	parsed document
+ * @param[in]	xmlHash	hash of the XML file contents
+ * @param[in]	xmlSize	size of the XML file [bytes]
+ */
+static void storeSnapshot(const char* pCacheName,TiXmlDocument* pDoc,const unsigned long long& xmlHash,const unsigned long long& xmlSize){
+	std::vector<char> buf;
+	ParamCacheFileHeader header;
+	header.magic_ = LSE_PARCACHE_MAGIC;
+	header.version_ = LSE_PARCACHE_VERSION;
+	header.xmlHash_ = xmlHash;
+	header.xmlSize_ = xmlSize;
+	buf.insert(buf.end(),(char*)&header,(char*)&header+sizeof(header));
+	for(const TiXmlElement* pElem=pDoc->FirstChildElement();pElem!=NULL;pElem=pElem->NextSiblingElement()){
+		putElement(buf,pElem);
+	}
+	std::ofstream ofs(pCacheName,std::ios::binary|std::ios::trunc);
+	if(ofs.is_open()){
+		ofs.write(&buf[0],buf.size());
+	}
+}
+
+TiXmlDocument* ParamCache::get(const char* pFilename){
+	std::map<std::string,TiXmlDocument*>::iterator it = documents_.find(pFilename);
+	if(it!=documents_.end()) return it->second;
+
+	// Read the XML contents (the hash always refers to the actual XML file,
+	// a stale snapshot can never shadow an edited parameter file)
+	std::ifstream ifs(pFilename,std::ios::binary);
+	if(!ifs.is_open()) return NULL;
+	std::vector<char> xml((std::istreambuf_iterator<char>(ifs)),std::istreambuf_iterator<char>());
+	ifs.close();
+	unsigned long long xmlHash = hashData(xml.empty() ? "" : &xml[0],xml.size());
+
+	std::string cacheName = std::string(pFilename)+".bin";
+	TiXmlDocument* pDoc = loadSnapshot(cacheName.c_str(),xmlHash,xml.size());
+	if(pDoc==NULL){
+		pDoc = new TiXmlDocument(pFilename);
+		if(!pDoc->LoadFile()){
+			delete pDoc;
+			return NULL;
+		}
+		storeSnapshot(cacheName.c_str(),pDoc,xmlHash,xml.size());
+	}
+	documents_[pFilename] = pDoc;
+	return pDoc;
+}
+
+void ParamCache::clear(){
+	for(std::map<std::string,TiXmlDocument*>::iterator it=documents_.begin();it!=documents_.end();it++){
+		delete it->second;
+	}
+	documents_.clear();
+}
+
+}
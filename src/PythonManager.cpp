@@ -6,6 +6,7 @@
 
 #include "PythonManager.hpp"
 #include <Eigen/Dense>
+#include <cstring>
 
 // Kinematics of robot
 Eigen::Vector3d legKin(Eigen::Matrix<double,LSE_DOF_LEG,1> a,int i){
@@ -67,6 +68,23 @@ void PythonManager::addImuMeas_python(double t, PyObject* pyf, PyObject* pyw){
 	pManager_->addImuMeas(t,imuMeas);
 }
 
+void PythonManager::addImuMeasBatch_python(PyObject* pyt, PyObject* pyM){
+	const double* t = (const double*)PyArray_DATA(pyt);
+	const double* M = (const double*)PyArray_DATA(pyM);
+	const int N = PyArray_SIZE(pyt);
+	ImuMeas imuMeas;
+	for(int i=0;i<N;i++){
+		// Row i of the Nx6 array: [f,w]
+		imuMeas.f_(0) = M[i*6+0];
+		imuMeas.f_(1) = M[i*6+1];
+		imuMeas.f_(2) = M[i*6+2];
+		imuMeas.w_(0) = M[i*6+3];
+		imuMeas.w_(1) = M[i*6+4];
+		imuMeas.w_(2) = M[i*6+5];
+		pManager_->addImuMeas(t[i],imuMeas);
+	}
+}
+
 int PythonManager::getImuMeas_python(double t, PyObject* pyf, PyObject* pyw){
 	const ImuMeas* imuMeas;
 	imuMeas = pManager_->getImuMeas(t);
@@ -95,6 +113,25 @@ void PythonManager::addEncMeas_python(double t, PyObject* pye, PyObject* pyv, Py
 	pManager_->addEncMeas(t,encMeas);
 }
 
+void PythonManager::addEncMeasBatch_python(PyObject* pyt, PyObject* pye, PyObject* pyv, PyObject* pyCF){
+	const double* t = (const double*)PyArray_DATA(pyt);
+	const double* e = (const double*)PyArray_DATA(pye);
+	const double* v = (const double*)PyArray_DATA(pyv);
+	const double* CF = (const double*)PyArray_DATA(pyCF);
+	const int N = PyArray_SIZE(pyt);
+	EncMeas encMeas;
+	for(int i=0;i<N;i++){
+		for(int j=0;j<LSE_N_LEG*LSE_DOF_LEG;j++){
+			encMeas.e_(j) = e[i*LSE_N_LEG*LSE_DOF_LEG+j];
+			encMeas.v_(j) = v[i*LSE_N_LEG*LSE_DOF_LEG+j];
+		}
+		for(int j=0;j<LSE_N_LEG;j++){
+			encMeas.CF_[j] = (int)(0<CF[i*LSE_N_LEG+j]);
+		}
+		pManager_->addEncMeas(t[i],encMeas);
+	}
+}
+
 int PythonManager::getEncMeas_python(double t, PyObject* pye, PyObject* pyv, PyObject* pyCF){
 	const EncMeas* encMeas;
 	encMeas = pManager_->getEncMeas(t);
@@ -145,20 +182,16 @@ void PythonManager::addOflMeas_python(double t, PyObject* pyx, PyObject* pyu){
 	OflMeas oflMeas;
 	int N = PyArray_SIZE(pyx);
 	N = floor(((double)N)/3.0);
-	oflMeas.x_.reserve(N);
-	oflMeas.u_.reserve(N);
-	Eigen::Vector3d v;
-	v.setZero();
+	if(N > LSE_OFL_N) N = LSE_OFL_N;
 	for(int i=0;i<N;i++){
-		v(0) = ((double*)PyArray_DATA(pyx))[i*3+0];
-		v(1) = ((double*)PyArray_DATA(pyx))[i*3+1];
-		v(2) = ((double*)PyArray_DATA(pyx))[i*3+2];
-		oflMeas.x_.push_back(v);
-		v(0) = ((double*)PyArray_DATA(pyu))[i*3+0];
-		v(1) = ((double*)PyArray_DATA(pyu))[i*3+1];
-		v(2) = ((double*)PyArray_DATA(pyu))[i*3+2];
-		oflMeas.u_.push_back(v);
+		oflMeas.x_(0,i) = ((double*)PyArray_DATA(pyx))[i*3+0];
+		oflMeas.x_(1,i) = ((double*)PyArray_DATA(pyx))[i*3+1];
+		oflMeas.x_(2,i) = ((double*)PyArray_DATA(pyx))[i*3+2];
+		oflMeas.u_(0,i) = ((double*)PyArray_DATA(pyu))[i*3+0];
+		oflMeas.u_(1,i) = ((double*)PyArray_DATA(pyu))[i*3+1];
+		oflMeas.u_(2,i) = ((double*)PyArray_DATA(pyu))[i*3+2];
 	}
+	oflMeas.n_ = N;
 	pManager_->addOflMeas(t,oflMeas);
 }
 
@@ -193,38 +226,23 @@ void PythonManager::getEst_python(PyObject* pyx){
 void PythonManager::getSlippage_python(PyObject* pyx){
 	SlippageDetection x;
 	x = pManager_->getSlippage();
-	((double*)PyArray_DATA(pyx))[0] = x.flag_[0];
-	((double*)PyArray_DATA(pyx))[1] = x.flag_[1];
-	((double*)PyArray_DATA(pyx))[2] = x.flag_[2];
-	((double*)PyArray_DATA(pyx))[3] = x.flag_[3];
-	((double*)PyArray_DATA(pyx))[4] = x.flagFiltered_[0];
-	((double*)PyArray_DATA(pyx))[5] = x.flagFiltered_[1];
-	((double*)PyArray_DATA(pyx))[6] = x.flagFiltered_[2];
-	((double*)PyArray_DATA(pyx))[7] = x.flagFiltered_[3];
-	((double*)PyArray_DATA(pyx))[8] = x.slipAxis_(0,0);
-	((double*)PyArray_DATA(pyx))[9] = x.slipAxis_(1,0);
-	((double*)PyArray_DATA(pyx))[10] = x.slipAxis_(2,0);
-	((double*)PyArray_DATA(pyx))[11] = x.slipAxis_(0,1);
-	((double*)PyArray_DATA(pyx))[12] = x.slipAxis_(1,1);
-	((double*)PyArray_DATA(pyx))[13] = x.slipAxis_(2,1);
-	((double*)PyArray_DATA(pyx))[14] = x.slipAxis_(0,2);
-	((double*)PyArray_DATA(pyx))[15] = x.slipAxis_(1,2);
-	((double*)PyArray_DATA(pyx))[16] = x.slipAxis_(2,2);
-	((double*)PyArray_DATA(pyx))[17] = x.slipAxis_(0,3);
-	((double*)PyArray_DATA(pyx))[18] = x.slipAxis_(1,3);
-	((double*)PyArray_DATA(pyx))[19] = x.slipAxis_(2,3);
-	((double*)PyArray_DATA(pyx))[20] = x.slip_(0,0);
-	((double*)PyArray_DATA(pyx))[21] = x.slip_(1,0);
-	((double*)PyArray_DATA(pyx))[22] = x.slip_(2,0);
-	((double*)PyArray_DATA(pyx))[23] = x.slip_(0,1);
-	((double*)PyArray_DATA(pyx))[24] = x.slip_(1,1);
-	((double*)PyArray_DATA(pyx))[25] = x.slip_(2,1);
-	((double*)PyArray_DATA(pyx))[26] = x.slip_(0,2);
-	((double*)PyArray_DATA(pyx))[27] = x.slip_(1,2);
-	((double*)PyArray_DATA(pyx))[28] = x.slip_(2,2);
-	((double*)PyArray_DATA(pyx))[29] = x.slip_(0,3);
-	((double*)PyArray_DATA(pyx))[30] = x.slip_(1,3);
-	((double*)PyArray_DATA(pyx))[31] = x.slip_(2,3);
+	int k = 0;
+	for(int i=0;i<LSE_N_LEG;i++){
+		((double*)PyArray_DATA(pyx))[k++] = x.flag_[i];
+	}
+	for(int i=0;i<LSE_N_LEG;i++){
+		((double*)PyArray_DATA(pyx))[k++] = x.flagFiltered_[i];
+	}
+	for(int i=0;i<LSE_N_LEG;i++){
+		for(int j=0;j<3;j++){
+			((double*)PyArray_DATA(pyx))[k++] = x.slipAxis_(j,i);
+		}
+	}
+	for(int i=0;i<LSE_N_LEG;i++){
+		for(int j=0;j<3;j++){
+			((double*)PyArray_DATA(pyx))[k++] = x.slip_(j,i);
+		}
+	}
 	return;
 	/*! Flag for feet */
 	int flag_[LSE_N_LEG];
@@ -235,6 +253,56 @@ void PythonManager::getSlippage_python(PyObject* pyx){
 	/*! Estimated (absolute) velocity of foot expressed in base frame */
 	Eigen::Matrix<double,3,LSE_N_LEG> slip_;
 }
+void PythonManager::enableBinaryLogging_python(std::string filename){
+	pManager_->enableBinaryLogging(filename.c_str());
+}
+void PythonManager::disableBinaryLogging_python(){
+	pManager_->disableBinaryLogging();
+}
+PyObject* PythonManager::getEstTrajectory_python(std::string filename){
+	BinaryLogReader reader;
+	std::vector<StateRecord> states;
+	if(reader.open(filename.c_str())){
+		int type;
+		while((type = reader.next()) != 0){
+			if(type == LSE_RECORD_STATE){
+				states.push_back(reader.state_);
+			}
+		}
+		reader.close();
+	}
+	PyObject *X;
+	int dims[2];
+	dims[0] = states.size();
+	dims[1] = 14;
+	X = PyArray_FromDims(2,dims,NPY_DOUBLE);
+	for(unsigned int i=0;i<states.size();i++){
+		// The first 14 doubles of a StateRecord are [t,r,v,q,w], copy them as one block
+		memcpy(((double*)PyArray_DATA(X))+i*14,&states[i],14*sizeof(double));
+	}
+	return X;
+}
+PyObject* PythonManager::getPerfStats_python(){
+	PerfStats stats = pManager_->getPerfStats();
+	PyObject *X;
+	int dims[2];
+	dims[0] = LSE_PERF_STAGE_N;
+	dims[1] = 3+LSE_PERF_HIST_N;
+	X = PyArray_FromDims(2,dims,NPY_DOUBLE);
+	// Row per stage: [count,cycles,maxCycles,hist[0..LSE_PERF_HIST_N-1]]
+	for(int i=0;i<LSE_PERF_STAGE_N;i++){
+		((double*)PyArray_DATA(X))[i*dims[1]+0] = (double)stats.count_[i];
+		((double*)PyArray_DATA(X))[i*dims[1]+1] = (double)stats.cycles_[i];
+		((double*)PyArray_DATA(X))[i*dims[1]+2] = (double)stats.maxCycles_[i];
+		for(int j=0;j<LSE_PERF_HIST_N;j++){
+			((double*)PyArray_DATA(X))[i*dims[1]+3+j] = (double)stats.hist_[i][j];
+		}
+	}
+	return X;
+}
+void PythonManager::resetPerfStats_python(){
+	pManager_->resetPerfStats();
+}
 void PythonManager::resetEstimate_python(double t){
 	return pManager_->resetEstimate(t);
 }
@@ -421,8 +489,10 @@ BOOST_PYTHON_MODULE(_PythonManager)
 {
     class_<PythonManager>("PythonManager", init<std::string>())
         .def("addImuMeas", &PythonManager::addImuMeas_python)
+        .def("addImuMeasBatch", &PythonManager::addImuMeasBatch_python)
         .def("getImuMeas", &PythonManager::getImuMeas_python)
         .def("addEncMeas", &PythonManager::addEncMeas_python)
+        .def("addEncMeasBatch", &PythonManager::addEncMeasBatch_python)
         .def("getEncMeas", &PythonManager::getEncMeas_python)
         .def("addPosMeas", &PythonManager::addPosMeas_python)
         .def("getPosMeas", &PythonManager::getPosMeas_python)
@@ -431,6 +501,11 @@ BOOST_PYTHON_MODULE(_PythonManager)
         .def("update", &PythonManager::update_python)
         .def("getEst", &PythonManager::getEst_python)
         .def("getSlippage", &PythonManager::getSlippage_python)
+        .def("enableBinaryLogging", &PythonManager::enableBinaryLogging_python)
+        .def("disableBinaryLogging", &PythonManager::disableBinaryLogging_python)
+        .def("getEstTrajectory", &PythonManager::getEstTrajectory_python)
+        .def("getPerfStats", &PythonManager::getPerfStats_python)
+        .def("resetPerfStats", &PythonManager::resetPerfStats_python)
         .def("resetEstimate", &PythonManager::resetEstimate_python)
         .def("delayIdentification", &PythonManager::delayIdentification_python)
         .def("setImuTD", &PythonManager::setImuTD_python)
@@ -5,12 +5,17 @@
  */
 
 #include "RobotCalibration.hpp"
+#include "ParamCache.hpp"
 #include "Manager.hpp"
 #include "tinyxml.h"
 
 #include "ceres/ceres.h"
 #include "ceres/rotation.h"
 
+#include <deque>
+#include <set>
+#include <vector>
+
 using ceres::AutoDiffCostFunction;
 using ceres::CostFunction;
 using ceres::Problem;
@@ -24,24 +29,48 @@ struct CostFunctor {
   }
 };
 
-struct GyrResidual {
-	GyrResidual(const double *w,double sigma):w_(w),sigma_(sigma){}
-
-	template <typename T>
-	bool operator()(const T* const x, const T* const b, T* residual) const {
-		residual[0] = (T(w_[0]) - x[0] - b[0])/T(sigma_);
-		residual[1] = (T(w_[1]) - x[1] - b[1])/T(sigma_);
-		residual[2] = (T(w_[2]) - x[2] - b[2])/T(sigma_);
+/*! Gyroscope residual (w - x - b)/sigma with hand-written Jacobians, the
+ * residual is linear in both parameter blocks so the Jacobians are constant
+ * diagonal matrices (no autodiff jet overhead on the per-sample blocks) */
+class GyrResidual : public ceres::SizedCostFunction<3,3,3> {
+public:
+	GyrResidual(const double *w,double sigma):sigma_(sigma){
+		w_[0] = w[0];
+		w_[1] = w[1];
+		w_[2] = w[2];
+	}
+	virtual ~GyrResidual(){}
+
+	virtual bool Evaluate(double const* const* parameters, double* residuals, double** jacobians) const {
+		const double* x = parameters[0];
+		const double* b = parameters[1];
+		residuals[0] = (w_[0] - x[0] - b[0])/sigma_;
+		residuals[1] = (w_[1] - x[1] - b[1])/sigma_;
+		residuals[2] = (w_[2] - x[2] - b[2])/sigma_;
+		if(jacobians != NULL){
+			for(int k=0;k<2;k++){
+				if(jacobians[k] != NULL){
+					for(int i=0;i<9;i++) jacobians[k][i] = 0;
+					jacobians[k][0] = -1/sigma_;
+					jacobians[k][4] = -1/sigma_;
+					jacobians[k][8] = -1/sigma_;
+				}
+			}
+		}
 		return true;
 	}
 
 private:
-	const double* w_;
+	double w_[3];
 	const double sigma_;
 };
 
 struct AccResidual {
-	AccResidual(const double *f,double sigma):f_(f),sigma_(sigma){}
+	AccResidual(const double *f,double sigma):sigma_(sigma){
+		f_[0] = f[0];
+		f_[1] = f[1];
+		f_[2] = f[2];
+	}
 
 	template <typename T>
 	bool operator()(const T* const q, const T* const a, const T* const b, T* residual) const {
@@ -59,21 +88,36 @@ struct AccResidual {
 	}
 
 private:
-	const double* f_;
+	double f_[3];
 	const double sigma_;
 };
 
-struct PosResidual {
+/*! Position integration residual (r2 - r1 - dt*v)/sigma with hand-written
+ * constant Jacobians (linear residual, one block per state transition) */
+class PosResidual : public ceres::SizedCostFunction<3,3,3,3> {
+public:
 	PosResidual(double t,double sigma):t_(t),sigma_(sigma){}
+	virtual ~PosResidual(){}
 
-	template <typename T>
-	bool operator()(const T* const r1, const T* const r2, const T* const v, T* residual) const {
+	virtual bool Evaluate(double const* const* parameters, double* residuals, double** jacobians) const {
+		const double* r1 = parameters[0];
+		const double* r2 = parameters[1];
+		const double* v = parameters[2];
 		// r2 = r1 + dt*v
-//		T WaI[3];
-//		ceres::UnitQuaternionRotatePoint(x+9,x+6,WaI);
-		residual[0] = (r2[0] - r1[0] - T(t_)*v[0])/T(sigma_);
-		residual[1] = (r2[1] - r1[1] - T(t_)*v[1])/T(sigma_);
-		residual[2] = (r2[2] - r1[2] - T(t_)*v[2])/T(sigma_);
+		residuals[0] = (r2[0] - r1[0] - t_*v[0])/sigma_;
+		residuals[1] = (r2[1] - r1[1] - t_*v[1])/sigma_;
+		residuals[2] = (r2[2] - r1[2] - t_*v[2])/sigma_;
+		if(jacobians != NULL){
+			const double d[3] = {-1/sigma_,1/sigma_,-t_/sigma_};
+			for(int k=0;k<3;k++){
+				if(jacobians[k] != NULL){
+					for(int i=0;i<9;i++) jacobians[k][i] = 0;
+					jacobians[k][0] = d[k];
+					jacobians[k][4] = d[k];
+					jacobians[k][8] = d[k];
+				}
+			}
+		}
 		return true;
 	}
 
@@ -82,15 +126,32 @@ private:
 	const double sigma_;
 };
 
-struct VelResidual {
+/*! Velocity integration residual (v2 - v1 - dt*a)/sigma with hand-written
+ * constant Jacobians (linear residual, one block per state transition) */
+class VelResidual : public ceres::SizedCostFunction<3,3,3,3> {
+public:
 	VelResidual(double t,double sigma):t_(t),sigma_(sigma){}
+	virtual ~VelResidual(){}
 
-	template <typename T>
-	bool operator()(const T* const v1, const T* const v2, const T* const a, T* residual) const {
+	virtual bool Evaluate(double const* const* parameters, double* residuals, double** jacobians) const {
+		const double* v1 = parameters[0];
+		const double* v2 = parameters[1];
+		const double* a = parameters[2];
 		// v2 = v1 + dt*a
-		residual[0] = (v2[0] - v1[0] - T(t_)*a[0])/T(sigma_);
-		residual[1] = (v2[1] - v1[1] - T(t_)*a[1])/T(sigma_);
-		residual[2] = (v2[2] - v1[2] - T(t_)*a[2])/T(sigma_);
+		residuals[0] = (v2[0] - v1[0] - t_*a[0])/sigma_;
+		residuals[1] = (v2[1] - v1[1] - t_*a[1])/sigma_;
+		residuals[2] = (v2[2] - v1[2] - t_*a[2])/sigma_;
+		if(jacobians != NULL){
+			const double d[3] = {-1/sigma_,1/sigma_,-t_/sigma_};
+			for(int k=0;k<3;k++){
+				if(jacobians[k] != NULL){
+					for(int i=0;i<9;i++) jacobians[k][i] = 0;
+					jacobians[k][0] = d[k];
+					jacobians[k][4] = d[k];
+					jacobians[k][8] = d[k];
+				}
+			}
+		}
 		return true;
 	}
 
@@ -134,7 +195,11 @@ private:
 };
 
 struct ForwardKinematics {
-	ForwardKinematics(const double* alpha, int legIndex):alpha_(alpha),legIndex_(legIndex){}
+	ForwardKinematics(const double* alpha, int legIndex):legIndex_(legIndex){
+		for(int i=0;i<12;i++){
+			alpha_[i] = alpha[i];
+		}
+	}
 
 	template <typename T>
 	bool operator()(const T* const par, T* residual) const {
@@ -149,12 +214,12 @@ struct ForwardKinematics {
 	}
 
 private:
-	const double* alpha_;
+	double alpha_[12];
 	const int legIndex_;
 };
 
 struct KinResidual {
-	KinResidual(const double* alpha, int legIndex):alpha_(alpha),legIndex_(legIndex),forwardKinematics_(alpha,legIndex){}
+	KinResidual(const double* alpha, int legIndex):legIndex_(legIndex),forwardKinematics_(alpha,legIndex){}
 
 	template <typename T>
 	bool operator()(const T* const r, const T* const q, const T* const p, const T* const I_r_IB, const T* const q_BI, const T* const par, T* residual) const {
@@ -176,7 +241,6 @@ struct KinResidual {
 	}
 
 private:
-	const double* alpha_;
 	const int legIndex_;
 	ForwardKinematics forwardKinematics_;
 };
@@ -242,8 +306,124 @@ private:
 	const double sigma2_;
 };
 
+/*! Prior factor resulting from marginalizing the states that slid out of the
+ * window, linear residual J*dx + r0 where dx is the error of the boundary
+ * state (r,v,a,q,w) with respect to the linearization point. The attitude
+ * error is vec(q*q0^-1), the local coordinate of the quaternion
+ * parameterization (half rotation vector) in which J was marginalized */
+class MarginalizationPrior : public ceres::SizedCostFunction<15,3,3,3,4,3> {
+public:
+	EIGEN_MAKE_ALIGNED_OPERATOR_NEW
+	MarginalizationPrior(const Eigen::Matrix<double,15,15>& J,const Eigen::Matrix<double,15,1>& r0,
+			const double* r,const double* v,const double* a,const double* q,const double* w): J_(J),r0_(r0){
+		for(int i=0;i<3;i++){
+			r_[i] = r[i];
+			v_[i] = v[i];
+			a_[i] = a[i];
+			w_[i] = w[i];
+		}
+		q0inv_[0] = q[0];
+		q0inv_[1] = -q[1];
+		q0inv_[2] = -q[2];
+		q0inv_[3] = -q[3];
+		// Jacobian of vec(q*q0^-1) with respect to q (constant, given q0)
+		Q_ << q0inv_[1], q0inv_[0], q0inv_[3], -q0inv_[2],
+			  q0inv_[2], -q0inv_[3], q0inv_[0], q0inv_[1],
+			  q0inv_[3], q0inv_[2], -q0inv_[1], q0inv_[0];
+	}
+	virtual ~MarginalizationPrior(){}
+
+	virtual bool Evaluate(double const* const* parameters, double* residuals, double** jacobians) const {
+		Eigen::Matrix<double,15,1> dx;
+		for(int i=0;i<3;i++){
+			dx(i) = parameters[0][i]-r_[i];
+			dx(3+i) = parameters[1][i]-v_[i];
+			dx(6+i) = parameters[2][i]-a_[i];
+			dx(12+i) = parameters[4][i]-w_[i];
+		}
+		double qe[4];
+		ceres::QuaternionProduct(parameters[3],q0inv_,qe);
+		dx(9) = qe[1];
+		dx(10) = qe[2];
+		dx(11) = qe[3];
+		Eigen::Matrix<double,15,1> res = J_*dx+r0_;
+		for(int i=0;i<15;i++) residuals[i] = res(i);
+		if(jacobians != NULL){
+			for(int k=0;k<5;k++){
+				if(jacobians[k] != NULL){
+					if(k==3){
+						Eigen::Matrix<double,15,4> Jq = J_.block(0,9,15,3)*Q_;
+						for(int i=0;i<15;i++)
+							for(int j=0;j<4;j++)
+								jacobians[k][4*i+j] = Jq(i,j);
+					} else {
+						int off = (k<3) ? 3*k : 12;
+						for(int i=0;i<15;i++)
+							for(int j=0;j<3;j++)
+								jacobians[k][3*i+j] = J_(i,off+j);
+					}
+				}
+			}
+		}
+		return true;
+	}
+
+private:
+	Eigen::Matrix<double,15,15> J_;
+	Eigen::Matrix<double,15,1> r0_;
+	Eigen::Matrix<double,3,4> Q_;
+	double r_[3];
+	double v_[3];
+	double a_[3];
+	double w_[3];
+	double q0inv_[4];
+};
+
 namespace LSE {
 
+/*! Bookkeeping for the persistent Ceres problem used in incremental mode */
+struct RobotCalibration::Incremental{
+	Incremental(){
+		pProblem_ = NULL;
+		pQuatPar_ = NULL;
+		NAlloc_ = 0;
+		tNewest_ = 0;
+		mbInitialized_ = false;
+		mbParQBISet_ = false;
+		mbParQVWSet_ = false;
+		mbParQCISet_ = false;
+		mbBiasesSet_ = false;
+	}
+	~Incremental(){
+		delete pProblem_;
+	}
+	/*! Persistent problem (owns the cost functions and the parameterization) */
+	Problem* pProblem_;
+	/*! Quaternion parameterization shared by all attitude blocks */
+	ceres::LocalParameterization* pQuatPar_;
+	/*! Slots of PB_states_ currently part of the problem (oldest first) */
+	std::deque<int> active_;
+	/*! Currently unused slots of PB_states_ */
+	std::deque<int> free_;
+	/*! Per-slot flag whether the quaternion parameterization is already set */
+	std::vector<bool> mbQuatParSet_;
+	/*! Allocated capacity of PB_states_ */
+	int NAlloc_;
+	/*! Time of the newest state in the problem */
+	double tNewest_;
+	/*! Flag whether the problem has been built */
+	bool mbInitialized_;
+	/*! Flags whether parameterizations/constants of the global blocks are set */
+	bool mbParQBISet_;
+	bool mbParQVWSet_;
+	bool mbParQCISet_;
+	bool mbBiasesSet_;
+	/*! Persistent iterator for the kinematic measurements */
+	MeasStorage<EncMeas,LSE_MEAS_N>::iterator itEnc_;
+	/*! Persistent iterator for the pose sensor measurements */
+	MeasStorage<PosMeas,LSE_MEAS_N>::iterator itPos_;
+};
+
 RobotCalibration::RobotCalibration(Manager* pManager,const char* pFilename){
 	pManager_ = pManager;
 
@@ -256,12 +436,16 @@ RobotCalibration::RobotCalibration(Manager* pManager,const char* pFilename){
 	mbUseImu_ = 0;
 	mbUseEnc_ = 0;
 	mbUsePos_ = 0;
+	mbIncremental_ = 0;
+	numThreads_ = 7;
+	linearSolver_ = "SPARSE_NORMAL_CHOLESKY";
 
 	loadParam(pFilename);
 
 	// Initialize parameter blocks
 	N_=1;
 	PB_states_ = new state;
+	pInc_ = new Incremental();
 
 	// This is the square root of the final value!!!
 	Wr_ = 0.01*Eigen::Matrix3d::Identity();
@@ -270,11 +454,31 @@ RobotCalibration::RobotCalibration(Manager* pManager,const char* pFilename){
 }
 
 RobotCalibration::~RobotCalibration(){
+	delete pInc_;
 	delete[] PB_states_;
 }
 
+/*! Applies the configured threading and linear-solver settings
+ * @param[out]	options	ceres solver options
+ */
+static void setSolverOptions(Solver::Options& options,const int& numThreads,const std::string& linearSolver){
+	options.num_threads = numThreads;
+	options.num_linear_solver_threads = numThreads;
+	options.linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;
+	if(linearSolver=="DENSE_QR"){
+		options.linear_solver_type = ceres::DENSE_QR;
+	} else if(linearSolver=="DENSE_NORMAL_CHOLESKY"){
+		options.linear_solver_type = ceres::DENSE_NORMAL_CHOLESKY;
+	} else if(linearSolver=="CGNR"){
+		options.linear_solver_type = ceres::CGNR;
+	} else if(linearSolver!="SPARSE_NORMAL_CHOLESKY"){
+		std::cout << "Unknown linear solver '" << linearSolver << "', using SPARSE_NORMAL_CHOLESKY" << std::endl;
+	}
+}
+
 int RobotCalibration::calibrateRobot(const double& t,const double& T){
 	// Check conditions
+	if(mbIncremental_) return calibrateRobotIncremental(t,T);
 
 	// Initialize and recheck
 	if(initialize(t,T)==0) return 0;
@@ -352,7 +556,7 @@ int RobotCalibration::calibrateRobot(const double& t,const double& T){
 
 		mpDouble = itImu_->second.w_.data();
 		sigma = std::sqrt(pManager_->Rw_(0,0)/dt);
-		cost_function = new AutoDiffCostFunction<GyrResidual, 3, 3, 3>(new GyrResidual(mpDouble,sigma));
+		cost_function = new GyrResidual(mpDouble,sigma);
 		problem.AddResidualBlock(cost_function, NULL, PB_states_[i].w_, PB_bw_);
 		mpDouble = itImu_->second.f_.data();
 		sigma = std::sqrt(pManager_->Rf_(0,0)/dt);
@@ -361,10 +565,10 @@ int RobotCalibration::calibrateRobot(const double& t,const double& T){
 		itImu_++;
 
 		sigma = std::sqrt(Wr_(0,0)*dt);
-		cost_function = new AutoDiffCostFunction<PosResidual, 3, 3, 3, 3>(new PosResidual(dt,sigma));
+		cost_function = new PosResidual(dt,sigma);
 		problem.AddResidualBlock(cost_function, NULL, PB_states_[i].r_, PB_states_[i+1].r_, PB_states_[i].v_);
 		sigma = std::sqrt(Wv_(0,0)*dt);
-		cost_function = new AutoDiffCostFunction<VelResidual, 3, 3, 3, 3>(new VelResidual(dt,sigma));
+		cost_function = new VelResidual(dt,sigma);
 		problem.AddResidualBlock(cost_function, NULL, PB_states_[i].v_, PB_states_[i+1].v_, PB_states_[i].a_);
 		sigma = std::sqrt(Wq_(0,0)*dt);
 		cost_function = new AutoDiffCostFunction<RotResidual, 3, 4, 4, 3>(new RotResidual(dt,sigma));
@@ -384,7 +588,7 @@ int RobotCalibration::calibrateRobot(const double& t,const double& T){
 	for(int i=0;i<N_;i++){
 		while(itEnc_->first < itImu_->first){
 			mpDouble = itEnc_->second.e_.data();
-			for(int j=0;j<4;j++){
+			for(int j=0;j<LSE_N_LEG;j++){
 				sigma = 1.0;
 				cost_function = new AutoDiffCostFunction<KinResidual, 3, 3, 4, 3, 3, 4, 17>(new KinResidual(mpDouble,j));
 				problem.AddResidualBlock(cost_function, NULL, PB_states_[i].r_, PB_states_[i].q_, &PB_p_[j*3], PB_IrIB_, PB_qBI_, PB_pkin_);
@@ -435,9 +639,7 @@ int RobotCalibration::calibrateRobot(const double& t,const double& T){
 	options.trust_region_strategy_type = ceres::LEVENBERG_MARQUARDT;
 //	options.trust_region_strategy_type = ceres::DOGLEG;
 	options.dogleg_type = ceres::TRADITIONAL_DOGLEG;
-	options.num_threads = 7;
-	options.linear_solver_type = ceres::SPARSE_NORMAL_CHOLESKY;
-	options.num_linear_solver_threads = 7;
+	setSolverOptions(options,numThreads_,linearSolver_);
 	Solver::Summary summary;
 	Solve(options, &problem, &summary);
 
@@ -449,6 +651,394 @@ int RobotCalibration::calibrateRobot(const double& t,const double& T){
 	return 1;
 }
 
+int RobotCalibration::calibrateRobotIncremental(const double& t,const double& T){
+	// Initialize and recheck
+	if(initialize(t,T)==0) return 0;
+
+	CostFunction* cost_function;
+	const double* mpDouble;
+	double sigma = 1;
+	double dt = 0;
+
+	// Build the persistent problem on the first call
+	if(!pInc_->mbInitialized_){
+		// Count the states in the window and allocate the slot ring (with
+		// slack such that a forward sliding window does not outgrow it)
+		itImu_ =  itImu1_;
+		N_ = 1;
+		while(itImu_ != itImu2_){
+			itImu_++;
+			N_++;
+		}
+		pInc_->NAlloc_ = 2*N_;
+		delete[] PB_states_;
+		PB_states_ = new state[pInc_->NAlloc_];
+		pInc_->active_.clear();
+		pInc_->free_.clear();
+		pInc_->mbQuatParSet_.assign(pInc_->NAlloc_,false);
+		for(int i=0;i<pInc_->NAlloc_;i++){
+			pInc_->free_.push_back(i);
+		}
+
+		// Initialize the global parameter blocks (kept warm on later calls)
+		PB_IrIB_[0] = -pManager_->B_r_BI_(0);
+		PB_IrIB_[1] = -pManager_->B_r_BI_(1);
+		PB_IrIB_[2] = -pManager_->B_r_BI_(2);
+		PB_qBI_[0] = 1;
+		PB_qBI_[1] = 0;
+		PB_qBI_[2] = 0;
+		PB_qBI_[3] = 0;
+		for(int i=0;i<12;i++){
+			PB_p_[i] = 0;
+		}
+		PB_pkin_[0] = 0.2525;
+		PB_pkin_[1] = 0.185;
+		PB_pkin_[2] = -0.0685;
+		PB_pkin_[3] = -0.2;
+		PB_pkin_[4] = -0.235;
+		for(int i=0;i<12;i++){
+			PB_pkin_[i+5] = 0;
+		}
+		PB_WrWV_[0] = 0;
+		PB_WrWV_[1] = 0;
+		PB_WrWV_[2] = 0;
+		PB_qVW_[0] = 1;
+		PB_qVW_[1] = 0;
+		PB_qVW_[2] = 0;
+		PB_qVW_[3] = 0;
+		PB_IrIC_[0] = 0;
+		PB_IrIC_[1] = 0;
+		PB_IrIC_[2] = 0;
+		PB_qCI_[0] = 1;
+		PB_qCI_[1] = 0;
+		PB_qCI_[2] = 0;
+		PB_qCI_[3] = 0;
+		PB_bw_[0] = 0;
+		PB_bw_[1] = 0;
+		PB_bw_[2] = 0;
+		PB_bf_[0] = 0;
+		PB_bf_[1] = 0;
+		PB_bf_[2] = 0;
+
+		// Build the problem (fast removal such that sliding out is cheap)
+		Problem::Options problemOptions;
+		problemOptions.enable_fast_removal = true;
+		pInc_->pProblem_ = new Problem(problemOptions);
+		pInc_->pQuatPar_ = new ceres::QuaternionParameterization;
+		pInc_->itEnc_ = pManager_->encMeasList_.lower_bound(t1_-pManager_->tEnc_);
+		pInc_->itPos_ = pManager_->posMeasList_.lower_bound(t1_-pManager_->tPos_);
+		pInc_->mbInitialized_ = true;
+	}
+
+	// Fold the states that slid out of the window into a prior factor on the
+	// window boundary, then remove them (dependent residual blocks are
+	// removed together with the parameter blocks)
+	std::vector<int> departing;
+	while(pInc_->active_.size()>1 && PB_states_[pInc_->active_.front()].t_ < t1_){
+		departing.push_back(pInc_->active_.front());
+		pInc_->active_.pop_front();
+	}
+	if(!departing.empty()){
+		marginalize(departing);
+		for(unsigned int i=0;i<departing.size();i++){
+			int slot = departing[i];
+			if(pInc_->pProblem_->HasParameterBlock(PB_states_[slot].r_)) pInc_->pProblem_->RemoveParameterBlock(PB_states_[slot].r_);
+			if(pInc_->pProblem_->HasParameterBlock(PB_states_[slot].v_)) pInc_->pProblem_->RemoveParameterBlock(PB_states_[slot].v_);
+			if(pInc_->pProblem_->HasParameterBlock(PB_states_[slot].a_)) pInc_->pProblem_->RemoveParameterBlock(PB_states_[slot].a_);
+			if(pInc_->pProblem_->HasParameterBlock(PB_states_[slot].q_)) pInc_->pProblem_->RemoveParameterBlock(PB_states_[slot].q_);
+			if(pInc_->pProblem_->HasParameterBlock(PB_states_[slot].w_)) pInc_->pProblem_->RemoveParameterBlock(PB_states_[slot].w_);
+			pInc_->mbQuatParSet_[slot] = false;
+			pInc_->free_.push_back(slot);
+		}
+	}
+
+	// Append states and residuals for the new IMU samples
+	MeasStorage<ImuMeas,LSE_MEAS_N>::iterator itImuPrev;
+	if(pInc_->active_.empty()){
+		itImu_ = itImu1_;
+	} else {
+		itImu_ = pManager_->imuMeasList_.upper_bound(pInc_->tNewest_);
+		itImuPrev = pManager_->imuMeasList_.lower_bound(pInc_->tNewest_);
+	}
+	while(itImu_ != pManager_->imuMeasList_.end() && itImu_->first <= itImu2_->first){
+		if(pInc_->free_.empty()){
+			// Slot ring outgrown (window got larger), rebuild from scratch
+			resetIncremental();
+			return calibrateRobotIncremental(t,T);
+		}
+		int slot = pInc_->free_.front();
+		pInc_->free_.pop_front();
+		PB_states_[slot] = state();
+		PB_states_[slot].t_ = itImu_->first;
+
+		if(!pInc_->active_.empty()){
+			int prev = pInc_->active_.back();
+
+			// Seed the new state with its predecessor (warm start)
+			for(int j=0;j<3;j++){
+				PB_states_[slot].r_[j] = PB_states_[prev].r_[j];
+				PB_states_[slot].v_[j] = PB_states_[prev].v_[j];
+				PB_states_[slot].a_[j] = PB_states_[prev].a_[j];
+				PB_states_[slot].w_[j] = PB_states_[prev].w_[j];
+			}
+			for(int j=0;j<4;j++){
+				PB_states_[slot].q_[j] = PB_states_[prev].q_[j];
+			}
+
+			// Calculate timestep
+			dt = PB_states_[slot].t_-PB_states_[prev].t_;
+			if(dt<0.001) dt = 0.001;
+
+			mpDouble = itImuPrev->second.w_.data();
+			sigma = std::sqrt(pManager_->Rw_(0,0)/dt);
+			cost_function = new GyrResidual(mpDouble,sigma);
+			pInc_->pProblem_->AddResidualBlock(cost_function, NULL, PB_states_[prev].w_, PB_bw_);
+			mpDouble = itImuPrev->second.f_.data();
+			sigma = std::sqrt(pManager_->Rf_(0,0)/dt);
+			cost_function = new AutoDiffCostFunction<AccResidual, 3, 4, 3, 3>(new AccResidual(mpDouble,sigma));
+			pInc_->pProblem_->AddResidualBlock(cost_function, NULL, PB_states_[prev].q_, PB_states_[prev].a_, PB_bf_);
+
+			sigma = std::sqrt(Wr_(0,0)*dt);
+			cost_function = new PosResidual(dt,sigma);
+			pInc_->pProblem_->AddResidualBlock(cost_function, NULL, PB_states_[prev].r_, PB_states_[slot].r_, PB_states_[prev].v_);
+			sigma = std::sqrt(Wv_(0,0)*dt);
+			cost_function = new VelResidual(dt,sigma);
+			pInc_->pProblem_->AddResidualBlock(cost_function, NULL, PB_states_[prev].v_, PB_states_[slot].v_, PB_states_[prev].a_);
+			sigma = std::sqrt(Wq_(0,0)*dt);
+			cost_function = new AutoDiffCostFunction<RotResidual, 3, 4, 4, 3>(new RotResidual(dt,sigma));
+			pInc_->pProblem_->AddResidualBlock(cost_function, NULL, PB_states_[prev].q_, PB_states_[slot].q_, PB_states_[prev].w_);
+
+			// Both attitude blocks are part of the problem now
+			if(!pInc_->mbQuatParSet_[prev]){
+				pInc_->pProblem_->SetParameterization(PB_states_[prev].q_,pInc_->pQuatPar_);
+				pInc_->mbQuatParSet_[prev] = true;
+			}
+			if(!pInc_->mbQuatParSet_[slot]){
+				pInc_->pProblem_->SetParameterization(PB_states_[slot].q_,pInc_->pQuatPar_);
+				pInc_->mbQuatParSet_[slot] = true;
+			}
+		}
+		pInc_->active_.push_back(slot);
+		pInc_->tNewest_ = PB_states_[slot].t_;
+
+		// Attach the kinematic measurements preceding this state
+		while(pInc_->itEnc_ != pManager_->encMeasList_.end() && pInc_->itEnc_->first < PB_states_[slot].t_){
+			mpDouble = pInc_->itEnc_->second.e_.data();
+			for(int j=0;j<LSE_N_LEG;j++){
+				cost_function = new AutoDiffCostFunction<KinResidual, 3, 3, 4, 3, 3, 4, 17>(new KinResidual(mpDouble,j));
+				pInc_->pProblem_->AddResidualBlock(cost_function, NULL, PB_states_[slot].r_, PB_states_[slot].q_, &PB_p_[j*3], PB_IrIB_, PB_qBI_, PB_pkin_);
+			}
+			pInc_->itEnc_++;
+		}
+
+		// Attach the 6DOF pose measurements preceding this state
+		while(pInc_->itPos_ != pManager_->posMeasList_.end() && pInc_->itPos_->first < PB_states_[slot].t_){
+			double sigma1 = std::sqrt(pManager_->Rposq_(0,0));
+			double sigma2 = std::sqrt(pManager_->Rposr_(0,0));
+			cost_function = new AutoDiffCostFunction<PosMeasResidual, 6, 3, 4, 3, 4, 3, 4>(new PosMeasResidual(&pInc_->itPos_->second,sigma1,sigma2));
+			pInc_->pProblem_->AddResidualBlock(cost_function, NULL, PB_states_[slot].r_, PB_states_[slot].q_, PB_WrWV_, PB_qVW_, PB_IrIC_, PB_qCI_);
+			pInc_->itPos_++;
+		}
+
+		// Kinematic/pose residuals may have introduced the attitude block
+		if(!pInc_->mbQuatParSet_[slot] && pInc_->pProblem_->HasParameterBlock(PB_states_[slot].q_)){
+			pInc_->pProblem_->SetParameterization(PB_states_[slot].q_,pInc_->pQuatPar_);
+			pInc_->mbQuatParSet_[slot] = true;
+		}
+
+		itImuPrev = itImu_;
+		itImu_++;
+	}
+
+	// Global blocks enter the problem with their first residual
+	if(!pInc_->mbBiasesSet_ && pInc_->pProblem_->HasParameterBlock(PB_bw_) && pInc_->pProblem_->HasParameterBlock(PB_bf_)){
+		pInc_->pProblem_->SetParameterBlockConstant(PB_bw_);
+		pInc_->pProblem_->SetParameterBlockConstant(PB_bf_);
+		pInc_->mbBiasesSet_ = true;
+	}
+	if(!pInc_->mbParQBISet_ && pInc_->pProblem_->HasParameterBlock(PB_qBI_)){
+		pInc_->pProblem_->SetParameterization(PB_qBI_,pInc_->pQuatPar_);
+		pInc_->mbParQBISet_ = true;
+	}
+	if(!pInc_->mbParQVWSet_ && pInc_->pProblem_->HasParameterBlock(PB_qVW_)){
+		pInc_->pProblem_->SetParameterization(PB_qVW_,pInc_->pQuatPar_);
+		pInc_->mbParQVWSet_ = true;
+	}
+	if(!pInc_->mbParQCISet_ && pInc_->pProblem_->HasParameterBlock(PB_qCI_)){
+		pInc_->pProblem_->SetParameterization(PB_qCI_,pInc_->pQuatPar_);
+		pInc_->mbParQCISet_ = true;
+	}
+
+	N_ = (int)pInc_->active_.size();
+	std::cout << "Number of States: " << N_ << std::endl;
+
+	// Run the solver!
+	Solver::Options options;
+	options.minimizer_progress_to_stdout = true;
+	options.max_num_iterations = 50;
+	options.minimizer_type = ceres::TRUST_REGION;
+	options.trust_region_strategy_type = ceres::LEVENBERG_MARQUARDT;
+	options.dogleg_type = ceres::TRADITIONAL_DOGLEG;
+	setSolverOptions(options,numThreads_,linearSolver_);
+	Solver::Summary summary;
+	Solve(options, pInc_->pProblem_, &summary);
+
+	std::cout << summary.BriefReport() << "\n";
+	std::cout << PB_WrWV_[0] << "\t" << PB_WrWV_[1] << "\t" << PB_WrWV_[2] << "\t" << PB_qVW_[0] << "\t" << PB_qVW_[1] << "\t" << PB_qVW_[2] << "\t" << PB_qVW_[3] << std::endl;
+	std::cout << PB_IrIC_[0] << "\t" << PB_IrIC_[1] << "\t" << PB_IrIC_[2] << "\t" << PB_qCI_[0] << "\t" << PB_qCI_[1] << "\t" << PB_qCI_[2] << "\t" << PB_qCI_[3] << std::endl;
+	std::cout << PB_IrIB_[0] << "\t" << PB_IrIB_[1] << "\t" << PB_IrIB_[2] << "\t" << PB_qBI_[0] << "\t" << PB_qBI_[1] << "\t" << PB_qBI_[2] << "\t" << PB_qBI_[3] << std::endl;
+	std::cout << PB_pkin_[0] << "\t" << PB_pkin_[1] << "\t" << PB_pkin_[2] << "\t" << PB_pkin_[3] << "\t" << PB_pkin_[4] << std::endl;
+	return 1;
+}
+
+void RobotCalibration::marginalize(const std::vector<int>& departing){
+	int boundary = pInc_->active_.front();
+
+	// Collect the residual blocks attached to the departing states (includes
+	// the prior of the previous marginalization if its anchor slid out)
+	std::set<ceres::ResidualBlockId> resSet;
+	std::vector<ceres::ResidualBlockId> attached;
+	for(unsigned int i=0;i<departing.size();i++){
+		double* blocks[5] = {PB_states_[departing[i]].r_,PB_states_[departing[i]].v_,PB_states_[departing[i]].a_,PB_states_[departing[i]].q_,PB_states_[departing[i]].w_};
+		for(int j=0;j<5;j++){
+			if(pInc_->pProblem_->HasParameterBlock(blocks[j])){
+				pInc_->pProblem_->GetResidualBlocksForParameterBlock(blocks[j],&attached);
+				resSet.insert(attached.begin(),attached.end());
+			}
+		}
+	}
+	if(resSet.empty()) return;
+
+	// Evaluate these residuals, departing blocks first, the boundary state
+	// last, all other involved parameter blocks (calibration parameters and
+	// biases) are kept fixed at their current values
+	Problem::EvaluateOptions evalOptions;
+	evalOptions.residual_blocks.assign(resSet.begin(),resSet.end());
+	std::vector<bool> isQuat;
+	int keptPresent[5];
+	int ambTotal = 0;
+	for(unsigned int i=0;i<=departing.size();i++){
+		int slot = (i<departing.size()) ? departing[i] : boundary;
+		double* blocks[5] = {PB_states_[slot].r_,PB_states_[slot].v_,PB_states_[slot].a_,PB_states_[slot].q_,PB_states_[slot].w_};
+		for(int j=0;j<5;j++){
+			bool present = pInc_->pProblem_->HasParameterBlock(blocks[j]);
+			if(i==departing.size()) keptPresent[j] = present;
+			if(present){
+				evalOptions.parameter_blocks.push_back(blocks[j]);
+				isQuat.push_back(j==3);
+				ambTotal += (j==3) ? 4 : 3;
+			}
+		}
+	}
+	double cost;
+	std::vector<double> residuals;
+	ceres::CRSMatrix crs;
+	if(!pInc_->pProblem_->Evaluate(evalOptions,&cost,&residuals,NULL,&crs)) return;
+	if(crs.num_cols != ambTotal) return;
+
+	// Assemble the dense Jacobian and map it onto the error state (identity
+	// for the vector blocks, the lift Jacobian of the parameterization for
+	// the attitude blocks)
+	Eigen::MatrixXd Jamb = Eigen::MatrixXd::Zero(crs.num_rows,crs.num_cols);
+	for(int i=0;i<crs.num_rows;i++){
+		for(int j=crs.rows[i];j<crs.rows[i+1];j++){
+			Jamb(i,crs.cols[j]) = crs.values[j];
+		}
+	}
+	int nB = (int)evalOptions.parameter_blocks.size();
+	Eigen::MatrixXd T = Eigen::MatrixXd::Zero(crs.num_cols,3*nB);
+	int amb = 0;
+	double Jq[12];
+	for(int i=0;i<nB;i++){
+		if(isQuat[i]){
+			pInc_->pQuatPar_->ComputeJacobian(evalOptions.parameter_blocks[i],Jq);
+			for(int r=0;r<4;r++){
+				for(int c=0;c<3;c++){
+					T(amb+r,3*i+c) = Jq[3*r+c];
+				}
+			}
+			amb += 4;
+		} else {
+			T.block(amb,3*i,3,3).setIdentity();
+			amb += 3;
+		}
+	}
+	Eigen::MatrixXd J = Jamb*T;
+	Eigen::VectorXd r(residuals.size());
+	for(unsigned int i=0;i<residuals.size();i++) r(i) = residuals[i];
+
+	// Schur complement of the accumulated information on the boundary state
+	Eigen::MatrixXd H = J.transpose()*J;
+	Eigen::VectorXd b = J.transpose()*r;
+	int keptCount = keptPresent[0]+keptPresent[1]+keptPresent[2]+keptPresent[3]+keptPresent[4];
+	int m = 3*(nB-keptCount);
+	int k = 3*keptCount;
+	if(m<=0 || k<=0) return;
+	Eigen::LDLT<Eigen::MatrixXd> ldlt(H.block(0,0,m,m));
+	if(ldlt.info()!=Eigen::Success) return;
+	Eigen::MatrixXd Hs = H.block(m,m,k,k) - H.block(m,0,k,m)*ldlt.solve(H.block(0,m,m,k));
+	Eigen::VectorXd bs = b.segment(m,k) - H.block(m,0,k,m)*ldlt.solve(b.segment(0,m));
+
+	// Scatter onto the full boundary error state (zero information on blocks
+	// which were not yet part of the problem)
+	Eigen::Matrix<double,15,15> Hk;
+	Eigen::Matrix<double,15,1> bk;
+	Hk.setZero();
+	bk.setZero();
+	int rowOf[5];
+	int ik = 0;
+	for(int j=0;j<5;j++){
+		rowOf[j] = keptPresent[j] ? ik : -1;
+		if(keptPresent[j]) ik += 3;
+	}
+	for(int j1=0;j1<5;j1++){
+		if(rowOf[j1]<0) continue;
+		bk.block(3*j1,0,3,1) = bs.segment(rowOf[j1],3);
+		for(int j2=0;j2<5;j2++){
+			if(rowOf[j2]<0) continue;
+			Hk.block(3*j1,3*j2,3,3) = Hs.block(rowOf[j1],rowOf[j2],3,3);
+		}
+	}
+
+	// Square root factorization of the prior (eigenvalues below threshold
+	// carry no information and are dropped)
+	Eigen::SelfAdjointEigenSolver<Eigen::Matrix<double,15,15> > es(Hk);
+	Eigen::Matrix<double,15,1> eig = es.eigenvalues();
+	Eigen::Matrix<double,15,1> Vtb = es.eigenvectors().transpose()*bk;
+	Eigen::Matrix<double,15,15> Jp;
+	Eigen::Matrix<double,15,1> r0;
+	for(int i=0;i<15;i++){
+		if(eig(i)>1e-10){
+			Jp.row(i) = std::sqrt(eig(i))*es.eigenvectors().col(i).transpose();
+			r0(i) = Vtb(i)/std::sqrt(eig(i));
+		} else {
+			Jp.row(i).setZero();
+			r0(i) = 0;
+		}
+	}
+
+	// Attach the prior to the boundary state
+	CostFunction* cost_function = new MarginalizationPrior(Jp,r0,PB_states_[boundary].r_,PB_states_[boundary].v_,PB_states_[boundary].a_,PB_states_[boundary].q_,PB_states_[boundary].w_);
+	pInc_->pProblem_->AddResidualBlock(cost_function, NULL, PB_states_[boundary].r_, PB_states_[boundary].v_, PB_states_[boundary].a_, PB_states_[boundary].q_, PB_states_[boundary].w_);
+	if(!pInc_->mbQuatParSet_[boundary]){
+		pInc_->pProblem_->SetParameterization(PB_states_[boundary].q_,pInc_->pQuatPar_);
+		pInc_->mbQuatParSet_[boundary] = true;
+	}
+}
+
+void RobotCalibration::resetIncremental(){
+	delete pInc_->pProblem_;
+	pInc_->pProblem_ = NULL;
+	pInc_->pQuatPar_ = NULL;
+	pInc_->active_.clear();
+	pInc_->free_.clear();
+	pInc_->mbInitialized_ = false;
+	pInc_->mbParQBISet_ = false;
+	pInc_->mbParQVWSet_ = false;
+	pInc_->mbParQCISet_ = false;
+	pInc_->mbBiasesSet_ = false;
+}
+
 int RobotCalibration::initialize(const double& t,const double& T){
 	t1_ = t-T;
 	t2_ = t;
@@ -522,11 +1112,11 @@ const RobotCalibration::state* RobotCalibration::getBatch(){
 
 void RobotCalibration::loadParam(const char* pFilename){
 	// Open parameter file
-	TiXmlDocument doc(pFilename);
-	if (!doc.LoadFile()) return;
+	TiXmlDocument* doc = ParamCache::get(pFilename);
+	if (doc==NULL) return;
 
 	// Define handles and elements
-	TiXmlHandle hDoc(&doc);
+	TiXmlHandle hDoc(doc);
 	TiXmlElement* pElem;
 	TiXmlHandle hRoot(0);
 
@@ -540,6 +1130,13 @@ void RobotCalibration::loadParam(const char* pFilename){
 		pElem=hRoot.FirstChild("RobotCalibrationSettings").Element();
 		if (pElem){
 			pElem->QueryDoubleAttribute("dt", &dt_);
+			if(pElem->QueryIntAttribute("incremental", &mInt)==TIXML_SUCCESS) mbIncremental_ = mInt;
+		}
+
+		pElem=hRoot.FirstChild("RobotCalibrationSettings").FirstChild("Solver").Element();
+		if (pElem){
+			pElem->QueryIntAttribute("numThreads", &numThreads_);
+			if(pElem->Attribute("linearSolver")!=NULL) linearSolver_ = pElem->Attribute("linearSolver");
 		}
 
 		pElem=hRoot.FirstChild("RobotCalibrationSettings").FirstChild("IMU").Element();
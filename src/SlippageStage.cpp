@@ -0,0 +1,106 @@
+/*!
+* @file 	SlippageStage.cpp
+* @author 	Michael Blösch
+* @date		10.10.2012
+ */
+
+#include "SlippageStage.hpp"
+#include "ParamCache.hpp"
+#include "tinyxml.h"
+
+namespace LSE {
+
+SlippageStage::SlippageStage(const char* pFilename){
+	// Parameters
+	rate_ = 0;
+	slipRatioTh_ = 0.5;
+
+	loadParam(pFilename);
+	mbEnabled_ = rate_>0;
+
+	reset();
+}
+
+SlippageStage::~SlippageStage(){
+}
+
+bool SlippageStage::isEnabled() const{
+	return mbEnabled_;
+}
+
+void SlippageStage::accumulate(const double& t,const CF& CFC,const SlippageDetection& s){
+	// Restart the window on rollbacks, the statistics would double-count
+	if(t < lastRefresh_) reset();
+
+	// Contact samples flagged as slipping got rejected by the outlier
+	// detection, their slip velocity is the kinematic innovation
+	for(int i=0;i<LSE_N_LEG;i++){
+		if(CFC[i]>0){
+			cntContact_[i]++;
+			if(s.flag_[i]==0){
+				cntSlip_[i]++;
+				sumSlip_.col(i) += s.slip_.col(i);
+			}
+		}
+	}
+
+	if(t-lastRefresh_ >= 1/rate_) refresh(t);
+}
+
+void SlippageStage::fill(SlippageDetection& s) const{
+	for(int i=0;i<LSE_N_LEG;i++){
+		s.flagFiltered_[i] = flagFiltered_[i];
+	}
+	s.slipAxis_ = slipAxis_;
+}
+
+void SlippageStage::reset(){
+	sumSlip_.setZero();
+	for(int i=0;i<LSE_N_LEG;i++){
+		cntContact_[i] = 0;
+		cntSlip_[i] = 0;
+		flagFiltered_[i] = 0;
+	}
+	slipAxis_.setZero();
+	lastRefresh_ = 0;
+}
+
+void SlippageStage::refresh(const double& t){
+	for(int i=0;i<LSE_N_LEG;i++){
+		flagFiltered_[i] = cntContact_[i]>0 && cntSlip_[i] >= slipRatioTh_*cntContact_[i];
+		if(cntSlip_[i]>0 && sumSlip_.col(i).norm()>1e-10){
+			slipAxis_.col(i) = sumSlip_.col(i)/sumSlip_.col(i).norm();
+		} else {
+			slipAxis_.col(i).setZero();
+		}
+		cntContact_[i] = 0;
+		cntSlip_[i] = 0;
+	}
+	sumSlip_.setZero();
+	lastRefresh_ = t;
+}
+
+void SlippageStage::loadParam(const char* pFilename){
+	// Open parameter file
+	TiXmlDocument* doc = ParamCache::get(pFilename);
+	if (doc==NULL) return;
+
+	// Define handles and elements
+	TiXmlHandle hDoc(doc);
+	TiXmlElement* pElem;
+	TiXmlHandle hRoot(0);
+
+	// Get root
+	pElem=hDoc.FirstChildElement("LeggedStateEstimator").Element();
+	if (pElem){
+		hRoot=TiXmlHandle(pElem);
+
+		pElem=hRoot.FirstChild("SlippageSettings").Element();
+		if (pElem){
+			pElem->QueryDoubleAttribute("rate", &rate_);
+			pElem->QueryDoubleAttribute("slipRatioThreshold", &slipRatioTh_);
+		}
+	}
+}
+
+}
@@ -0,0 +1,198 @@
+/*!
+* @file 	SmootherOCEKF.cpp
+* @author 	Michael Blösch
+* @date		10.10.2012
+ */
+
+#include "SmootherOCEKF.hpp"
+#include "ParamCache.hpp"
+#include "Manager.hpp"
+#include "tinyxml.h"
+#include <thread>
+
+namespace LSE {
+
+SmootherOCEKF::SmootherOCEKF(Manager* pManager,const char* pFilename){
+	pManager_ = pManager;
+	pFilter_ = new FilterOCEKF(pManager,pFilename);
+
+	// Parameters
+	nThreads_ = 4;
+	overlap_ = 64;
+
+	loadParam(pFilename);
+}
+
+SmootherOCEKF::~SmootherOCEKF(){
+	delete pFilter_;
+}
+
+int SmootherOCEKF::smooth(const double& t1,const double& t2){
+	if(t2 <= t1) return 0;
+
+	// Forward pass: the dedicated filter instance reports each correction step
+	// through the recording hooks
+	steps_.clear();
+	pFilter_->resetEstimate(t1);
+	pFilter_->pRecorder_ = this;
+	pFilter_->filterState(pFilter_->xs_,t2);
+	pFilter_->pRecorder_ = NULL;
+	const int N = (int)steps_.size();
+	if(N == 0) return 0;
+
+	// Backward pass, partitioned into parallel chunks
+	int nChunks = nThreads_;
+	if(nChunks < 1) nChunks = 1;
+	if(nChunks > N) nChunks = N;
+	const int len = (N+nChunks-1)/nChunks;
+	if(nChunks == 1){
+		backwardChunk(0,N);
+	} else {
+		std::vector<std::thread> workers(nChunks);
+		for(int c=0;c<nChunks;c++){
+			workers[c] = std::thread(&SmootherOCEKF::backwardChunk,this,c*len,std::min(N,(c+1)*len));
+		}
+		for(int c=0;c<nChunks;c++){
+			workers[c].join();
+		}
+	}
+	return 1;
+}
+
+void SmootherOCEKF::backwardChunk(const int& b,const int& e){
+	// Empty chunks (N not a multiple of the chunk count) must not touch the
+	// seed step, it belongs to the neighboring chunk
+	if(b >= e) return;
+	const int N = (int)steps_.size();
+
+	// Seed above the kept range where possible, the warm-up recursion down to
+	// e lets the chunk forget the filtered (non-smoothed) initialization
+	int start = e-1;
+	if(e < N) start = std::min(N-1,e-1+overlap_);
+
+	// Loop-carried smoothed state, only written back inside the kept range
+	Eigen::Vector3d r = steps_[start].rPost_;
+	Eigen::Vector3d v = steps_[start].vPost_;
+	Rotations::Quat q = steps_[start].qPost_;
+	Eigen::Vector3d bf = steps_[start].bfPost_;
+	Eigen::Vector3d bw = steps_[start].bwPost_;
+	Eigen::Matrix<double,15,15> P = steps_[start].PPost_;
+	if(start < e){
+		steps_[start].rSm_ = r;
+		steps_[start].vSm_ = v;
+		steps_[start].qSm_ = q;
+		steps_[start].bfSm_ = bf;
+		steps_[start].bwSm_ = bw;
+		steps_[start].PSm_ = P;
+	}
+
+	Eigen::Matrix<double,15,15> A;
+	Eigen::Matrix<double,15,15> Pnew;
+	Eigen::Matrix<double,15,1> d;
+	Eigen::Matrix<double,15,1> dx;
+	for(int k=start-1;k>=b;k--){
+		const SmootherStep& nx = steps_[k+1];
+		SmootherStep& cu = steps_[k];
+
+		// Smoother gain
+		A = cu.PPost_*nx.F_.transpose()*nx.PPre_.inverse();
+
+		// Difference between smoothed and predicted state at k+1 (the attitude
+		// part follows the correction convention q = exp(-dq)*qPre)
+		d.block(0,0,3,1) = r-nx.rPre_;
+		d.block(3,0,3,1) = v-nx.vPre_;
+		d.block(6,0,3,1) = -Rotations::quatToRotVec(Rotations::quatL(q)*Rotations::quatInverse(nx.qPre_));
+		d.block(9,0,3,1) = bf-nx.bfPre_;
+		d.block(12,0,3,1) = bw-nx.bwPre_;
+
+		// Smoothed covariance and state at k
+		Pnew = cu.PPost_+A*(P-nx.PPre_)*A.transpose();
+		P = Pnew;
+		dx = A*d;
+		r = cu.rPost_+dx.block(0,0,3,1);
+		v = cu.vPost_+dx.block(3,0,3,1);
+		q = Rotations::quatL(Rotations::rotVecToQuat(-dx.block(6,0,3,1)))*cu.qPost_;
+		q.normalize();
+		bf = cu.bfPost_+dx.block(9,0,3,1);
+		bw = cu.bwPost_+dx.block(12,0,3,1);
+
+		if(k < e){
+			cu.rSm_ = r;
+			cu.vSm_ = v;
+			cu.qSm_ = q;
+			cu.bfSm_ = bf;
+			cu.bwSm_ = bw;
+			cu.PSm_ = P;
+		}
+	}
+}
+
+int SmootherOCEKF::getN() const{
+	return (int)steps_.size();
+}
+
+State SmootherOCEKF::getSmoothed(const int& i){
+	const SmootherStep& s = steps_[i];
+	Eigen::Matrix3d R_WI,R_IB;
+	R_WI = Rotations::quatToRotMat(s.qSm_).transpose();
+	R_IB = Rotations::quatToRotMat(pManager_->q_IB_);
+	State x = State();
+	x.t_ = s.t_;
+	x.r_ = s.rSm_-R_WI*R_IB*pManager_->B_r_BI_;
+	x.v_ = s.vSm_-R_WI*(Rotations::vecToSqew(s.wPost_)*R_IB*pManager_->B_r_BI_);
+	x.q_ = Rotations::quatL(pManager_->q_IB_).transpose()*s.qSm_;
+	x.w_ = R_IB.transpose()*s.wPost_;
+	x.P_.setZero();
+	x.P_.block(0,0,9,9) = s.PSm_.block(0,0,9,9);
+	x.P_.block(9,9,3,3) = s.PSm_.block(12,12,3,3)+pManager_->Rw_;
+	return x;
+}
+
+void SmootherOCEKF::recordPrior(const FilterOCEKF::InternState& x,const Eigen::Matrix<double,15,15>& F){
+	steps_.push_back(SmootherStep());
+	SmootherStep& s = steps_.back();
+	s.t_ = x.t_;
+	s.rPre_ = x.r_;
+	s.vPre_ = x.v_;
+	s.qPre_ = x.q_;
+	s.bfPre_ = x.bf_;
+	s.bwPre_ = x.bw_;
+	s.PPre_ = x.P_.block(0,0,15,15);
+	s.F_ = F;
+}
+
+void SmootherOCEKF::recordPosterior(const FilterOCEKF::InternState& x){
+	SmootherStep& s = steps_.back();
+	s.rPost_ = x.r_;
+	s.vPost_ = x.v_;
+	s.qPost_ = x.q_;
+	s.bfPost_ = x.bf_;
+	s.bwPost_ = x.bw_;
+	s.wPost_ = x.w_;
+	s.PPost_ = x.P_.block(0,0,15,15);
+}
+
+void SmootherOCEKF::loadParam(const char* pFilename){
+	// Open parameter file
+	TiXmlDocument* doc = ParamCache::get(pFilename);
+	if (doc==NULL) return;
+
+	// Define handles and elements
+	TiXmlHandle hDoc(doc);
+	TiXmlElement* pElem;
+	TiXmlHandle hRoot(0);
+
+	// Get root
+	pElem=hDoc.FirstChildElement("LeggedStateEstimator").Element();
+	if (pElem){
+		hRoot=TiXmlHandle(pElem);
+
+		pElem=hRoot.FirstChild("SmootherSettings").Element();
+		if (pElem){
+			pElem->QueryIntAttribute("threads", &nThreads_);
+			pElem->QueryIntAttribute("overlap", &overlap_);
+		}
+	}
+}
+
+}